@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "table.h"
+
+/*
+ * Checkpoints of long runs printing to a file (--checkpoint, --resume).
+ *
+ * A checkpoint is one line of text: the formula hash, the statement being printed, the rows of
+ * it already in the output and the size of the output at that point. It is written to a
+ * temporary file, flushed to disk and renamed over the previous one, and the directory is flushed
+ * so the rename itself is on disk: a crash at any moment leaves either the old or the new
+ * checkpoint, never a torn one. The output itself is synced
+ * before, so the checkpoint never claims more than what is on disk.
+ */
+
+#define CHECKPOINT_MAGIC "truth-table-checkpoint"
+
+// Monotonic clock, in seconds
+double now_seconds(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Starts counting the interval to the next checkpoint
+void start_progress(Progress *progress){
+    progress->last = now_seconds();
+}
+
+// True when the interval since the last checkpoint has passed
+int checkpoint_due(const Progress *progress){
+    return now_seconds() - progress->last >= progress->interval;
+}
+
+// Syncs the directory holding path, so a rename into it survives a crash, returns 0 on failure
+static int sync_directory(const char *path){
+    const char *slash = strrchr(path, '/');
+    size_t length = slash == NULL || slash == path ? 1 : (size_t)(slash - path);
+    char *directory = malloc(length + 1);
+    if (directory == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(directory, slash == NULL ? "." : path, length);
+    directory[length] = '\0';
+    int fd = open(directory, O_RDONLY | O_DIRECTORY);
+    int ok = fd >= 0 && fsync(fd) == 0;
+    if (fd >= 0){
+        close(fd);
+    }
+    free(directory);
+    return ok;
+}
+
+// Syncs the output written to fd and replaces the checkpoint, returns 0 on failure
+int save_checkpoint(Progress *progress, int fd, long long offset){
+    if (fdatasync(fd) != 0){
+        perror("error syncing output file");
+        return 0;
+    }
+
+    size_t length = strlen(progress->path);
+    char *temporary = malloc(length + 5);
+    if (temporary == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(temporary, progress->path, length);
+    memcpy(temporary + length, ".tmp", 5);
+
+    char line[160];
+    int size = snprintf(line, sizeof(line), "%s %016" PRIx64 " %zu %lu %lld\n", CHECKPOINT_MAGIC,
+                        progress->hash, progress->statement, progress->row, offset);
+    int file = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok = file >= 0 && write(file, line, size) == size && fsync(file) == 0;
+    if (file >= 0 && close(file) != 0){
+        ok = 0;
+    }
+    if (ok && rename(temporary, progress->path) != 0){
+        ok = 0;
+    }
+    if (!ok){
+        perror("error writing checkpoint");
+        unlink(temporary);
+    }
+    else if (!sync_directory(progress->path)){
+        perror("error syncing checkpoint directory");  // renamed, but the rename may be lost
+        ok = 0;
+    }
+    free(temporary);
+    progress->last = now_seconds();
+    return ok;
+}
+
+// Reads the checkpoint of progress->path, returns 0 with err filled if it is missing or does not match
+int load_checkpoint(Progress *progress, const Formula *formula, long long *offset, char *err, size_t err_len){
+    FILE *file = fopen(progress->path, "r");
+    if (file == NULL){
+        snprintf(err, err_len, "cannot open checkpoint %s", progress->path);
+        return 0;
+    }
+    char magic[32];
+    uint64_t hash;
+    int fields = fscanf(file, "%31s %" SCNx64 " %zu %lu %lld", magic, &hash, &progress->statement,
+                        &progress->row, offset);
+    fclose(file);
+
+    if (fields != 5 || strcmp(magic, CHECKPOINT_MAGIC) != 0){
+        snprintf(err, err_len, "%s is not a checkpoint", progress->path);
+        return 0;
+    }
+    if (hash != progress->hash){
+        snprintf(err, err_len, "checkpoint %s was written for a different formula", progress->path);
+        return 0;
+    }
+    // past the last statement only once every statement is printed, and never past the rows of one
+    unsigned long rows = 0;
+    if (progress->statement < formula->num_statements){
+        size_t num_vars = formula->statements[progress->statement].num_vars;
+        rows = num_vars < 64 ? 1UL << num_vars : 0;
+    }
+    if (progress->statement > formula->num_statements || progress->row > rows ||
+        (progress->row % 64 != 0 && progress->row != rows) || *offset < 0){
+        snprintf(err, err_len, "checkpoint %s is out of range", progress->path);
+        return 0;
+    }
+    return 1;
+}
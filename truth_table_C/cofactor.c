@@ -0,0 +1,400 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "table.h"
+
+/*
+ * Shannon-cofactor parallel evaluation.
+ *
+ * k splitting variables are picked among the inputs referenced most often in the cone of the
+ * statement, and the 2^k cofactors are built by copying the cone with those inputs replaced
+ * by constants. emit_instr folds the constants away, so many cofactors collapse to False (or
+ * to a much smaller formula) before any row is evaluated. The cofactors are spread over the
+ * threads with work stealing and evaluated into bit-packed columns, which are stitched back
+ * together in the original row order when printing.
+ *
+ * The last 6 declared variables are never split: they select the row inside a 64-row word,
+ * so every word of the table belongs to exactly one cofactor.
+ */
+
+#define MAX_SPLIT 16
+#define MAX_STITCH_BYTES (1UL << 30)  // Columns kept in memory before falling back to a plain sweep
+
+typedef struct {
+    int constant;          // 1 if every output of the cofactor folded to a constant
+    uint64_t *constants;   // Per output: all ones or all zeros, when the output is constant
+    uint64_t **columns;    // Per output: bit-packed values on the cofactor rows, NULL if constant
+} Cofactor;
+
+typedef struct {
+    _Atomic uint64_t range;  // Cofactors still owned by the worker: low 32 bits first, high 32 bits end
+    char padding[56];        // Keep each range on its own cache line
+} WorkRange;
+
+typedef struct {
+    const Formula *formula;
+    const Statement *stmt;
+    size_t num_split;
+    int *split_bit;           // Per declared variable: position among the split variables, -1 otherwise
+    unsigned int *new_index;  // Per declared variable: index among the remaining variables
+    Cofactor *cofactors;
+    WorkRange *ranges;
+    size_t num_threads;
+    _Atomic unsigned long folded;  // Cofactors whose outputs were all constant
+} CofactorJob;
+
+typedef struct {
+    CofactorJob *job;
+    size_t id;
+} Worker;
+
+static uint64_t pack_range(uint32_t first, uint32_t end){
+    return ((uint64_t)end << 32) | first;
+}
+
+// Takes the next cofactor of the worker's own range
+static int pop_own(WorkRange *range, uint32_t *item){
+    uint64_t current = atomic_load(&range->range);
+    for (;;){
+        uint32_t first = (uint32_t)current, end = (uint32_t)(current >> 32);
+        if (first >= end){
+            return 0;
+        }
+        if (atomic_compare_exchange_weak(&range->range, &current, pack_range(first + 1, end))){
+            *item = first;
+            return 1;
+        }
+    }
+}
+
+// Moves the upper half of the fullest other range into the thief's (empty) range
+static int steal(CofactorJob *job, size_t thief){
+    for (;;){
+        size_t victim = job->num_threads;
+        uint32_t most = 0;
+        for (size_t i = 0; i < job->num_threads; i++){
+            uint64_t current = atomic_load(&job->ranges[i].range);
+            uint32_t left = (uint32_t)(current >> 32) - (uint32_t)current;
+            if (i != thief && (uint32_t)current < (uint32_t)(current >> 32) && left > most){
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim == job->num_threads){
+            return 0;
+        }
+        uint64_t current = atomic_load(&job->ranges[victim].range);
+        uint32_t first = (uint32_t)current, end = (uint32_t)(current >> 32);
+        if (first >= end){
+            continue;
+        }
+        uint32_t middle = first + (end - first) / 2;
+        if (atomic_compare_exchange_strong(&job->ranges[victim].range, &current, pack_range(first, middle))){
+            atomic_store(&job->ranges[thief].range, pack_range(middle, end));
+            return 1;
+        }
+    }
+}
+
+// Copies the cone of the statement into a new formula with the split variables fixed by assignment
+static Formula* build_cofactor(const CofactorJob *job, unsigned long assignment, unsigned int *map, Statement *result){
+    const Formula *formula = job->formula;
+    const Statement *stmt = job->stmt;
+    Formula *cofactor = create_formula();
+
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &formula->code[i];
+        switch (in->op){
+            case OP_CONST:
+                map[i] = emit_instr(cofactor, OP_CONST, in->a, 0);
+                break;
+            case OP_INPUT:
+                if (job->split_bit[in->a] >= 0){
+                    map[i] = emit_instr(cofactor, OP_CONST, (assignment >> job->split_bit[in->a]) & 1, 0);
+                }
+                else {
+                    map[i] = emit_instr(cofactor, OP_INPUT, job->new_index[in->a], 0);
+                }
+                break;
+            case OP_NOT:
+                map[i] = emit_instr(cofactor, OP_NOT, map[in->a], 0);
+                break;
+            default:
+                map[i] = emit_instr(cofactor, in->op, map[in->a], map[in->b]);
+                break;
+        }
+    }
+
+    memset(result, 0, sizeof(Statement));
+    result->kind = stmt->kind;
+    result->num_vars = stmt->num_vars - job->num_split;
+    result->num_outputs = stmt->num_outputs;
+    result->outputs = malloc((stmt->num_outputs + 1) * sizeof(unsigned int));
+    if (result->outputs == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        result->outputs[j] = map[stmt->outputs[j]];
+    }
+    compute_cone(cofactor, result);
+    return cofactor;
+}
+
+static void evaluate_cofactor(CofactorJob *job, unsigned long assignment, unsigned int *map){
+    Statement stmt;
+    Formula *formula = build_cofactor(job, assignment, map, &stmt);
+    Cofactor *cofactor = &job->cofactors[assignment];
+    size_t num_outputs = stmt.num_outputs;
+
+    cofactor->constants = calloc(num_outputs + 1, sizeof(uint64_t));
+    cofactor->columns = calloc(num_outputs + 1, sizeof(uint64_t *));
+    if (cofactor->constants == NULL || cofactor->columns == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    cofactor->constant = 1;
+    for (size_t j = 0; j < num_outputs; j++){
+        const Instr *out = &formula->code[stmt.outputs[j]];
+        if (out->op == OP_CONST){
+            cofactor->constants[j] = out->a ? ~0ULL : 0;
+        }
+        else {
+            cofactor->constant = 0;
+        }
+    }
+
+    if (cofactor->constant){
+        atomic_fetch_add(&job->folded, 1);
+    }
+    else {
+        unsigned long words = (1UL << stmt.num_vars) / 64;
+        for (size_t j = 0; j < num_outputs; j++){
+            if (formula->code[stmt.outputs[j]].op != OP_CONST){
+                cofactor->columns[j] = malloc(words * sizeof(uint64_t));
+                if (cofactor->columns[j] == NULL){
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+        }
+        uint64_t *values = alloc_values(formula);
+        for (unsigned long w = 0; w < words; w++){
+            eval_word(formula, &stmt, w * 64, values);
+            for (size_t j = 0; j < num_outputs; j++){
+                if (cofactor->columns[j] != NULL){
+                    cofactor->columns[j][w] = values[stmt.outputs[j]];
+                }
+            }
+        }
+        free(values);
+    }
+
+    free(stmt.outputs);
+    free(stmt.cone);
+    free_formula(formula);
+}
+
+static void* cofactor_worker(void *arg){
+    Worker *worker = arg;
+    CofactorJob *job = worker->job;
+    unsigned int *map = malloc((job->formula->size + 1) * sizeof(unsigned int));
+    if (map == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    uint32_t item;
+    for (;;){
+        while (pop_own(&job->ranges[worker->id], &item)){
+            evaluate_cofactor(job, item, map);
+        }
+        if (!steal(job, worker->id)){
+            break;
+        }
+    }
+
+    free(map);
+    return NULL;
+}
+
+// Picks the variables to split on: most referenced inputs of the cone, outside the last 6 declared
+static size_t choose_split(const Formula *formula, const Statement *stmt, size_t wanted, int *split_bit){
+    size_t num_vars = stmt->num_vars;
+    unsigned long *uses = calloc(num_vars + 1, sizeof(unsigned long));
+    if (uses == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        const Instr *in = &formula->code[stmt->cone[k]];
+        if (in->op == OP_NOT || in->op == OP_AND || in->op == OP_OR){
+            if (formula->code[in->a].op == OP_INPUT) uses[formula->code[in->a].a]++;
+            if (in->op != OP_NOT && formula->code[in->b].op == OP_INPUT) uses[formula->code[in->b].a]++;
+        }
+    }
+
+    for (size_t j = 0; j < num_vars; j++){
+        split_bit[j] = -1;
+    }
+    size_t chosen = 0;
+    while (chosen < wanted){
+        size_t best = num_vars;
+        for (size_t j = 0; j + 6 < num_vars; j++){
+            if (split_bit[j] < 0 && (best == num_vars || uses[j] > uses[best])){
+                best = j;
+            }
+        }
+        if (best == num_vars || uses[best] == 0){
+            break;
+        }
+        split_bit[best] = chosen++;
+    }
+    free(uses);
+    return chosen;
+}
+
+// Splitting variables for the options, in split_bit, returns 0 when the statement is not split
+size_t split_variables(const Formula *formula, const Statement *stmt, const Options *options, int *split_bit){
+    size_t num_vars = stmt->num_vars;
+    size_t num_threads = options->num_threads > 0 ? options->num_threads : 1;
+
+    // enough cofactors for the stealing to even out the work, unless the user picked k
+    size_t wanted = options->split;
+    if (wanted == 0){
+        while ((1UL << wanted) < 8 * num_threads && wanted < MAX_SPLIT){
+            wanted++;
+        }
+    }
+    if (wanted > MAX_SPLIT){
+        wanted = MAX_SPLIT;
+    }
+
+    unsigned long rows = num_vars < 64 ? 1UL << num_vars : 0;
+    size_t stitch_bytes = rows / 8 * stmt->num_outputs;
+    if (num_vars >= 7 && num_vars < 64 && stitch_bytes <= MAX_STITCH_BYTES){
+        return choose_split(formula, stmt, wanted, split_bit);
+    }
+    return 0;
+}
+
+// Index of the cofactor word holding the 64 rows starting at base
+static unsigned long local_word(unsigned long base, size_t num_vars, const int *split_bit){
+    unsigned long word = 0;
+    size_t position = 0;
+    for (size_t j = num_vars; j-- > 0; ){
+        size_t bit = num_vars - 1 - j;
+        if (bit >= 6 && split_bit[j] < 0){
+            word |= ((base >> bit) & 1) << position++;
+        }
+    }
+    return word;
+}
+
+static unsigned long cofactor_of(unsigned long base, size_t num_vars, const int *split_bit){
+    unsigned long assignment = 0;
+    for (size_t j = 0; j < num_vars; j++){
+        if (split_bit[j] >= 0){
+            assignment |= ((base >> (num_vars - 1 - j)) & 1) << split_bit[j];
+        }
+    }
+    return assignment;
+}
+
+void run_statement_parallel(const Formula *formula, const Statement *stmt, const Options *options, FILE *out){
+    if (is_query(stmt)){
+        run_statement(formula, stmt, out);  // no rows to split
+        return;
+    }
+    size_t num_vars = stmt->num_vars;
+    size_t num_threads = options->num_threads > 0 ? options->num_threads : 1;
+    unsigned long rows = num_vars < 64 ? 1UL << num_vars : 0;
+    int *split_bit = malloc((num_vars + 1) * sizeof(int));
+    size_t num_split = split_variables(formula, stmt, options, split_bit);
+    if (num_split == 0){
+        free(split_bit);
+        run_statement_pipelined(formula, stmt, options, out);
+        return;
+    }
+
+    CofactorJob job;
+    job.formula = formula;
+    job.stmt = stmt;
+    job.num_split = num_split;
+    job.split_bit = split_bit;
+    job.new_index = malloc((num_vars + 1) * sizeof(unsigned int));
+    for (size_t j = 0, next = 0; j < num_vars; j++){
+        job.new_index[j] = split_bit[j] < 0 ? next++ : 0;
+    }
+    size_t num_cofactors = 1UL << num_split;
+    job.cofactors = calloc(num_cofactors, sizeof(Cofactor));
+    job.num_threads = num_threads;
+    job.ranges = aligned_alloc(64, num_threads * sizeof(WorkRange));
+    atomic_init(&job.folded, 0);
+    if (job.new_index == NULL || job.cofactors == NULL || job.ranges == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t t = 0; t < num_threads; t++){
+        atomic_init(&job.ranges[t].range, pack_range(num_cofactors * t / num_threads,
+                                                     num_cofactors * (t + 1) / num_threads));
+    }
+
+    pthread_t *threads = malloc(num_threads * sizeof(pthread_t));
+    Worker *workers = malloc(num_threads * sizeof(Worker));
+    for (size_t t = 0; t < num_threads; t++){
+        workers[t].job = &job;
+        workers[t].id = t;
+        pthread_create(&threads[t], NULL, cofactor_worker, &workers[t]);
+    }
+    for (size_t t = 0; t < num_threads; t++){
+        pthread_join(threads[t], NULL);
+    }
+
+    // stitch the cofactor columns back in row order
+    print_header(stmt, formula->variables, out);
+    OutputBuffer *buffer = create_output_buffer(out);
+    uint64_t *values = alloc_values(formula);
+    for (unsigned long base = 0; base < rows; base += 64){
+        const Cofactor *cofactor = &job.cofactors[cofactor_of(base, num_vars, split_bit)];
+        unsigned long word = cofactor->constant ? 0 : local_word(base, num_vars, split_bit);
+        uint64_t ones = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            uint64_t value = cofactor->columns[j] ? cofactor->columns[j][word] : cofactor->constants[j];
+            values[stmt->outputs[j]] = value;
+            ones |= value;
+        }
+        uint64_t selected = stmt->kind == STMT_SHOW ? ~0ULL : ones;
+        while (selected != 0){
+            unsigned int bit = __builtin_ctzll(selected);
+            emit_row(buffer, stmt, base + bit, values, bit);
+            selected &= selected - 1;
+        }
+    }
+    flush_output(buffer);
+    free(buffer);
+    free(values);
+
+    for (size_t c = 0; c < num_cofactors; c++){
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            free(job.cofactors[c].columns[j]);
+        }
+        free(job.cofactors[c].columns);
+        free(job.cofactors[c].constants);
+    }
+    if (options->verbose){
+        fprintf(stderr, "cofactors: %lu of %zu folded to constants (split on %zu variables)\n",
+                (unsigned long)atomic_load(&job.folded), num_cofactors, num_split);
+    }
+    free(workers);
+    free(threads);
+    free(job.ranges);
+    free(job.cofactors);
+    free(job.new_index);
+    free(split_bit);
+}
@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * Consecutive show and show_ones statements printed from one sweep of the rows.
+ *
+ * The outputs of the statements are gathered into one statement whose cone is the union of
+ * theirs, so an instruction they share (the structural hashing makes every common subterm one
+ * instruction) is evaluated once per word for all of them. The sweep runs over the rows of the
+ * statement with the most declared variables; a statement reached with fewer variables
+ * declared does not depend on the ones declared after it, and its row r is the sweep row whose
+ * extra low bits are 0, r shifted left by their number. Each row is routed to the statements
+ * printing it: the first one writes to the output directly and the others to temporary files,
+ * copied to the output after the sweep, so the text still comes out in statement order.
+ */
+
+#define COPY_BUFFER_SIZE (1 << 20)
+
+// Bits of a word at the rows whose low shift bits are 0
+static uint64_t stride_mask(size_t shift){
+    uint64_t mask = 0;
+    for (unsigned int bit = 0; bit < 64; bit += 1U << shift){
+        mask |= 1ULL << bit;
+    }
+    return mask;
+}
+
+// Gathers the outputs of statements first..end-1 into result, with the cone of all of them
+void fused_statement(const Formula *formula, size_t first, size_t end, Statement *result){
+    memset(result, 0, sizeof(Statement));
+    result->kind = STMT_SHOW;
+    for (size_t s = first; s < end; s++){
+        const Statement *stmt = &formula->statements[s];
+        result->num_outputs += stmt->num_outputs;
+        if (stmt->num_vars > result->num_vars){
+            result->num_vars = stmt->num_vars;
+        }
+    }
+    result->outputs = malloc((result->num_outputs + 1) * sizeof(unsigned int));
+    if (result->outputs == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    size_t next = 0;
+    for (size_t s = first; s < end; s++){
+        const Statement *stmt = &formula->statements[s];
+        memcpy(result->outputs + next, stmt->outputs, stmt->num_outputs * sizeof(unsigned int));
+        next += stmt->num_outputs;
+    }
+    compute_cone(formula, result);
+}
+
+// Appends the spooled text of a statement to out
+static int copy_spool(FILE *spool, FILE *out){
+    char *buffer = malloc(COPY_BUFFER_SIZE);
+    if (buffer == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    rewind(spool);
+    size_t read;
+    int ok = 1;
+    while ((read = fread(buffer, 1, COPY_BUFFER_SIZE, spool)) > 0){
+        if (fwrite(buffer, 1, read, out) != read){
+            ok = 0;
+            break;
+        }
+    }
+    if (ferror(spool)){
+        ok = 0;
+    }
+    free(buffer);
+    return ok;
+}
+
+void run_fused(const Formula *formula, size_t first, size_t end, const Options *options, FILE *out){
+    Statement sweep;
+    fused_statement(formula, first, end, &sweep);
+    size_t count = end - first;
+    unsigned long rows = 1UL << sweep.num_vars;
+
+    OutputBuffer **buffers = malloc(count * sizeof(OutputBuffer*));
+    FILE **spools = calloc(count, sizeof(FILE*));
+    if (buffers == NULL || spools == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t s = 0; s < count; s++){
+        const Statement *stmt = &formula->statements[first + s];
+        FILE *target = out;
+        if (s > 0){
+            spools[s] = tmpfile();
+            if (spools[s] == NULL){
+                perror("error creating temporary file");
+                exit(1);
+            }
+            target = spools[s];
+        }
+        print_header(stmt, formula->variables, target);
+        buffers[s] = create_output_buffer(target);
+    }
+
+    uint64_t *values = alloc_values(formula);
+    for (unsigned long base = 0; base < rows; base += 64){
+        eval_word(formula, &sweep, base, values);
+        uint64_t valid = valid_rows_mask(rows, base);
+        for (size_t s = 0; s < count; s++){
+            const Statement *stmt = &formula->statements[first + s];
+            size_t shift = sweep.num_vars - stmt->num_vars;
+            uint64_t selected = valid;
+            if (shift >= 6){
+                if ((base & ((1UL << shift) - 1)) != 0){
+                    continue;  // no row of the statement in this word
+                }
+                selected &= 1;
+            }
+            else {
+                selected &= stride_mask(shift);
+            }
+            if (stmt->kind == STMT_SHOW_ONES){
+                uint64_t ones = 0;
+                for (size_t j = 0; j < stmt->num_outputs; j++){
+                    ones |= values[stmt->outputs[j]];
+                }
+                selected &= ones;
+            }
+            while (selected != 0){
+                unsigned int bit = __builtin_ctzll(selected);
+                emit_row(buffers[s], stmt, (base + bit) >> shift, values, bit);
+                selected &= selected - 1;
+            }
+        }
+    }
+
+    for (size_t s = 0; s < count; s++){
+        flush_output(buffers[s]);
+        free(buffers[s]);
+        if (spools[s] != NULL){
+            if (!copy_spool(spools[s], out)){
+                perror("error copying temporary file");
+            }
+            fclose(spools[s]);
+        }
+    }
+    if (options->verbose){
+        fprintf(stderr, "fuse: %zu statements in one sweep of %lu rows, cone of %zu instructions\n",
+                count, rows, sweep.cone_size);
+    }
+
+    free(values);
+    free(spools);
+    free(buffers);
+    free(sweep.outputs);
+    free(sweep.cone);
+}
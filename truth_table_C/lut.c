@@ -0,0 +1,407 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * k-LUT mapping of a statement's cone.
+ *
+ * Every gate gets its best cuts of at most 6 leaves, enumerated bottom-up by merging the
+ * cuts of its children (priority cuts, MAX_CUTS per gate). The function of a cut over its
+ * leaves is a 64-bit truth table: bit m is the value of the gate when leaf i equals bit i of
+ * m, so the table of a single leaf i is low_bit_patterns[i] and merged cuts combine their
+ * stretched tables with the gate's own operation. The cone is then covered from the outputs
+ * with the cut of least area flow at every gate, and each selected cut is rebuilt from its
+ * table as a short network of and/or/not gates (a Shannon decomposition that stops on
+ * constant, equal and literal cofactors), through emit_instr so equal tables share gates.
+ * Evaluation is bit-sliced, 64 rows per word, so a cut is evaluated through that precomputed
+ * network rather than by indexing its table row by row. The mapping is kept only when the
+ * statement's cone gets smaller; otherwise the instructions it emitted are dropped again.
+ */
+
+#define LUT_SIZE 6
+#define MAX_CUTS 8           // Cuts kept per gate, besides the trivial one
+#define MAX_CANDIDATES ((MAX_CUTS + 1) * (MAX_CUTS + 1))
+
+typedef struct {
+    unsigned int leaves[LUT_SIZE];  // Sorted instruction indices
+    unsigned char size;
+    uint64_t table;                 // Bit m: value of the cut when leaf i is bit i of m
+    double flow;                    // Area flow: network size plus the shared flow of the leaves
+} Cut;
+
+typedef struct {
+    Formula *formula;
+    uint64_t *cost_keys;            // Memo of network sizes by truth table (open addressing)
+    unsigned int *cost_values;      // Size + 1, 0 when the slot is empty
+    unsigned long cost_slots;
+    unsigned long cost_count;
+} Mapper;
+
+/* TRUTH TABLES */
+
+// Mask of the minterms where leaf i is 0
+static uint64_t low_half(int i){
+    return ~low_bit_patterns[i];
+}
+
+// Table with leaf i fixed to value, as a table that no longer depends on leaf i
+static uint64_t cofactor_table(uint64_t table, int i, int value){
+    unsigned int shift = 1u << i;
+    if (value){
+        uint64_t ones = table & low_bit_patterns[i];
+        return ones | (ones >> shift);
+    }
+    uint64_t zeros = table & low_half(i);
+    return zeros | (zeros << shift);
+}
+
+static int depends_on(uint64_t table, int i){
+    return cofactor_table(table, i, 0) != cofactor_table(table, i, 1);
+}
+
+// Table of a cut over the leaves of a larger cut containing them
+static uint64_t stretch(uint64_t table, const Cut *from, const Cut *to){
+    int position[LUT_SIZE];
+    for (int i = 0, j = 0; i < from->size; i++){
+        while (to->leaves[j] != from->leaves[i]){
+            j++;
+        }
+        position[i] = j;
+    }
+    uint64_t result = 0;
+    for (unsigned int m = 0; m < 64; m++){
+        unsigned int index = 0;
+        for (int i = 0; i < from->size; i++){
+            index |= ((m >> position[i]) & 1) << i;
+        }
+        result |= ((table >> index) & 1) << m;
+    }
+    return result;
+}
+
+// Drops the leaves the table does not depend on
+static void shrink(Cut *cut){
+    for (int i = cut->size - 1; i >= 0; i--){
+        if (depends_on(cut->table, i)){
+            continue;
+        }
+        // move the leaves above i down by one position
+        uint64_t table = cofactor_table(cut->table, i, 0), moved = 0;
+        for (unsigned int m = 0; m < 64; m++){
+            unsigned int index = (m & ((1u << i) - 1)) | ((m >> i) << (i + 1));
+            moved |= ((table >> (index & 63)) & 1) << m;
+        }
+        cut->table = moved;
+        for (int j = i; j + 1 < cut->size; j++){
+            cut->leaves[j] = cut->leaves[j + 1];
+        }
+        cut->size--;
+    }
+}
+
+/* NETWORKS */
+
+/*
+ * Builds the table over leaves as gates, returns the instruction when emitting, and adds the
+ * number of gates to cost either way. The split leaf is the one with a constant or equal
+ * cofactor when there is one, so and/or/literal shapes cost one gate per leaf.
+ */
+static unsigned int build_network(Mapper *mapper, uint64_t table, int size, const unsigned int *leaves,
+                                  int emit, size_t *cost){
+    Formula *formula = mapper->formula;
+    if (table == 0 || table == ~0ULL){
+        return emit ? emit_instr(formula, OP_CONST, table != 0, 0) : 0;
+    }
+
+    int split = -1, best_score = -1;
+    for (int i = 0; i < size; i++){
+        if (!depends_on(table, i)){
+            continue;
+        }
+        uint64_t f0 = cofactor_table(table, i, 0), f1 = cofactor_table(table, i, 1);
+        int score = (f0 == 0 || f0 == ~0ULL || f1 == 0 || f1 == ~0ULL) ? 2 : 1;
+        if (score > best_score){
+            best_score = score;
+            split = i;
+        }
+    }
+    uint64_t f0 = cofactor_table(table, split, 0), f1 = cofactor_table(table, split, 1);
+    unsigned int x = emit ? leaves[split] : 0;
+
+    // literals
+    if (f0 == 0 && f1 == ~0ULL){
+        return x;
+    }
+    if (f0 == ~0ULL && f1 == 0){
+        (*cost)++;
+        return emit ? emit_instr(formula, OP_NOT, x, 0) : 0;
+    }
+    // one constant cofactor: a single and/or with the literal
+    if (f0 == 0 || f0 == ~0ULL){
+        unsigned int rest = build_network(mapper, f1, size, leaves, emit, cost);
+        *cost += 1 + (f0 != 0);
+        if (!emit){
+            return 0;
+        }
+        return f0 == 0 ? emit_instr(formula, OP_AND, x, rest) :
+                         emit_instr(formula, OP_OR, emit_instr(formula, OP_NOT, x, 0), rest);
+    }
+    if (f1 == 0 || f1 == ~0ULL){
+        unsigned int rest = build_network(mapper, f0, size, leaves, emit, cost);
+        *cost += 1 + (f1 == 0);
+        if (!emit){
+            return 0;
+        }
+        return f1 == ~0ULL ? emit_instr(formula, OP_OR, x, rest) :
+                             emit_instr(formula, OP_AND, emit_instr(formula, OP_NOT, x, 0), rest);
+    }
+    // multiplexer: (x and f1) or (not x and f0)
+    unsigned int high = build_network(mapper, f1, size, leaves, emit, cost);
+    unsigned int low = build_network(mapper, f0, size, leaves, emit, cost);
+    *cost += 4;
+    if (!emit){
+        return 0;
+    }
+    return emit_instr(formula, OP_OR, emit_instr(formula, OP_AND, x, high),
+                      emit_instr(formula, OP_AND, emit_instr(formula, OP_NOT, x, 0), low));
+}
+
+// Gates in the network of a table, memoized
+static size_t network_cost(Mapper *mapper, uint64_t table, int size){
+    unsigned long mask = mapper->cost_slots - 1;
+    unsigned long slot = (unsigned long)((table * 0x9E3779B97F4A7C15ULL) >> 20) & mask;
+    while (mapper->cost_values[slot] != 0){
+        if (mapper->cost_keys[slot] == table){
+            return mapper->cost_values[slot] - 1;
+        }
+        slot = (slot + 1) & mask;
+    }
+    size_t cost = 0;
+    build_network(mapper, table, size, NULL, 0, &cost);
+    if (2 * (mapper->cost_count + 1) <= mapper->cost_slots){
+        mapper->cost_keys[slot] = table;
+        mapper->cost_values[slot] = (unsigned int)cost + 1;
+        mapper->cost_count++;
+    }
+    return cost;
+}
+
+/* CUTS */
+
+// Union of the leaves of two cuts, returns 0 when it has more than LUT_SIZE leaves
+static int merge_leaves(const Cut *a, const Cut *b, Cut *result){
+    int i = 0, j = 0, n = 0;
+    while (i < a->size || j < b->size){
+        unsigned int next;
+        if (j >= b->size || (i < a->size && a->leaves[i] < b->leaves[j])){
+            next = a->leaves[i++];
+        }
+        else if (i >= a->size || b->leaves[j] < a->leaves[i]){
+            next = b->leaves[j++];
+        }
+        else {
+            next = a->leaves[i++];
+            j++;
+        }
+        if (n == LUT_SIZE){
+            return 0;
+        }
+        result->leaves[n++] = next;
+    }
+    result->size = (unsigned char)n;
+    return 1;
+}
+
+static int same_leaves(const Cut *a, const Cut *b){
+    return a->size == b->size && memcmp(a->leaves, b->leaves, a->size * sizeof(unsigned int)) == 0;
+}
+
+static int by_flow(const void *a, const void *b){
+    const Cut *x = a, *y = b;
+    if (x->flow != y->flow){
+        return x->flow < y->flow ? -1 : 1;
+    }
+    return (int)x->size - (int)y->size;
+}
+
+/*
+ * Maps the cone of stmt onto cuts of at most 6 leaves and rebuilds it from their truth tables.
+ * The outputs and cone of stmt are replaced when the mapped cone is smaller.
+ */
+void map_luts(Formula *formula, Statement *stmt){
+    size_t cone_size = stmt->cone_size;
+    if (cone_size == 0){
+        return;
+    }
+
+    Mapper mapper;
+    mapper.formula = formula;
+    mapper.cost_slots = 1024;
+    mapper.cost_count = 0;
+    while (mapper.cost_slots < 4 * cone_size){
+        mapper.cost_slots *= 2;
+    }
+    mapper.cost_keys = calloc(mapper.cost_slots, sizeof(uint64_t));
+    mapper.cost_values = calloc(mapper.cost_slots, sizeof(unsigned int));
+    unsigned int *position = malloc((formula->size + 1) * sizeof(unsigned int));
+    unsigned int *fanout = calloc(cone_size + 1, sizeof(unsigned int));
+    Cut *cuts = malloc((cone_size * (MAX_CUTS + 1) + 1) * sizeof(Cut));
+    unsigned char *num_cuts = calloc(cone_size + 1, 1);
+    double *best_flow = calloc(cone_size + 1, sizeof(double));
+    Cut *candidates = malloc(MAX_CANDIDATES * sizeof(Cut));
+    if (mapper.cost_keys == NULL || mapper.cost_values == NULL || position == NULL || fanout == NULL ||
+        cuts == NULL || num_cuts == NULL || best_flow == NULL || candidates == NULL){
+        allocation_failed();
+    }
+
+    for (size_t k = 0; k < cone_size; k++){
+        position[stmt->cone[k]] = k;
+    }
+    for (size_t k = 0; k < cone_size; k++){
+        const Instr *in = &formula->code[stmt->cone[k]];
+        if (in->op == OP_NOT || in->op == OP_AND || in->op == OP_OR){
+            fanout[position[in->a]]++;
+            if (in->op != OP_NOT){
+                fanout[position[in->b]]++;
+            }
+        }
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        fanout[position[stmt->outputs[j]]]++;
+    }
+
+    // cut enumeration, children first
+    for (size_t k = 0; k < cone_size; k++){
+        unsigned int node = stmt->cone[k];
+        Instr in = formula->code[node];
+        Cut *own = &cuts[k * (MAX_CUTS + 1)];
+        size_t count = 0;
+
+        if (in.op == OP_NOT){
+            const Cut *child = &cuts[position[in.a] * (MAX_CUTS + 1)];
+            for (size_t c = 0; c < num_cuts[position[in.a]]; c++){
+                candidates[count] = child[c];
+                candidates[count].table = ~child[c].table;
+                count++;
+            }
+        }
+        else if (in.op == OP_AND || in.op == OP_OR){
+            const Cut *left = &cuts[position[in.a] * (MAX_CUTS + 1)];
+            const Cut *right = &cuts[position[in.b] * (MAX_CUTS + 1)];
+            for (size_t l = 0; l < num_cuts[position[in.a]]; l++){
+                for (size_t r = 0; r < num_cuts[position[in.b]]; r++){
+                    Cut *cut = &candidates[count];
+                    if (!merge_leaves(&left[l], &right[r], cut)){
+                        continue;
+                    }
+                    uint64_t a = stretch(left[l].table, &left[l], cut);
+                    uint64_t b = stretch(right[r].table, &right[r], cut);
+                    cut->table = in.op == OP_AND ? a & b : a | b;
+                    shrink(cut);
+                    int duplicate = 0;
+                    for (size_t d = 0; d < count && !duplicate; d++){
+                        duplicate = same_leaves(&candidates[d], cut);
+                    }
+                    count += !duplicate;
+                }
+            }
+        }
+
+        for (size_t c = 0; c < count; c++){
+            Cut *cut = &candidates[c];
+            cut->flow = (double)network_cost(&mapper, cut->table, cut->size);
+            for (int i = 0; i < cut->size; i++){
+                size_t leaf = position[cut->leaves[i]];
+                cut->flow += best_flow[leaf] / (fanout[leaf] ? fanout[leaf] : 1);
+            }
+        }
+        qsort(candidates, count, sizeof(Cut), by_flow);
+        if (count > MAX_CUTS){
+            count = MAX_CUTS;
+        }
+        best_flow[k] = count > 0 ? candidates[0].flow : 0;
+        memcpy(own, candidates, count * sizeof(Cut));
+
+        // the trivial cut, through which the parents see this node as a leaf
+        Cut *trivial = &own[count++];
+        trivial->size = 1;
+        trivial->leaves[0] = node;
+        trivial->table = low_bit_patterns[0];
+        trivial->flow = 0;
+        num_cuts[k] = (unsigned char)count;
+    }
+
+    // cover from the outputs: every selected cut makes its leaves required
+    unsigned char *required = calloc(cone_size + 1, 1);
+    unsigned int *mapped = malloc((cone_size + 1) * sizeof(unsigned int));
+    if (required == NULL || mapped == NULL){
+        allocation_failed();
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        required[position[stmt->outputs[j]]] = 1;
+    }
+    for (size_t k = cone_size; k-- > 0;){
+        if (!required[k] || num_cuts[k] <= 1){
+            continue;  // inputs and constants only have the trivial cut
+        }
+        const Cut *best = &cuts[k * (MAX_CUTS + 1)];
+        for (int i = 0; i < best->size; i++){
+            required[position[best->leaves[i]]] = 1;
+        }
+    }
+
+    // rebuild the selected cuts from their tables, leaves first
+    size_t emitted = formula->size;  // instructions from here on belong to the mapping
+    for (size_t k = 0; k < cone_size; k++){
+        if (!required[k]){
+            continue;
+        }
+        if (num_cuts[k] <= 1){
+            mapped[k] = stmt->cone[k];
+            continue;
+        }
+        const Cut *best = &cuts[k * (MAX_CUTS + 1)];
+        unsigned int leaves[LUT_SIZE];
+        for (int i = 0; i < best->size; i++){
+            leaves[i] = mapped[position[best->leaves[i]]];
+        }
+        size_t cost = 0;
+        mapped[k] = build_network(&mapper, best->table, best->size, leaves, 1, &cost);
+    }
+
+    unsigned int *old_outputs = malloc((stmt->num_outputs + 1) * sizeof(unsigned int));
+    if (old_outputs == NULL){
+        allocation_failed();
+    }
+    memcpy(old_outputs, stmt->outputs, stmt->num_outputs * sizeof(unsigned int));
+    unsigned int *old_cone = stmt->cone;
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        stmt->outputs[j] = mapped[position[old_outputs[j]]];
+    }
+    compute_cone(formula, stmt);
+    if (stmt->cone_size >= cone_size){
+        // no gain, back to the original cone, without the instructions of the mapping
+        free(stmt->cone);
+        truncate_code(formula, emitted);
+        memcpy(stmt->outputs, old_outputs, stmt->num_outputs * sizeof(unsigned int));
+        stmt->cone = old_cone;
+        stmt->cone_size = cone_size;
+    }
+    else {
+        free(old_cone);
+    }
+
+    free(old_outputs);
+    free(mapped);
+    free(required);
+    free(candidates);
+    free(best_flow);
+    free(num_cuts);
+    free(cuts);
+    free(fanout);
+    free(position);
+    free(mapper.cost_keys);
+    free(mapper.cost_values);
+}
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "table.h"
+
+/*
+ * show and show_ones written straight into the -o file.
+ *
+ * Every row of a statement takes the same number of bytes, so where each row goes in the file
+ * is known before it is evaluated: for show, the header plus the row index times the row
+ * width; for show_ones, a first pass counts the rows printed by every block, and their prefix
+ * sums give the offset of each block. The file is extended to its final size, the space is
+ * reserved so that running out of disk is an error here rather than a fault when a page is
+ * written back, and it is mapped into memory. Worker threads claim blocks of words with an
+ * atomic counter, evaluate them and render their rows in place: there is no reorder buffer and
+ * no lock, and nothing is copied through stdio or a pipe. When the file cannot be extended,
+ * reserved or mapped (not a regular file, disk full), nothing is written and the caller
+ * falls back to the pipeline.
+ */
+
+#define MAPPED_BLOCK_WORDS 256  // Words claimed at a time by a worker: 16384 rows
+
+typedef struct {
+    const Formula *formula;
+    const Statement *stmt;
+    unsigned long rows;
+    unsigned long num_blocks;
+    size_t width;               // Bytes of a row
+    char *text;                 // Where the first row goes in the mapping
+    unsigned long *printed;     // show_ones: rows printed before each block, num_blocks + 1 entries
+    int counting;               // First pass of show_ones: count into printed[b + 1]
+    _Atomic unsigned long next_block;
+} MappedJob;
+
+static void* mapped_worker(void *arg){
+    MappedJob *job = arg;
+    const Statement *stmt = job->stmt;
+    size_t num_vars = stmt->num_vars;
+    unsigned long total_words = (job->rows + 63) / 64;
+    uint64_t *values = alloc_values(job->formula);
+
+    for (;;){
+        unsigned long block = atomic_fetch_add(&job->next_block, 1);
+        if (block >= job->num_blocks){
+            break;
+        }
+        unsigned long first_word = block * MAPPED_BLOCK_WORDS;
+        unsigned long end_word = first_word + MAPPED_BLOCK_WORDS < total_words ? first_word + MAPPED_BLOCK_WORDS : total_words;
+        unsigned long row_index = stmt->kind == STMT_SHOW ? first_word * 64 : job->printed[block];
+        char *p = job->text + row_index * job->width;
+        unsigned long count = 0;
+
+        for (unsigned long w = first_word; w < end_word; w++){
+            unsigned long base = w * 64;
+            eval_word(job->formula, stmt, base, values);
+            uint64_t selected = valid_rows_mask(job->rows, base);
+            if (stmt->kind == STMT_SHOW_ONES){
+                uint64_t ones = 0;
+                for (size_t j = 0; j < stmt->num_outputs; j++){
+                    ones |= values[stmt->outputs[j]];
+                }
+                selected &= ones;
+            }
+            if (job->counting){
+                count += __builtin_popcountll(selected);
+                continue;
+            }
+            // same rendering as emit_row
+            while (selected != 0){
+                unsigned int bit = __builtin_ctzll(selected);
+                unsigned long row = base + bit;
+                char *line = p;
+                for (size_t j = 0; j < num_vars; j++){
+                    *p++ = '0' + ((row >> (num_vars - 1 - j)) & 1);
+                    *p++ = ' ';
+                }
+                for (size_t j = 0; j < stmt->num_outputs; j++){
+                    *p++ = '0' + ((values[stmt->outputs[j]] >> bit) & 1);
+                    *p++ = ' ';
+                }
+                if (p == line){
+                    *p++ = ' ';
+                }
+                p[-1] = '\n';  // newline instead of the trailing space
+                selected &= selected - 1;
+            }
+        }
+        if (job->counting){
+            job->printed[block + 1] = count;
+        }
+    }
+
+    free(values);
+    return NULL;
+}
+
+static void run_workers(MappedJob *job, size_t num_threads){
+    atomic_store(&job->next_block, 0);
+    pthread_t *workers = malloc(num_threads * sizeof(pthread_t));
+    if (workers == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t t = 0; t < num_threads; t++){
+        pthread_create(&workers[t], NULL, mapped_worker, job);
+    }
+    for (size_t t = 0; t < num_threads; t++){
+        pthread_join(workers[t], NULL);
+    }
+    free(workers);
+}
+
+// Prints the statement into the mapped output file, returns 0 without printing anything if the
+// file cannot be extended and mapped
+int run_statement_mapped(const Formula *formula, const Statement *stmt, const Options *options, FILE *out){
+    if (is_query(stmt) || stmt->num_vars >= 64){
+        return 0;
+    }
+    struct stat status;
+    int fd = fileno(out);
+    if (fflush(out) != 0 || fstat(fd, &status) != 0 || !S_ISREG(status.st_mode)){
+        return 0;
+    }
+
+    MappedJob job;
+    memset(&job, 0, sizeof(job));
+    job.formula = formula;
+    job.stmt = stmt;
+    job.rows = 1UL << stmt->num_vars;
+    job.width = 2 * (stmt->num_vars + stmt->num_outputs);
+    if (job.width == 0){
+        job.width = 1;
+    }
+    unsigned long total_words = (job.rows + 63) / 64;
+    job.num_blocks = (total_words + MAPPED_BLOCK_WORDS - 1) / MAPPED_BLOCK_WORDS;
+    size_t num_threads = options->num_threads > 0 ? options->num_threads : 1;
+    if (num_threads > job.num_blocks){
+        num_threads = job.num_blocks;
+    }
+
+    // the header is mapped with the rows, so that a failure leaves the file as it was
+    size_t header_size = 2;
+    for (size_t i = 0; i < stmt->num_vars; i++){
+        header_size += 1 + strlen(formula->variables[i]);
+    }
+    for (size_t i = 0; i < stmt->num_outputs; i++){
+        header_size += 1 + strlen(stmt->names[i]);
+    }
+
+    unsigned long printed_rows = job.rows;
+    if (stmt->kind == STMT_SHOW_ONES){
+        job.printed = calloc(job.num_blocks + 1, sizeof(unsigned long));
+        if (job.printed == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        job.counting = 1;
+        run_workers(&job, num_threads);
+        job.counting = 0;
+        for (unsigned long b = 0; b < job.num_blocks; b++){
+            job.printed[b + 1] += job.printed[b];
+        }
+        printed_rows = job.printed[job.num_blocks];
+    }
+
+    off_t start = ftello(out);
+    off_t size = header_size + (off_t)printed_rows * job.width;
+    long page = sysconf(_SC_PAGESIZE);
+    off_t aligned = start - start % page;
+    char *map = MAP_FAILED;
+    if (start >= 0 && ftruncate(fd, start + size) == 0){
+        int reserved = posix_fallocate(fd, start, size);
+        if (reserved == 0){
+            map = mmap(NULL, start + size - aligned, PROT_READ | PROT_WRITE, MAP_SHARED, fd, aligned);
+        }
+        if (map == MAP_FAILED){
+            if (ftruncate(fd, start) != 0){
+                perror("error restoring output file");
+            }
+            if (options->verbose){
+                fprintf(stderr, "mapped: cannot map the output: %s\n", strerror(reserved != 0 ? reserved : errno));
+            }
+        }
+    }
+    if (map == MAP_FAILED){
+        free(job.printed);
+        return 0;
+    }
+
+    char *p = map + (start - aligned);
+    *p++ = '#';
+    for (size_t i = 0; i < stmt->num_vars; i++){
+        *p++ = ' ';
+        p = stpcpy(p, formula->variables[i]);
+    }
+    for (size_t i = 0; i < stmt->num_outputs; i++){
+        *p++ = ' ';
+        p = stpcpy(p, stmt->names[i]);
+    }
+    *p++ = '\n';
+    job.text = p;
+    run_workers(&job, num_threads);
+
+    munmap(map, start + size - aligned);
+    fseeko(out, start + size, SEEK_SET);
+    if (options->verbose){
+        fprintf(stderr, "mapped: %lld bytes, %lu blocks of %d rows on %zu threads%s\n", (long long)size,
+                job.num_blocks, MAPPED_BLOCK_WORDS * 64, num_threads,
+                stmt->kind == STMT_SHOW_ONES ? ", counted first" : "");
+    }
+    free(job.printed);
+    return 1;
+}
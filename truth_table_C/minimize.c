@@ -0,0 +1,686 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * Two-level minimization of an assignment: "minimize z;".
+ *
+ * The function of z is tabulated over its support (the declared variables in its cone) as a
+ * bit-packed on-set, then covered with products:
+ *   - up to MAX_EXACT_SUPPORT variables, Quine-McCluskey: the implicants of every mask of
+ *     eliminated variables are one bitset over the minterms, built by merging the bitset of
+ *     a smaller mask with itself shifted; primes are the implicants no larger cube contains.
+ *     Essential primes are taken first and the cyclic core is covered by branch and bound.
+ *   - above that, Espresso-style heuristics: every uncovered minterm is expanded into a prime,
+ *     then irredundant (drop cubes covered by the others) and reduce (shrink every cube to
+ *     the minterms only it covers, expand it again in another variable order) are repeated
+ *     while the cover gets cheaper.
+ * The sum of products is compiled into the formula and z is rebound to it, so the statements
+ * after "minimize" evaluate the minimized form, unless its cone is no smaller than the one of z:
+ * a factored form such as (a or b) and (c or d) and (e or f) is smaller than its 8 products.
+ */
+
+#define MAX_EXACT_SUPPORT 12     // 4^12 bits of implicant sets
+#define MAX_MINIMIZE_SUPPORT 22  // 2^22 minterms, 16 MiB of cover counts
+#define MAX_BRANCH_NODES 100000  // Branch and bound budget, the greedy cover is kept past it
+#define MAX_ESPRESSO_ROUNDS 4
+
+// Product term over the support: variables set in mask are absent, the others equal value
+typedef struct {
+    uint32_t mask;
+    uint32_t value;
+} Cube;
+
+typedef struct {
+    Cube *cubes;
+    size_t count;
+    size_t capacity;
+} Cover;
+
+static void push_cube(Cover *cover, uint32_t mask, uint32_t value){
+    if (cover->count >= cover->capacity){
+        cover->capacity = cover->capacity ? 2 * cover->capacity : 16;
+        cover->cubes = realloc(cover->cubes, cover->capacity * sizeof(Cube));
+        if (cover->cubes == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    cover->cubes[cover->count].mask = mask;
+    cover->cubes[cover->count].value = value;
+    cover->count++;
+}
+
+static void* min_alloc(size_t count, size_t size){
+    void *memory = calloc(count + 1, size);
+    if (memory == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return memory;
+}
+
+// Literals of a cover over k variables
+static size_t cover_literals(const Cover *cover, size_t k){
+    size_t literals = 0;
+    for (size_t i = 0; i < cover->count; i++){
+        literals += k - __builtin_popcount(cover->cubes[i].mask);
+    }
+    return literals;
+}
+
+// Next minterm of a cube: iterate with s = 0, then s = next_subset(s, mask) until it is 0 again
+static uint32_t next_subset(uint32_t s, uint32_t mask){
+    return (s - mask) & mask;
+}
+
+static int is_set(const uint64_t *bits, uint32_t minterm){
+    return (bits[minterm / 64] >> (minterm % 64)) & 1;
+}
+
+/* TABULATION */
+
+// On-set of instr over the k support variables, minterm bit k-1-i is support variable i
+static uint64_t* tabulate(const Formula *formula, unsigned int instr, const unsigned int *support, size_t k){
+    Statement single;
+    memset(&single, 0, sizeof(single));
+    single.num_outputs = 1;
+    single.outputs = &instr;
+    compute_cone(formula, &single);
+
+    // position of every declared variable in the support
+    size_t *position = min_alloc(formula->num_vars, sizeof(size_t));
+    for (size_t i = 0; i < k; i++){
+        position[support[i]] = k - 1 - i;
+    }
+
+    unsigned long minterms = 1UL << k;
+    uint64_t *on = min_alloc((minterms + 63) / 64, sizeof(uint64_t));
+    uint64_t *values = alloc_values(formula);
+    for (unsigned long base = 0; base < minterms; base += 64){
+        for (size_t c = 0; c < single.cone_size; c++){
+            unsigned int i = single.cone[c];
+            const Instr *in = &formula->code[i];
+            switch (in->op){
+                case OP_CONST:
+                    values[i] = in->a ? ~0ULL : 0;
+                    break;
+                case OP_INPUT: {
+                    size_t bit = position[in->a];
+                    values[i] = bit < 6 ? low_bit_patterns[bit] : (((base >> bit) & 1) ? ~0ULL : 0);
+                    break;
+                }
+                case OP_NOT:
+                    values[i] = ~values[in->a];
+                    break;
+                case OP_AND:
+                    values[i] = values[in->a] & values[in->b];
+                    break;
+                case OP_OR:
+                    values[i] = values[in->a] | values[in->b];
+                    break;
+            }
+        }
+        on[base / 64] = values[instr] & valid_rows_mask(minterms, base);
+    }
+    free(values);
+    free(position);
+    free(single.cone);
+    return on;
+}
+
+/* QUINE-MCCLUSKEY */
+
+// Words of bitset x moved down by s = 2^t positions, bit v of the result is bit v + s of x
+static void shift_down(uint64_t *dst, const uint64_t *x, size_t words, unsigned int t){
+    if (t < 6){
+        for (size_t w = 0; w < words; w++){
+            dst[w] = x[w] >> (1u << t);
+        }
+    }
+    else {
+        size_t step = 1UL << (t - 6);
+        for (size_t w = 0; w < words; w++){
+            dst[w] = w + step < words ? x[w + step] : 0;
+        }
+    }
+}
+
+// Same, moved up: bit v + s of the result is bit v of x
+static void shift_up(uint64_t *dst, const uint64_t *x, size_t words, unsigned int t){
+    if (t < 6){
+        for (size_t w = 0; w < words; w++){
+            dst[w] = x[w] << (1u << t);
+        }
+    }
+    else {
+        size_t step = 1UL << (t - 6);
+        for (size_t w = 0; w < words; w++){
+            dst[w] = w >= step ? x[w - step] : 0;
+        }
+    }
+}
+
+// Keeps the bits of the minterms whose bit t is 0
+static void clear_upper_half(uint64_t *x, size_t words, unsigned int t){
+    for (size_t w = 0; w < words; w++){
+        if (t < 6){
+            x[w] &= ~low_bit_patterns[t];
+        }
+        else if ((w >> (t - 6)) & 1){
+            x[w] = 0;
+        }
+    }
+}
+
+// Compares (terms, literals) of two covers
+static int cheaper(size_t terms, size_t literals, size_t best_terms, size_t best_literals){
+    return terms < best_terms || (terms == best_terms && literals < best_literals);
+}
+
+typedef struct {
+    size_t words;
+    size_t k;
+    const Cube *primes;
+    const uint64_t *covers;     // Minterms of every prime, words each
+    size_t **primes_of;         // Primes covering every minterm, terminated by SIZE_MAX
+    size_t *chosen;
+    size_t num_chosen;
+    size_t *best;
+    size_t num_best;
+    size_t best_literals;
+    long nodes;
+} Branch;
+
+static void branch(Branch *b, const uint64_t *uncovered, size_t literals){
+    if (b->nodes-- <= 0){
+        return;
+    }
+    // the minterm covered by the fewest primes has to be covered by one of them
+    size_t pick = SIZE_MAX, fewest = SIZE_MAX;
+    for (size_t w = 0; w < b->words; w++){
+        uint64_t bits = uncovered[w];
+        while (bits != 0){
+            size_t minterm = w * 64 + __builtin_ctzll(bits);
+            size_t count = 0;
+            while (b->primes_of[minterm][count] != SIZE_MAX){
+                count++;
+            }
+            if (count < fewest){
+                fewest = count;
+                pick = minterm;
+            }
+            bits &= bits - 1;
+        }
+    }
+    if (pick == SIZE_MAX){
+        if (cheaper(b->num_chosen, literals, b->num_best, b->best_literals)){
+            memcpy(b->best, b->chosen, b->num_chosen * sizeof(size_t));
+            b->num_best = b->num_chosen;
+            b->best_literals = literals;
+        }
+        return;
+    }
+    if (b->num_chosen + 1 >= b->num_best && !(b->num_chosen + 1 == b->num_best && literals < b->best_literals)){
+        return;  // cannot beat the best cover
+    }
+
+    uint64_t *rest = min_alloc(b->words, sizeof(uint64_t));
+    for (size_t *p = b->primes_of[pick]; *p != SIZE_MAX; p++){
+        const uint64_t *cover = b->covers + *p * b->words;
+        for (size_t w = 0; w < b->words; w++){
+            rest[w] = uncovered[w] & ~cover[w];
+        }
+        b->chosen[b->num_chosen++] = *p;
+        branch(b, rest, literals + b->k - __builtin_popcount(b->primes[*p].mask));
+        b->num_chosen--;
+    }
+    free(rest);
+}
+
+static Cover quine_mccluskey(const uint64_t *on, size_t k){
+    size_t minterms = 1UL << k;
+    size_t words = (minterms + 63) / 64;
+    size_t masks = 1UL << k;
+
+    // implicants[m]: bit v set when the cube (m, v) lies in the on-set
+    uint64_t *implicants = min_alloc(masks * words, sizeof(uint64_t));
+    uint64_t *shifted = min_alloc(words, sizeof(uint64_t));
+    memcpy(implicants, on, words * sizeof(uint64_t));
+    for (size_t m = 1; m < masks; m++){
+        unsigned int t = __builtin_ctzl(m);
+        const uint64_t *smaller = implicants + (m & (m - 1)) * words;  // m without variable t
+        uint64_t *current = implicants + m * words;
+        shift_down(shifted, smaller, words, t);
+        for (size_t w = 0; w < words; w++){
+            current[w] = smaller[w] & shifted[w];
+        }
+        clear_upper_half(current, words, t);
+    }
+
+    // primes: implicants contained in no implicant with one more eliminated variable
+    Cover primes = {NULL, 0, 0};
+    uint64_t *contained = min_alloc(words, sizeof(uint64_t));
+    for (size_t m = 0; m < masks; m++){
+        memset(contained, 0, words * sizeof(uint64_t));
+        for (unsigned int t = 0; t < k; t++){
+            if (m & (1UL << t)){
+                continue;
+            }
+            const uint64_t *larger = implicants + (m | (1UL << t)) * words;
+            shift_up(shifted, larger, words, t);
+            for (size_t w = 0; w < words; w++){
+                contained[w] |= larger[w] | shifted[w];
+            }
+        }
+        const uint64_t *current = implicants + m * words;
+        for (size_t w = 0; w < words; w++){
+            uint64_t prime = current[w] & ~contained[w];
+            while (prime != 0){
+                push_cube(&primes, (uint32_t)m, (uint32_t)(w * 64 + __builtin_ctzll(prime)));
+                prime &= prime - 1;
+            }
+        }
+    }
+    free(contained);
+    free(shifted);
+    free(implicants);
+
+    // minterms of every prime and primes of every minterm
+    uint64_t *covers = min_alloc(primes.count * words, sizeof(uint64_t));
+    size_t *counts = min_alloc(minterms, sizeof(size_t));
+    for (size_t p = 0; p < primes.count; p++){
+        uint32_t s = 0;
+        do {
+            uint32_t minterm = primes.cubes[p].value | s;
+            covers[p * words + minterm / 64] |= 1ULL << (minterm % 64);
+            counts[minterm]++;
+            s = next_subset(s, primes.cubes[p].mask);
+        } while (s != 0);
+    }
+    size_t **primes_of = min_alloc(minterms, sizeof(size_t *));
+    for (size_t v = 0; v < minterms; v++){
+        primes_of[v] = min_alloc(counts[v] + 1, sizeof(size_t));
+        primes_of[v][counts[v]] = SIZE_MAX;
+        counts[v] = 0;
+    }
+    for (size_t p = 0; p < primes.count; p++){
+        uint32_t s = 0;
+        do {
+            uint32_t minterm = primes.cubes[p].value | s;
+            primes_of[minterm][counts[minterm]++] = p;
+            s = next_subset(s, primes.cubes[p].mask);
+        } while (s != 0);
+    }
+
+    // essential primes are the only cover of some minterm
+    Cover result = {NULL, 0, 0};
+    unsigned char *taken = min_alloc(primes.count, 1);
+    uint64_t *uncovered = min_alloc(words, sizeof(uint64_t));
+    memcpy(uncovered, on, words * sizeof(uint64_t));
+    for (size_t v = 0; v < minterms; v++){
+        size_t p = primes_of[v][0];
+        if (is_set(on, v) && primes_of[v][1] == SIZE_MAX && !taken[p]){
+            taken[p] = 1;
+            push_cube(&result, primes.cubes[p].mask, primes.cubes[p].value);
+            for (size_t w = 0; w < words; w++){
+                uncovered[w] &= ~covers[p * words + w];
+            }
+        }
+    }
+
+    // greedy cover of the rest as the bound, improved by branch and bound
+    Branch b;
+    b.words = words;
+    b.k = k;
+    b.primes = primes.cubes;
+    b.covers = covers;
+    b.primes_of = primes_of;
+    b.chosen = min_alloc(primes.count, sizeof(size_t));
+    b.num_chosen = 0;
+    b.best = min_alloc(primes.count, sizeof(size_t));
+    b.num_best = 0;
+    b.best_literals = 0;
+    b.nodes = MAX_BRANCH_NODES;
+
+    uint64_t *left = min_alloc(words, sizeof(uint64_t));
+    memcpy(left, uncovered, words * sizeof(uint64_t));
+    for (;;){
+        size_t pick = SIZE_MAX, gain = 0;
+        for (size_t p = 0; p < primes.count; p++){
+            size_t new_minterms = 0;
+            for (size_t w = 0; w < words; w++){
+                new_minterms += __builtin_popcountll(left[w] & covers[p * words + w]);
+            }
+            if (new_minterms > gain || (new_minterms == gain && new_minterms > 0 &&
+                __builtin_popcount(primes.cubes[p].mask) > __builtin_popcount(primes.cubes[pick].mask))){
+                gain = new_minterms;
+                pick = p;
+            }
+        }
+        if (pick == SIZE_MAX){
+            break;
+        }
+        b.best[b.num_best++] = pick;
+        b.best_literals += k - __builtin_popcount(primes.cubes[pick].mask);
+        for (size_t w = 0; w < words; w++){
+            left[w] &= ~covers[pick * words + w];
+        }
+    }
+    branch(&b, uncovered, 0);
+    for (size_t i = 0; i < b.num_best; i++){
+        push_cube(&result, primes.cubes[b.best[i]].mask, primes.cubes[b.best[i]].value);
+    }
+
+    free(left);
+    free(b.chosen);
+    free(b.best);
+    free(uncovered);
+    free(taken);
+    for (size_t v = 0; v < minterms; v++){
+        free(primes_of[v]);
+    }
+    free(primes_of);
+    free(counts);
+    free(covers);
+    free(primes.cubes);
+    return result;
+}
+
+/* ESPRESSO */
+
+// Adds delta to the cover count of every minterm of the cube
+static void count_cube(uint32_t *counts, Cube cube, int delta){
+    uint32_t s = 0;
+    do {
+        counts[cube.value | s] += delta;
+        s = next_subset(s, cube.mask);
+    } while (s != 0);
+}
+
+// Raises the variables of the cube in the given order while it stays inside the on-set
+static Cube expand(const uint64_t *on, Cube cube, const unsigned int *order, size_t k){
+    for (size_t i = 0; i < k; i++){
+        uint32_t bit = 1u << order[i];
+        if (cube.mask & bit){
+            continue;
+        }
+        // the cube doubles into its mirror across the variable, which must be in the on-set
+        int inside = 1;
+        uint32_t s = 0;
+        do {
+            inside = is_set(on, (cube.value | s) ^ bit);
+            s = next_subset(s, cube.mask);
+        } while (inside && s != 0);
+        if (inside){
+            cube.mask |= bit;
+            cube.value &= ~bit;
+        }
+    }
+    return cube;
+}
+
+static int larger_cube_first(const void *a, const void *b){
+    return __builtin_popcount(((const Cube *)b)->mask) - __builtin_popcount(((const Cube *)a)->mask);
+}
+
+// Drops the cubes whose minterms are all covered by other cubes, smallest cubes first
+static void irredundant(Cover *cover, uint32_t *counts){
+    qsort(cover->cubes, cover->count, sizeof(Cube), larger_cube_first);
+    size_t kept = cover->count;
+    for (size_t i = cover->count; i-- > 0;){
+        Cube cube = cover->cubes[i];
+        int redundant = 1;
+        uint32_t s = 0;
+        do {
+            redundant = counts[cube.value | s] >= 2;
+            s = next_subset(s, cube.mask);
+        } while (redundant && s != 0);
+        if (redundant){
+            count_cube(counts, cube, -1);
+            cover->cubes[i].mask = UINT32_MAX;  // removed
+            kept--;
+        }
+    }
+    size_t j = 0;
+    for (size_t i = 0; i < cover->count; i++){
+        if (cover->cubes[i].mask != UINT32_MAX){
+            cover->cubes[j++] = cover->cubes[i];
+        }
+    }
+    cover->count = kept;
+}
+
+// Shrinks every cube to the smallest cube holding the minterms no other cube covers
+static void reduce(Cover *cover, uint32_t *counts, size_t k){
+    uint32_t all = (uint32_t)((1UL << k) - 1);
+    for (size_t i = 0; i < cover->count; i++){
+        Cube cube = cover->cubes[i];
+        uint32_t ones = 0, zeros = all;
+        int alone = 0;
+        uint32_t s = 0;
+        do {
+            uint32_t minterm = cube.value | s;
+            if (counts[minterm] == 1){
+                ones |= minterm;
+                zeros &= minterm;
+                alone = 1;
+            }
+            s = next_subset(s, cube.mask);
+        } while (s != 0);
+        if (!alone){
+            continue;  // left to irredundant
+        }
+        Cube reduced = {ones ^ zeros, zeros};
+        count_cube(counts, cube, -1);
+        count_cube(counts, reduced, 1);
+        cover->cubes[i] = reduced;
+    }
+}
+
+static Cover espresso(const uint64_t *on, size_t k){
+    size_t minterms = 1UL << k;
+    uint32_t *counts = min_alloc(minterms, sizeof(uint32_t));
+    unsigned int *order = min_alloc(k, sizeof(unsigned int));
+    for (size_t i = 0; i < k; i++){
+        order[i] = i;
+    }
+
+    // every minterm not covered yet grows into a prime
+    Cover cover = {NULL, 0, 0};
+    for (size_t w = 0; w < (minterms + 63) / 64; w++){
+        uint64_t bits = on[w];
+        while (bits != 0){
+            uint32_t minterm = w * 64 + __builtin_ctzll(bits);
+            if (counts[minterm] == 0){
+                Cube cube = {0, minterm};
+                cube = expand(on, cube, order, k);
+                count_cube(counts, cube, 1);
+                push_cube(&cover, cube.mask, cube.value);
+            }
+            bits &= bits - 1;
+        }
+    }
+    irredundant(&cover, counts);
+
+    Cover best = {NULL, 0, 0};
+    for (size_t i = 0; i < cover.count; i++){
+        push_cube(&best, cover.cubes[i].mask, cover.cubes[i].value);
+    }
+    for (int round = 1; round <= MAX_ESPRESSO_ROUNDS; round++){
+        // another variable order every round, so cubes expand in other directions
+        for (size_t i = 0; i < k; i++){
+            order[i] = (i * (2 * round + 1) + round) % k;
+        }
+        reduce(&cover, counts, k);
+        for (size_t i = 0; i < cover.count; i++){
+            Cube before = cover.cubes[i];
+            Cube after = expand(on, before, order, k);
+            // count the minterms the cube gained
+            uint32_t s = 0;
+            do {
+                uint32_t minterm = after.value | s;
+                if ((minterm & ~before.mask) != before.value){
+                    counts[minterm]++;
+                }
+                s = next_subset(s, after.mask);
+            } while (s != 0);
+            cover.cubes[i] = after;
+        }
+        irredundant(&cover, counts);
+        if (!cheaper(cover.count, cover_literals(&cover, k), best.count, cover_literals(&best, k))){
+            break;
+        }
+        best.count = 0;
+        for (size_t i = 0; i < cover.count; i++){
+            push_cube(&best, cover.cubes[i].mask, cover.cubes[i].value);
+        }
+    }
+
+    free(cover.cubes);
+    free(order);
+    free(counts);
+    return best;
+}
+
+/* SUM OF PRODUCTS */
+
+static int cube_order(const void *a, const void *b){
+    const Cube *x = a, *y = b;
+    if (x->value != y->value){
+        return x->value > y->value ? -1 : 1;
+    }
+    return x->mask < y->mask ? -1 : x->mask > y->mask;
+}
+
+static size_t cone_size_of(const Formula *formula, unsigned int instr){
+    Statement single;
+    memset(&single, 0, sizeof(single));
+    single.num_outputs = 1;
+    single.outputs = &instr;
+    compute_cone(formula, &single);
+    free(single.cone);
+    return single.cone_size;
+}
+
+static void append(char **text, size_t *length, size_t *capacity, const char *piece){
+    size_t piece_len = strlen(piece);
+    while (*length + piece_len + 1 > *capacity){
+        *capacity = *capacity ? 2 * *capacity : 256;
+        *text = realloc(*text, *capacity);
+        if (*text == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    memcpy(*text + *length, piece, piece_len + 1);
+    *length += piece_len;
+}
+
+static int declaration_order(const void *a, const void *b){
+    unsigned int x = *(const unsigned int *)a, y = *(const unsigned int *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Minimizes the function computed by instr into a sum of products, emits it into the formula
+ * and returns its instruction, or instr when the sum of products has no fewer instructions.
+ * report receives what the statement prints: a comment line, then the minimized assignment
+ * of name in the input syntax.
+ */
+unsigned int minimize_instr(Formula *formula, const char *name, unsigned int instr, char **report){
+    // support: declared variables in the cone, in declaration order
+    Statement single;
+    memset(&single, 0, sizeof(single));
+    single.num_outputs = 1;
+    single.outputs = &instr;
+    compute_cone(formula, &single);
+    unsigned int *support = min_alloc(formula->num_vars, sizeof(unsigned int));
+    size_t k = 0;
+    for (size_t c = 0; c < single.cone_size; c++){
+        const Instr *in = &formula->code[single.cone[c]];
+        if (in->op == OP_INPUT){
+            support[k++] = in->a;
+        }
+    }
+    qsort(support, k, sizeof(unsigned int), declaration_order);
+    free(single.cone);
+    size_t before = single.cone_size;
+
+    char line[256];
+    size_t length = 0, capacity = 0;
+    *report = NULL;
+    if (k > MAX_MINIMIZE_SUPPORT){
+        snprintf(line, sizeof(line), "# minimize %s: support of %zu variables is too large, kept as is\n", name, k);
+        append(report, &length, &capacity, line);
+        free(support);
+        return instr;
+    }
+
+    uint64_t *on = tabulate(formula, instr, support, k);
+    Cover cover = k <= MAX_EXACT_SUPPORT ? quine_mccluskey(on, k) : espresso(on, k);
+    free(on);
+    qsort(cover.cubes, cover.count, sizeof(Cube), cube_order);
+
+    // or of the products, each an and of literals in declaration order
+    unsigned int result = emit_instr(formula, OP_CONST, 0, 0);
+    char *expression = NULL;
+    size_t expression_len = 0, expression_capacity = 0;
+    for (size_t i = 0; i < cover.count; i++){
+        const Cube *cube = &cover.cubes[i];
+        size_t literals = k - __builtin_popcount(cube->mask);
+        unsigned int product = emit_instr(formula, OP_CONST, 1, 0);
+        if (i > 0){
+            append(&expression, &expression_len, &expression_capacity, " or ");
+        }
+        if (literals > 1 && cover.count > 1){
+            append(&expression, &expression_len, &expression_capacity, "(");
+        }
+        if (literals == 0){
+            append(&expression, &expression_len, &expression_capacity, "True");
+        }
+        size_t written = 0;
+        for (size_t j = 0; j < k; j++){
+            uint32_t bit = 1u << (k - 1 - j);
+            if (cube->mask & bit){
+                continue;
+            }
+            unsigned int input;
+            lookup_symbol(&formula->symbols, formula->variables[support[j]], &input, NULL);
+            int positive = (cube->value & bit) != 0;
+            product = emit_instr(formula, OP_AND, product, positive ? input : emit_instr(formula, OP_NOT, input, 0));
+            if (written++ > 0){
+                append(&expression, &expression_len, &expression_capacity, " and ");
+            }
+            if (!positive){
+                append(&expression, &expression_len, &expression_capacity, "not ");
+            }
+            append(&expression, &expression_len, &expression_capacity, formula->variables[support[j]]);
+        }
+        if (literals > 1 && cover.count > 1){
+            append(&expression, &expression_len, &expression_capacity, ")");
+        }
+        result = emit_instr(formula, OP_OR, result, product);
+    }
+    if (cover.count == 0){
+        append(&expression, &expression_len, &expression_capacity, "False");
+    }
+
+    // a factored form can be smaller than any sum of products, it is kept then
+    size_t after = cone_size_of(formula, result);
+    snprintf(line, sizeof(line), "# minimize %s: %zu terms, %zu literals, %zu -> %zu instructions (%s)%s\n",
+             name, cover.count, cover_literals(&cover, k), before, after,
+             k <= MAX_EXACT_SUPPORT ? "exact" : "heuristic", after < before ? "" : ", original kept");
+    append(report, &length, &capacity, line);
+    append(report, &length, &capacity, name);
+    append(report, &length, &capacity, " = ");
+    append(report, &length, &capacity, expression);
+    append(report, &length, &capacity, ";\n");
+
+    free(expression);
+    free(cover.cubes);
+    free(support);
+    return after < before ? result : instr;
+}
@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "table.h"
+
+/*
+ * Pipelined evaluation and output of show and show_ones statements.
+ *
+ * The rows are cut into blocks of about BLOCK_TEXT_BYTES of text. Evaluation workers claim the
+ * blocks in order, evaluate them into bit-packed columns and render their rows into the text
+ * buffer of a slot, while a single writer thread ships the finished slots, in row order, with
+ * writev calls covering every consecutive finished block. Block b lives in slot b % inflight,
+ * so a worker that runs inflight blocks ahead of the writer waits for it: memory stays bounded
+ * by the number of slots and the evaluation never stalls on a blocking write, nor the writes
+ * on the evaluation, as long as there is a slot to work on. When checkpointing, the writer
+ * records the rows and bytes written so far between two writes, and a resumed statement
+ * starts at the checkpointed row, as does one whose first rows another engine printed. The
+ * symmetry engine runs through here too, with its workers looking the outputs up from the
+ * points of the symmetry classes instead of evaluating them.
+ */
+
+#define DEFAULT_INFLIGHT 8
+#define BLOCK_TEXT_BYTES (1UL << 20)
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+typedef enum {
+    SLOT_FREE,      // Written out, or never used
+    SLOT_READY      // Rendered, waiting for the writer
+} SlotState;
+
+typedef struct {
+    SlotState state;
+    uint64_t *bits;     // num_outputs columns of block_words words
+    char *text;
+    size_t used;
+} Slot;
+
+typedef struct {
+    const Formula *formula;
+    const Statement *stmt;
+    unsigned long rows;
+    unsigned long first_word;    // Word of the first row to print, after a resumed checkpoint
+    unsigned long block_words;
+    unsigned long num_blocks;
+    size_t inflight;
+    Slot *slots;
+    int fd;
+    Progress *progress;          // Checkpointed by the writer, NULL when not checkpointing
+    const Symmetry *symmetry;    // Outputs looked up rather than evaluated, NULL otherwise
+
+    pthread_mutex_t lock;
+    pthread_cond_t slot_free;    // The writer released a slot
+    pthread_cond_t slot_ready;   // A worker finished a slot
+    unsigned long next_block;    // Next block to claim
+    unsigned long written;       // Blocks written out so far
+    int failed;                  // errno of a failed write, the workers stop
+    unsigned long writes;        // writev calls
+    unsigned long stalls;        // Times a worker waited for a free slot
+} Pipeline;
+
+// Evaluates block b into the slot's columns
+static void evaluate_block(Pipeline *job, unsigned long block, Slot *slot, uint64_t *values){
+    const Statement *stmt = job->stmt;
+    unsigned long first_word = job->first_word + block * job->block_words;
+    unsigned long total_words = (job->rows + 63) / 64;
+    unsigned long words = total_words - first_word < job->block_words ? total_words - first_word : job->block_words;
+
+    if (job->symmetry != NULL && stmt->kind == STMT_SHOW_ONES){
+        // the words below no true point are left at 0 without looking their rows up
+        memset(slot->bits, 0, stmt->num_outputs * job->block_words * sizeof(uint64_t));
+        unsigned long end = (first_word + words) * 64;
+        unsigned long base = first_word * 64;
+        while ((base = next_true_word(stmt, job->symmetry, base, end)) < end){
+            unsigned long w = base / 64 - first_word;
+            lookup_word(stmt, job->symmetry, base, values);
+            for (size_t j = 0; j < stmt->num_outputs; j++){
+                slot->bits[j * job->block_words + w] = values[stmt->outputs[j]];
+            }
+            base += 64;
+        }
+        return;
+    }
+    for (unsigned long w = 0; w < words; w++){
+        unsigned long base = (first_word + w) * 64;
+        if (job->symmetry != NULL){
+            lookup_word(stmt, job->symmetry, base, values);
+        }
+        else {
+            eval_word(job->formula, stmt, base, values);
+        }
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            slot->bits[j * job->block_words + w] = values[stmt->outputs[j]];
+        }
+    }
+}
+
+// Renders the rows of block b from the slot's columns, like emit_row does
+static void format_block(Pipeline *job, unsigned long block, Slot *slot){
+    const Statement *stmt = job->stmt;
+    size_t num_vars = stmt->num_vars;
+    unsigned long first_word = job->first_word + block * job->block_words;
+    unsigned long total_words = (job->rows + 63) / 64;
+    unsigned long words = total_words - first_word < job->block_words ? total_words - first_word : job->block_words;
+    char *p = slot->text;
+
+    for (unsigned long w = 0; w < words; w++){
+        unsigned long base = (first_word + w) * 64;
+        uint64_t selected = valid_rows_mask(job->rows, base);
+        if (stmt->kind == STMT_SHOW_ONES){
+            uint64_t ones = 0;
+            for (size_t j = 0; j < stmt->num_outputs; j++){
+                ones |= slot->bits[j * job->block_words + w];
+            }
+            selected &= ones;
+        }
+        while (selected != 0){
+            unsigned int bit = __builtin_ctzll(selected);
+            unsigned long row = base + bit;
+            char *line = p;
+            for (size_t j = 0; j < num_vars; j++){
+                *p++ = '0' + ((row >> (num_vars - 1 - j)) & 1);
+                *p++ = ' ';
+            }
+            for (size_t j = 0; j < stmt->num_outputs; j++){
+                *p++ = '0' + ((slot->bits[j * job->block_words + w] >> bit) & 1);
+                *p++ = ' ';
+            }
+            if (p == line){
+                *p++ = ' ';
+            }
+            p[-1] = '\n';  // newline instead of the trailing space
+            selected &= selected - 1;
+        }
+    }
+    slot->used = p - slot->text;
+}
+
+static void* pipeline_worker(void *arg){
+    Pipeline *job = arg;
+    uint64_t *values = alloc_values(job->formula);
+
+    pthread_mutex_lock(&job->lock);
+    while (!job->failed && job->next_block < job->num_blocks){
+        unsigned long block = job->next_block++;
+        Slot *slot = &job->slots[block % job->inflight];
+        if (block >= job->written + job->inflight){
+            job->stalls++;
+        }
+        while (!job->failed && block >= job->written + job->inflight){
+            pthread_cond_wait(&job->slot_free, &job->lock);  // back-pressure from the writer
+        }
+        if (job->failed){
+            break;
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        evaluate_block(job, block, slot, values);
+        format_block(job, block, slot);
+
+        pthread_mutex_lock(&job->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_signal(&job->slot_ready);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    free(values);
+    return NULL;
+}
+
+// Writes all of iov, returns 0 with errno set on failure
+static int write_all(int fd, struct iovec *iov, int count){
+    while (count > 0){
+        ssize_t written = writev(fd, iov, count);
+        if (written < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return 0;
+        }
+        // skip what went out, a short write can stop in the middle of a buffer
+        while (count > 0 && (size_t)written >= iov->iov_len){
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0){
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 1;
+}
+
+static void* pipeline_writer(void *arg){
+    Pipeline *job = arg;
+    size_t batch = job->inflight < IOV_MAX ? job->inflight : IOV_MAX;
+    struct iovec *iov = malloc(batch * sizeof(struct iovec));
+    if (iov == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    pthread_mutex_lock(&job->lock);
+    while (!job->failed && job->written < job->num_blocks){
+        while (job->slots[job->written % job->inflight].state != SLOT_READY){
+            pthread_cond_wait(&job->slot_ready, &job->lock);
+        }
+        // every finished block that follows goes out in the same call
+        int count = 0;
+        while (count < (int)batch && job->written + count < job->num_blocks){
+            Slot *slot = &job->slots[(job->written + count) % job->inflight];
+            if (slot->state != SLOT_READY){
+                break;
+            }
+            iov[count].iov_base = slot->text;
+            iov[count].iov_len = slot->used;
+            count++;
+        }
+        pthread_mutex_unlock(&job->lock);
+
+        int ok = write_all(job->fd, iov, count);
+        int error = errno;
+
+        pthread_mutex_lock(&job->lock);
+        job->writes++;
+        for (int i = 0; i < count; i++){
+            job->slots[(job->written + i) % job->inflight].state = SLOT_FREE;
+        }
+        job->written += count;
+        if (!ok){
+            job->failed = error;
+        }
+        pthread_cond_broadcast(&job->slot_free);
+
+        if (ok && job->progress != NULL && checkpoint_due(job->progress)){
+            unsigned long row = (job->first_word + job->written * job->block_words) * 64;
+            pthread_mutex_unlock(&job->lock);
+            job->progress->row = row < job->rows ? row : job->rows;
+            save_checkpoint(job->progress, job->fd, lseek(job->fd, 0, SEEK_CUR));
+            pthread_mutex_lock(&job->lock);
+        }
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    free(iov);
+    return NULL;
+}
+
+void run_statement_pipelined(const Formula *formula, const Statement *stmt, const Options *options, FILE *out){
+    if (is_query(stmt) || stmt->num_vars >= 64){
+        run_statement(formula, stmt, out);
+        return;
+    }
+
+    Pipeline job;
+    memset(&job, 0, sizeof(job));
+    job.formula = formula;
+    job.stmt = stmt;
+    job.rows = 1UL << stmt->num_vars;
+    size_t width = 2 * (stmt->num_vars + stmt->num_outputs);
+    if (width == 0){
+        width = 1;
+    }
+    unsigned long total_words = (job.rows + 63) / 64;
+    unsigned long start_row = options->progress != NULL ? options->progress->row : options->first_row;
+    job.first_word = start_row / 64;
+    if (job.first_word >= total_words){
+        return;  // finished before the checkpoint
+    }
+    job.block_words = BLOCK_TEXT_BYTES / (64 * width);
+    if (job.block_words == 0){
+        job.block_words = 1;
+    }
+    if (job.block_words > total_words){
+        job.block_words = total_words;
+    }
+    job.num_blocks = (total_words - job.first_word + job.block_words - 1) / job.block_words;
+    if (job.num_blocks < 2 && start_row == 0 && options->symmetry == NULL){
+        run_statement(formula, stmt, out);  // nothing to overlap
+        return;
+    }
+    job.progress = options->progress;
+    job.symmetry = options->symmetry;
+
+    job.inflight = options->inflight > 0 ? options->inflight : DEFAULT_INFLIGHT;
+    if (job.inflight < 2){
+        job.inflight = 2;  // one slot written while the next is filled
+    }
+    if (job.inflight > job.num_blocks){
+        job.inflight = job.num_blocks;
+    }
+    job.slots = calloc(job.inflight, sizeof(Slot));
+    if (job.slots == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < job.inflight; i++){
+        job.slots[i].bits = malloc((stmt->num_outputs * job.block_words + 1) * sizeof(uint64_t));
+        job.slots[i].text = malloc(job.block_words * 64 * width);
+        if (job.slots[i].bits == NULL || job.slots[i].text == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.slot_free, NULL);
+    pthread_cond_init(&job.slot_ready, NULL);
+
+    // the rows bypass the stdio buffer, which has to be empty first
+    if (start_row == 0){
+        print_header(stmt, formula->variables, out);
+    }
+    fflush(out);
+    job.fd = fileno(out);
+
+    size_t num_threads = options->num_threads > 0 ? options->num_threads : 1;
+    pthread_t writer;
+    pthread_t *workers = malloc(num_threads * sizeof(pthread_t));
+    if (workers == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    pthread_create(&writer, NULL, pipeline_writer, &job);
+    for (size_t t = 0; t < num_threads; t++){
+        pthread_create(&workers[t], NULL, pipeline_worker, &job);
+    }
+    for (size_t t = 0; t < num_threads; t++){
+        pthread_join(workers[t], NULL);
+    }
+    pthread_join(writer, NULL);
+
+    if (job.failed){
+        fprintf(stderr, "error writing output: %s\n", strerror(job.failed));
+    }
+    if (options->verbose){
+        fprintf(stderr, "pipeline: %lu blocks of %lu rows, %lu writes, %lu stalls on %zu slots\n",
+                job.num_blocks, job.block_words * 64, job.writes, job.stalls, job.inflight);
+    }
+
+    pthread_cond_destroy(&job.slot_ready);
+    pthread_cond_destroy(&job.slot_free);
+    pthread_mutex_destroy(&job.lock);
+    for (size_t i = 0; i < job.inflight; i++){
+        free(job.slots[i].bits);
+        free(job.slots[i].text);
+    }
+    free(job.slots);
+    free(workers);
+}
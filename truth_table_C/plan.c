@@ -0,0 +1,422 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "table.h"
+
+/*
+ * Cost-based choice of the engine printing each statement.
+ *
+ * Before a statement runs it is measured: the declared variables its outputs depend on, the
+ * size of its cone and how much of it is shared, and the time eval_word takes on a sample of
+ * words spread over the table, whose rows also estimate the fraction show_ones prints. When the
+ * table is large enough for it to matter, three-valued evaluation of a sample of prefixes just
+ * above the leaves of the pruning search estimates the rows pruning never evaluates, and the
+ * same on the assignments of the splitting variables estimates the cofactors that fold to
+ * constants. The time of every engine that applies is estimated from these, and the cheapest
+ * runs. The engines whose estimate rests on a sample run under a budget of a few times their
+ * estimate: pruning still running past it hands the rest of the table to the pipeline, and a
+ * stalled SAT solver gives up for simulation of the remaining rows. --explain prints the
+ * measurements and the estimates of every statement instead of running them.
+ */
+
+#define SAMPLE_WORDS 64         // Words timed, spread over the table
+#define PROBE_SAMPLES 256       // Three-valued evaluations of a probe
+#define PROBE_SECONDS 0.01      // Estimated scan time below which nothing is probed
+#define FORMAT_SECONDS 0.5e-9   // Per byte of text rendered
+#define WRITE_SECONDS 1e-9      // Per byte of text written out
+#define MAP_SECONDS 0.1e-9      // Per byte of text faulted into the mapped output file
+#define THREAD_SECONDS 50e-6    // Starting and joining a thread
+#define BUILD_SECONDS 20e-9     // Per instruction copied into a cofactor
+#define PACK_SECONDS 1e-9       // Per variable of a representative row of the symmetry engine
+#define LOOKUP_SECONDS 2e-9     // Per row and output looked up by the symmetry engine
+#define BUDGET_FACTOR 4.0       // Budget of an engine, over its estimate
+#define MIN_BUDGET 0.25         // Seconds
+
+static const char *engine_names[NUM_ENGINES] = {
+    "report", "sat", "scan", "pipeline", "cofactor", "prune", "mapped", "symmetry"
+};
+
+static const char *statement_keyword(const Statement *stmt){
+    switch (stmt->kind){
+        case STMT_SHOW: return "show";
+        case STMT_SHOW_ONES: return "show_ones";
+        case STMT_CHECK: return "check";
+        case STMT_EQUIV: return "equiv";
+        case STMT_MINIMIZE: return "minimize";
+    }
+    return "?";
+}
+
+// Declared variables output depends on, or all the outputs of the statement for UINT_MAX
+static size_t support_size(const Formula *formula, const Statement *stmt, unsigned int output){
+    unsigned char *needed = calloc(formula->size + 1, 1);
+    if (needed == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        if (output == UINT_MAX || stmt->outputs[j] == output){
+            needed[stmt->outputs[j]] = 1;
+        }
+    }
+
+    // the cone is in evaluation order, parents after their children
+    size_t support = 0;
+    for (size_t k = stmt->cone_size; k-- > 0; ){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &formula->code[i];
+        if (!needed[i]){
+            continue;
+        }
+        if (in->op == OP_INPUT){
+            support++;
+        }
+        if (in->op == OP_NOT || in->op == OP_AND || in->op == OP_OR){
+            needed[in->a] = 1;
+        }
+        if (in->op == OP_AND || in->op == OP_OR){
+            needed[in->b] = 1;
+        }
+    }
+    free(needed);
+    return support;
+}
+
+// Fraction of the cone read by more than one instruction or output
+static double shared_fraction(const Formula *formula, const Statement *stmt){
+    if (stmt->cone_size == 0){
+        return 0;
+    }
+    unsigned char *uses = calloc(formula->size + 1, 1);
+    if (uses == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        const Instr *in = &formula->code[stmt->cone[k]];
+        if (in->op == OP_NOT || in->op == OP_AND || in->op == OP_OR){
+            uses[in->a] += uses[in->a] < 2;
+        }
+        if (in->op == OP_AND || in->op == OP_OR){
+            uses[in->b] += uses[in->b] < 2;
+        }
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        uses[stmt->outputs[j]] += uses[stmt->outputs[j]] < 2;
+    }
+    size_t shared = 0;
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        shared += uses[stmt->cone[k]] >= 2;
+    }
+    free(uses);
+    return (double)shared / stmt->cone_size;
+}
+
+// Times eval_word on words spread over the table and counts the rows show_ones would print
+static void sample_words(const Formula *formula, const Statement *stmt, Plan *plan){
+    unsigned long rows = 1UL << stmt->num_vars;
+    unsigned long words = (rows + 63) / 64;
+    unsigned long samples = words < SAMPLE_WORDS ? words : SAMPLE_WORDS;
+    uint64_t *values = alloc_values(formula);
+    unsigned long ones = 0, sampled = 0;
+
+    // words is a power of two, so an odd stride visits distinct words, and one near words / phi
+    // spreads them over every bit of the word index instead of leaving the low bits at 0
+    unsigned long stride = (unsigned long)(words * 0.6180339887498949) | 1;
+
+    double start = now_seconds();
+    for (unsigned long s = 0; s < samples; s++){
+        unsigned long base = (s * stride & (words - 1)) * 64;
+        eval_word(formula, stmt, base, values);
+        uint64_t word = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            word |= values[stmt->outputs[j]];
+        }
+        uint64_t valid = valid_rows_mask(rows, base);
+        ones += __builtin_popcountll(word & valid);
+        sampled += __builtin_popcountll(valid);
+    }
+    plan->word_seconds = (now_seconds() - start) / samples;
+    plan->density = (double)ones / sampled;
+    free(values);
+}
+
+void plan_statement(const Formula *formula, const Statement *stmt, const Options *options, Plan *plan){
+    memset(plan, 0, sizeof(Plan));
+    for (int e = 0; e < NUM_ENGINES; e++){
+        plan->cost[e] = -1;
+    }
+    plan->support = support_size(formula, stmt, UINT_MAX);
+    plan->shared = shared_fraction(formula, stmt);
+
+    if (stmt->kind == STMT_MINIMIZE){
+        plan->engine = plan->fallback = ENGINE_REPORT;
+        plan->cost[ENGINE_REPORT] = 0;
+        return;
+    }
+    if (stmt->num_vars >= 64){
+        // too many rows to enumerate, the solver is the only way
+        plan->engine = plan->fallback = is_query(stmt) ? ENGINE_SAT : ENGINE_SCAN;
+        return;
+    }
+
+    size_t num_vars = stmt->num_vars;
+    unsigned long rows = 1UL << num_vars;
+    size_t num_threads = options->num_threads > 0 ? options->num_threads : 1;
+    sample_words(formula, stmt, plan);
+    double evaluate = (rows + 63) / 64 * plan->word_seconds;
+
+    if (is_query(stmt)){
+        // the solver gets as long as simulating the whole table would take, then simulation takes over
+        plan->engine = ENGINE_SAT;
+        plan->fallback = ENGINE_SCAN;
+        plan->cost[ENGINE_SCAN] = evaluate;
+        plan->budget = evaluate > MIN_BUDGET ? evaluate : MIN_BUDGET;
+        return;
+    }
+
+    double printed = stmt->kind == STMT_SHOW ? rows : plan->density * rows;
+    double bytes = printed * 2 * (num_vars + stmt->num_outputs);
+    double format = bytes * FORMAT_SECONDS, write = bytes * WRITE_SECONDS;
+
+    plan->cost[ENGINE_SCAN] = evaluate + format + write;
+    double parallel = (evaluate + format) / num_threads;
+    plan->cost[ENGINE_PIPELINE] = (parallel > write ? parallel : write) + (num_threads + 1) * THREAD_SECONDS;
+
+    // show_ones is evaluated twice into a mapped file, once to count the rows
+    if (options->output != NULL && options->progress == NULL){
+        double passes = stmt->kind == STMT_SHOW ? 1 : 2;
+        plan->cost[ENGINE_MAPPED] = (passes * evaluate + format + bytes * MAP_SECONDS) / num_threads
+                                    + num_threads * THREAD_SECONDS;
+    }
+
+    int probe = plan->cost[ENGINE_SCAN] >= PROBE_SECONDS && options->progress == NULL;
+    if (options->progress == NULL && (num_threads > 1 || options->split > 0)){
+        int *split_bit = malloc((num_vars + 1) * sizeof(int));
+        if (split_bit == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        plan->num_split = split_variables(formula, stmt, options, split_bit);
+        if (plan->num_split > 0){
+            plan->folded = probe ? kleene_decided(formula, stmt, split_bit, plan->num_split, PROBE_SAMPLES) : 0;
+            double build = (double)(1UL << plan->num_split) * stmt->cone_size * BUILD_SECONDS;
+            plan->cost[ENGINE_COFACTOR] = (evaluate * (1 - plan->folded) + build) / num_threads
+                                          + format + write + num_threads * THREAD_SECONDS;
+        }
+        free(split_bit);
+    }
+    if (probe && stmt->kind == STMT_SHOW_ONES && num_vars > PRUNE_LEAF_VARS){
+        // the nodes just above the leaves: a subcube decided higher up is decided there too
+        size_t depth = num_vars - PRUNE_LEAF_VARS - 1;
+        int *prefix_bit = malloc((num_vars + 1) * sizeof(int));
+        if (prefix_bit == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (size_t j = 0; j < num_vars; j++){
+            prefix_bit[j] = j < depth ? (int)(depth - 1 - j) : -1;
+        }
+        double start = now_seconds();
+        plan->pruned = kleene_decided(formula, stmt, prefix_bit, depth, PROBE_SAMPLES);
+        unsigned long samples = depth < 63 && (1UL << depth) < PROBE_SAMPLES ? 1UL << depth : PROBE_SAMPLES;
+        double node_seconds = (now_seconds() - start) / samples;
+        free(prefix_bit);
+
+        // every undecided leaf is evaluated, after about two three-valued evaluations on its way,
+        // and the search goes down to at least one leaf
+        double nodes = 2 * (1 - plan->pruned) * (double)(rows >> PRUNE_LEAF_VARS) + depth;
+        plan->cost[ENGINE_PRUNE] = (1 - plan->pruned) * evaluate + nodes * node_seconds + format + write;
+    }
+
+    if (probe && num_vars >= SYMMETRY_MIN_VARS){
+        // the classes are kept for the engine, the solver gets a fraction of a full evaluation
+        find_symmetry(formula, stmt, evaluate * SYMMETRY_BUDGET_SHARE, &plan->symmetry);
+        unsigned long num_points = plan->symmetry.points;
+        if (symmetry_pays(stmt, &plan->symmetry)){
+            // the points are evaluated on the calling thread, the rows looked up by the pipeline workers,
+            // for show_ones only in the words with a row printed: as many as if the rows were independent
+            double points = (num_points + 63) / 64 * (plan->word_seconds + 64 * num_vars * PACK_SECONDS);
+            double looked_up = 1;
+            if (stmt->kind == STMT_SHOW_ONES){
+                double none = 1 - plan->density;
+                for (int i = 0; i < 6; i++){
+                    none *= none;
+                }
+                looked_up = 1 - none;
+            }
+            double lookup = (looked_up * rows * stmt->num_outputs * LOOKUP_SECONDS + format) / num_threads;
+            plan->cost[ENGINE_SYMMETRY] = points + (lookup > write ? lookup : write) + (num_threads + 1) * THREAD_SECONDS;
+        }
+    }
+
+    // checkpoints record rows written by the pipeline, and an explicit --split asks for the cofactors
+    if (options->progress != NULL){
+        plan->engine = ENGINE_PIPELINE;
+    }
+    else if (options->split > 0 && plan->cost[ENGINE_COFACTOR] >= 0){
+        plan->engine = ENGINE_COFACTOR;
+    }
+    else {
+        plan->engine = ENGINE_SCAN;
+        for (Engine e = ENGINE_PIPELINE; e < NUM_ENGINES; e++){
+            if (plan->cost[e] >= 0 && plan->cost[e] < plan->cost[plan->engine]){
+                plan->engine = e;
+            }
+        }
+    }
+    plan->fallback = plan->engine;
+    if (plan->engine == ENGINE_PRUNE){
+        plan->fallback = ENGINE_PIPELINE;
+        plan->budget = BUDGET_FACTOR * plan->cost[ENGINE_PRUNE];
+        if (plan->budget < MIN_BUDGET){
+            plan->budget = MIN_BUDGET;
+        }
+    }
+}
+
+// Decides whether statement first and the show and show_ones statements right after it are
+// printed from one sweep, given the plans of the statements one by one. end is set past the
+// candidates, with the estimated time of one sweep and of the statements one by one, and 1 is
+// returned when the sweep is cheaper.
+int plan_fusion(const Formula *formula, const Plan *plans, size_t first, const Options *options, size_t *end,
+                double *fused, double *separate){
+    *end = first;
+    while (*end < formula->num_statements && !is_query(&formula->statements[*end]) &&
+           formula->statements[*end].num_vars < 64){
+        (*end)++;
+    }
+    *fused = *separate = 0;
+    if (*end < first + 2 || options->progress != NULL){
+        *end = first + 1;
+        return 0;
+    }
+
+    // one sweep: the union cone on the largest table, every statement formatted, all but the first
+    // written to a temporary file and read back
+    Statement sweep;
+    Plan sample;
+    fused_statement(formula, first, *end, &sweep);
+    sample_words(formula, &sweep, &sample);
+    *fused = ((1UL << sweep.num_vars) + 63) / 64 * sample.word_seconds;
+    for (size_t s = first; s < *end; s++){
+        const Statement *stmt = &formula->statements[s];
+        const Plan *plan = &plans[s];
+        *separate += plan->cost[plan->engine];
+
+        double printed = stmt->kind == STMT_SHOW ? 1UL << stmt->num_vars : plan->density * (1UL << stmt->num_vars);
+        double bytes = printed * 2 * (stmt->num_vars + stmt->num_outputs);
+        *fused += bytes * (FORMAT_SECONDS + WRITE_SECONDS) + (s > first ? 2 * bytes * WRITE_SECONDS : 0);
+    }
+    free(sweep.outputs);
+    free(sweep.cone);
+    return *fused < *separate;
+}
+
+// Prints the measurements and estimates of the plan, for --explain
+void explain_plan(const Formula *formula, const Statement *stmt, const Plan *plan, FILE *out){
+    fprintf(out, "%s", statement_keyword(stmt));
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        fprintf(out, " %s", stmt->names[j]);
+    }
+    fprintf(out, "\n  %zu variables, support %zu (", stmt->num_vars, plan->support);
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        fprintf(out, "%s%s %zu", j > 0 ? ", " : "", stmt->names[j], support_size(formula, stmt, stmt->outputs[j]));
+    }
+    fprintf(out, "), cone of %zu instructions, %.0f%% shared\n", stmt->cone_size, 100 * plan->shared);
+
+    if (plan->word_seconds > 0){
+        fprintf(out, "  %.3g us per word", plan->word_seconds * 1e6);
+        if (!is_query(stmt)){
+            fprintf(out, ", %.3g%% of the rows printed", 100 * plan->density);
+        }
+        fputc('\n', out);
+    }
+    if (plan->cost[ENGINE_PRUNE] >= 0){
+        fprintf(out, "  pruning decides %.3g%% of the rows\n", 100 * plan->pruned);
+    }
+    if (plan->symmetry.num_classes > 0){
+        fprintf(out, "  %zu classes of symmetric variables, %lu weight assignments%s\n", plan->symmetry.num_classes,
+                plan->symmetry.points, symmetry_pays(stmt, &plan->symmetry) ? "" : " (too many to evaluate)");
+    }
+    if (plan->cost[ENGINE_COFACTOR] >= 0){
+        fprintf(out, "  %lu cofactors on %zu variables, %.3g%% fold to constants\n",
+                1UL << plan->num_split, plan->num_split, 100 * plan->folded);
+    }
+    for (Engine e = 0; e < NUM_ENGINES; e++){
+        if (plan->cost[e] >= 0 || e == plan->engine){
+            fprintf(out, "  %-9s", engine_names[e]);
+            if (plan->cost[e] >= 0){
+                fprintf(out, " %10.3g s", plan->cost[e]);
+            }
+            else {
+                fprintf(out, " %12s", "?");
+            }
+            if (e == plan->engine){
+                fputs("  <- chosen", out);
+                if (plan->fallback != plan->engine){
+                    fprintf(out, ", %s after %.3g s", engine_names[plan->fallback], plan->budget);
+                }
+            }
+            fputc('\n', out);
+        }
+    }
+}
+
+// Runs the statement with the engine of its plan, which evaluates the symmetry classes it found
+void run_planned(const Formula *formula, const Statement *stmt, Plan *plan, const Options *options, FILE *out){
+    if (options->verbose){
+        fprintf(stderr, "plan: %s %s\n", statement_keyword(stmt), engine_names[plan->engine]);
+    }
+
+    switch (plan->engine){
+        case ENGINE_SAT:
+            run_query(formula, stmt, plan->budget, out);
+            break;
+        case ENGINE_PIPELINE:
+            run_statement_pipelined(formula, stmt, options, out);
+            break;
+        case ENGINE_COFACTOR:
+            run_statement_parallel(formula, stmt, options, out);
+            break;
+        case ENGINE_MAPPED:
+            if (!run_statement_mapped(formula, stmt, options, out)){
+                run_statement_pipelined(formula, stmt, options, out);  // not a regular file, or no space
+            }
+            break;
+        case ENGINE_SYMMETRY: {
+            evaluate_symmetry(formula, stmt, &plan->symmetry);
+            if (options->verbose){
+                fprintf(stderr, "symmetry: %zu classes, %lu points for %lu rows\n", plan->symmetry.num_classes,
+                        plan->symmetry.points, 1UL << stmt->num_vars);
+            }
+            Options lookup = *options;
+            lookup.symmetry = &plan->symmetry;
+            run_statement_pipelined(formula, stmt, &lookup, out);
+            break;
+        }
+        case ENGINE_PRUNE: {
+            unsigned long rows = 1UL << stmt->num_vars;
+            unsigned long row = show_ones_pruned(formula, stmt, options, now_seconds() + plan->budget, out);
+            if (row < rows){
+                // over budget: the rows from there on go through the pipeline
+                if (options->verbose){
+                    fprintf(stderr, "plan: pruning past %.3g s at row %lu, pipeline for the rest\n", plan->budget, row);
+                }
+                Options rest = *options;
+                rest.first_row = row;
+                run_statement_pipelined(formula, stmt, &rest, out);
+            }
+            break;
+        }
+        default:
+            run_statement(formula, stmt, out);
+            break;
+    }
+}
+
+void free_plan(Plan *plan){
+    free_symmetry(&plan->symmetry);
+}
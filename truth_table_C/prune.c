@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * Three-valued prefix pruning for show_ones.
+ *
+ * The rows are enumerated depth first over the declared variable order, which is the row
+ * order. At every node of the search the first depth variables are fixed and the cone is
+ * evaluated in Kleene's three-valued logic with the others unknown: false and x is false, true
+ * or x is true, everything else involving x is unknown. When every shown output is known
+ * the whole subcube is decided at once, skipped if they are all false and printed without
+ * further evaluation otherwise. Subcubes of at most 2^PRUNE_LEAF_VARS rows are evaluated
+ * normally, 64 rows per word, so the three-valued evaluation only runs along the boundary of
+ * the set of printed rows, at most once per 2^PRUNE_LEAF_VARS rows.
+ *
+ * With a deadline the search stops between two subcubes, once it has passed, and returns the
+ * first row it did not print, so the planner can hand the rest of the table to another engine.
+ * The same evaluation over a sample of the assignments of a few variables tells the planner how
+ * much of the table pruning, or folding cofactors, is likely to decide (kleene_decided).
+ */
+
+enum { KLEENE_FALSE, KLEENE_TRUE, KLEENE_UNKNOWN };
+
+typedef struct {
+    const Formula *formula;
+    const Statement *stmt;
+    unsigned char *kleene;  // Three-valued value of each instruction
+    unsigned char *fixed;   // Per declared variable: 1 when fixed by the prefix
+    uint64_t *values;       // Bit-sliced values of each instruction
+    OutputBuffer *buffer;
+    unsigned long skipped;  // Rows of subcubes proven false
+    unsigned long bulk;     // Rows of subcubes printed without evaluation
+    unsigned long nodes;    // Three-valued evaluations
+    double deadline;        // now_seconds() at which to give up, 0 for none
+    unsigned long stopped;  // First row not printed
+} PruneJob;
+
+// Evaluates the cone with the variables marked in fixed set as in row and the others unknown
+static void eval_kleene(const Formula *formula, const Statement *stmt, const unsigned char *fixed,
+                        unsigned long row, unsigned char *kleene){
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &formula->code[i];
+        switch (in->op){
+            case OP_CONST:
+                kleene[i] = in->a ? KLEENE_TRUE : KLEENE_FALSE;
+                break;
+            case OP_INPUT:
+                kleene[i] = fixed[in->a] ? (row >> (stmt->num_vars - 1 - in->a)) & 1 : KLEENE_UNKNOWN;
+                break;
+            case OP_NOT:
+                kleene[i] = kleene[in->a] == KLEENE_UNKNOWN ? KLEENE_UNKNOWN : !kleene[in->a];
+                break;
+            case OP_AND:
+                if (kleene[in->a] == KLEENE_FALSE || kleene[in->b] == KLEENE_FALSE){
+                    kleene[i] = KLEENE_FALSE;
+                }
+                else {
+                    kleene[i] = kleene[in->a] == KLEENE_TRUE && kleene[in->b] == KLEENE_TRUE ? KLEENE_TRUE : KLEENE_UNKNOWN;
+                }
+                break;
+            case OP_OR:
+                if (kleene[in->a] == KLEENE_TRUE || kleene[in->b] == KLEENE_TRUE){
+                    kleene[i] = KLEENE_TRUE;
+                }
+                else {
+                    kleene[i] = kleene[in->a] == KLEENE_FALSE && kleene[in->b] == KLEENE_FALSE ? KLEENE_FALSE : KLEENE_UNKNOWN;
+                }
+                break;
+        }
+    }
+}
+
+static int outputs_known(const Statement *stmt, const unsigned char *kleene){
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        if (kleene[stmt->outputs[j]] == KLEENE_UNKNOWN){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Prints the rows of a subcube where some output is true, evaluating 64 rows per word
+static void visit_leaf(PruneJob *job, unsigned long first, unsigned long count){
+    const Statement *stmt = job->stmt;
+    unsigned long rows = 1UL << stmt->num_vars;
+    for (unsigned long base = first; base < first + count; base += 64){
+        eval_word(job->formula, stmt, base, job->values);
+        uint64_t ones = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            ones |= job->values[stmt->outputs[j]];
+        }
+        ones &= valid_rows_mask(rows, base);
+        while (ones != 0){
+            unsigned int bit = __builtin_ctzll(ones);
+            emit_row(job->buffer, stmt, base + bit, job->values, bit);
+            ones &= ones - 1;
+        }
+    }
+}
+
+// Returns 0 when the deadline passed before the subcube, which is then left to the caller
+static int visit(PruneJob *job, size_t depth, unsigned long first){
+    const Statement *stmt = job->stmt;
+    size_t free_vars = stmt->num_vars - depth;
+    unsigned long count = 1UL << free_vars;
+    if (job->deadline > 0 && first > 0 && now_seconds() > job->deadline){
+        job->stopped = first;
+        return 0;
+    }
+    if (free_vars <= PRUNE_LEAF_VARS){
+        visit_leaf(job, first, count);
+        return 1;
+    }
+
+    for (size_t j = 0; j < stmt->num_vars; j++){
+        job->fixed[j] = j < depth;
+    }
+    eval_kleene(job->formula, stmt, job->fixed, first, job->kleene);
+    job->nodes++;
+    if (outputs_known(stmt, job->kleene)){
+        int any_true = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            any_true |= job->kleene[stmt->outputs[j]] == KLEENE_TRUE;
+        }
+        if (!any_true){
+            job->skipped += count;
+            return 1;
+        }
+        // every row of the subcube prints the same output values
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            job->values[stmt->outputs[j]] = job->kleene[stmt->outputs[j]] == KLEENE_TRUE ? ~0ULL : 0;
+        }
+        for (unsigned long row = first; row < first + count; row++){
+            emit_row(job->buffer, stmt, row, job->values, 0);
+        }
+        job->bulk += count;
+        return 1;
+    }
+
+    return visit(job, depth + 1, first) && visit(job, depth + 1, first + count / 2);
+}
+
+// Prints the statement with pruning until deadline (0 for none), returns the rows printed through
+unsigned long show_ones_pruned(const Formula *formula, const Statement *stmt, const Options *options,
+                               double deadline, FILE *out){
+    print_header(stmt, formula->variables, out);
+
+    PruneJob job;
+    memset(&job, 0, sizeof(job));
+    job.formula = formula;
+    job.stmt = stmt;
+    job.kleene = malloc(formula->size + 1);
+    job.fixed = malloc(stmt->num_vars + 1);
+    job.values = alloc_values(formula);
+    job.buffer = create_output_buffer(out);
+    job.deadline = deadline;
+    job.stopped = 1UL << stmt->num_vars;
+    if (job.kleene == NULL || job.fixed == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    visit(&job, 0, 0);
+    flush_output(job.buffer);
+
+    if (options->verbose){
+        fprintf(stderr, "prune: %lu of %lu rows skipped, %lu printed in bulk, %lu three-valued evaluations\n",
+                job.skipped, 1UL << stmt->num_vars, job.bulk, job.nodes);
+    }
+    free(job.buffer);
+    free(job.values);
+    free(job.fixed);
+    free(job.kleene);
+    return job.stopped;
+}
+
+// Fraction of the assignments of the variables with fixed_bit[j] >= 0 under which every output is
+// known in three-valued logic, over a pseudo-random sample when there are more than samples
+double kleene_decided(const Formula *formula, const Statement *stmt, const int *fixed_bit,
+                      size_t num_fixed, unsigned long samples){
+    unsigned char *kleene = malloc(formula->size + 1);
+    unsigned char *fixed = malloc(stmt->num_vars + 1);
+    if (kleene == NULL || fixed == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < stmt->num_vars; j++){
+        fixed[j] = fixed_bit[j] >= 0;
+    }
+
+    unsigned long assignments = 1UL << num_fixed;
+    if (samples > assignments){
+        samples = assignments;
+    }
+    unsigned long decided = 0;
+    for (unsigned long s = 0; s < samples; s++){
+        unsigned long assignment = s;
+        if (samples < assignments){
+            // scattered over all the bits, not only the high ones
+            uint64_t mixed = (s + 1) * 0x9E3779B97F4A7C15ULL;
+            mixed = (mixed ^ (mixed >> 31)) * 0xBF58476D1CE4E5B9ULL;
+            assignment = (mixed ^ (mixed >> 29)) >> (64 - num_fixed);
+        }
+        unsigned long row = 0;
+        for (size_t j = 0; j < stmt->num_vars; j++){
+            if (fixed_bit[j] >= 0){
+                row |= ((assignment >> fixed_bit[j]) & 1) << (stmt->num_vars - 1 - j);
+            }
+        }
+        eval_kleene(formula, stmt, fixed, row, kleene);
+        decided += outputs_known(stmt, kleene);
+    }
+
+    free(fixed);
+    free(kleene);
+    return samples > 0 ? (double)decided / samples : 0;
+}
@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * check and equiv statements, answered without enumerating the table.
+ *
+ * "check z;" asks for the first row where z is true and "equiv a b;" for the first row where
+ * a and b differ (the miter of the two). The first rows are simulated 64 at a time, which
+ * settles small tables and shallow answers; otherwise the cone of the statement is Tseitin
+ * encoded and handed to a small CDCL solver. Both sides of a miter share the structurally
+ * hashed instructions of the formula, so identical subterms are encoded once and two names
+ * bound to the same instruction are equivalent without calling the solver. A satisfying
+ * assignment is turned into the first satisfying row by fixing the variables to 0 in
+ * declaration order, under assumptions, while the solver keeps what it learnt. With a time
+ * budget from the planner, the solver gives up at the first restart past it and the rows not
+ * simulated yet are, which always terminates.
+ */
+
+#define SIMULATED_WORDS 1024   // Rows tried by simulation before calling the solver: 64 * 1024
+#define RESTART_BASE 100       // Conflicts before the first restart, scaled by the Luby sequence
+
+/* CDCL SOLVER */
+
+// Literal of variable v is 2v, its negation 2v + 1
+#define LIT(v, negated) (2 * (v) + (negated))
+#define VAR(lit) ((lit) >> 1)
+#define NEG(lit) ((lit) ^ 1)
+
+typedef struct {
+    int *clauses;     // Offsets of the clauses whose first or second literal is this one
+    size_t size;
+    size_t capacity;
+} WatchList;
+
+typedef struct {
+    int num_vars;
+    int ok;                 // 0 once the clauses are unsatisfiable without assumptions
+
+    int *data;              // Clauses one after the other: size, then the literals
+    size_t data_size;
+    size_t data_capacity;
+    WatchList *watches;     // Indexed by literal
+
+    signed char *value;     // -1 unassigned, 0 false, 1 true
+    int *level;
+    int *reason;            // Clause that implied the variable, -1 for decisions
+    int *trail;
+    int trail_size;
+    int propagated;
+    int *trail_lim;         // Trail size at the start of every decision level
+    int num_levels;
+
+    double *activity;
+    double increment;
+    int *heap;              // Max-heap of variables on activity
+    int *heap_index;        // Position in the heap, -1 if not in it
+    int heap_size;
+    unsigned char *phase;   // Last value of every variable, 0 at first
+    unsigned char *seen;
+    signed char *model;     // Values of the last satisfying assignment
+    double deadline;        // now_seconds() at which sat_solve gives up, 0 for none
+} Solver;
+
+static void* sat_alloc(size_t count, size_t size){
+    void *memory = calloc(count + 1, size);
+    if (memory == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    return memory;
+}
+
+static void heap_up(Solver *s, int i){
+    int v = s->heap[i];
+    while (i > 0 && s->activity[s->heap[(i - 1) / 2]] < s->activity[v]){
+        s->heap[i] = s->heap[(i - 1) / 2];
+        s->heap_index[s->heap[i]] = i;
+        i = (i - 1) / 2;
+    }
+    s->heap[i] = v;
+    s->heap_index[v] = i;
+}
+
+static void heap_down(Solver *s, int i){
+    int v = s->heap[i];
+    for (;;){
+        int child = 2 * i + 1;
+        if (child >= s->heap_size){
+            break;
+        }
+        if (child + 1 < s->heap_size && s->activity[s->heap[child + 1]] > s->activity[s->heap[child]]){
+            child++;
+        }
+        if (s->activity[s->heap[child]] <= s->activity[v]){
+            break;
+        }
+        s->heap[i] = s->heap[child];
+        s->heap_index[s->heap[i]] = i;
+        i = child;
+    }
+    s->heap[i] = v;
+    s->heap_index[v] = i;
+}
+
+static void heap_insert(Solver *s, int v){
+    if (s->heap_index[v] >= 0){
+        return;
+    }
+    s->heap[s->heap_size] = v;
+    heap_up(s, s->heap_size++);
+}
+
+static int heap_pop(Solver *s){
+    int v = s->heap[0];
+    s->heap_index[v] = -1;
+    s->heap_size--;
+    if (s->heap_size > 0){
+        s->heap[0] = s->heap[s->heap_size];
+        heap_down(s, 0);
+    }
+    return v;
+}
+
+static Solver* sat_create(int num_vars){
+    Solver *s = sat_alloc(1, sizeof(Solver));
+    s->num_vars = num_vars;
+    s->ok = 1;
+    s->data_capacity = 1024;
+    s->data = sat_alloc(s->data_capacity, sizeof(int));
+    s->watches = sat_alloc(2 * num_vars, sizeof(WatchList));
+    s->value = sat_alloc(num_vars, 1);
+    s->level = sat_alloc(num_vars, sizeof(int));
+    s->reason = sat_alloc(num_vars, sizeof(int));
+    s->trail = sat_alloc(num_vars, sizeof(int));
+    s->trail_lim = sat_alloc(2 * num_vars, sizeof(int));  // assumptions may open empty levels
+    s->activity = sat_alloc(num_vars, sizeof(double));
+    s->increment = 1.0;
+    s->heap = sat_alloc(num_vars, sizeof(int));
+    s->heap_index = sat_alloc(num_vars, sizeof(int));
+    s->phase = sat_alloc(num_vars, 1);
+    s->seen = sat_alloc(num_vars, 1);
+    s->model = sat_alloc(num_vars, 1);
+    for (int v = 0; v < num_vars; v++){
+        s->value[v] = -1;
+        s->heap_index[v] = -1;
+        heap_insert(s, v);
+    }
+    return s;
+}
+
+static void sat_free(Solver *s){
+    for (int l = 0; l < 2 * s->num_vars; l++){
+        free(s->watches[l].clauses);
+    }
+    free(s->watches);
+    free(s->data);
+    free(s->value);
+    free(s->level);
+    free(s->reason);
+    free(s->trail);
+    free(s->trail_lim);
+    free(s->activity);
+    free(s->heap);
+    free(s->heap_index);
+    free(s->phase);
+    free(s->seen);
+    free(s->model);
+    free(s);
+}
+
+// 1 true, 0 false, -1 unassigned
+static int lit_value(const Solver *s, int lit){
+    int v = s->value[VAR(lit)];
+    return v < 0 ? -1 : v ^ (lit & 1);
+}
+
+static void add_watch(Solver *s, int lit, int clause){
+    WatchList *list = &s->watches[lit];
+    if (list->size >= list->capacity){
+        list->capacity = list->capacity ? 2 * list->capacity : 4;
+        list->clauses = realloc(list->clauses, list->capacity * sizeof(int));
+        if (list->clauses == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    list->clauses[list->size++] = clause;
+}
+
+static void enqueue(Solver *s, int lit, int reason){
+    int v = VAR(lit);
+    s->value[v] = !(lit & 1);
+    s->level[v] = s->num_levels;
+    s->reason[v] = reason;
+    s->trail[s->trail_size++] = lit;
+}
+
+// Stores a clause of at least two literals and watches its first two, returns its offset
+static int store_clause(Solver *s, const int *lits, int size){
+    if (s->data_size + size + 1 > s->data_capacity){
+        while (s->data_size + size + 1 > s->data_capacity){
+            s->data_capacity *= 2;
+        }
+        s->data = realloc(s->data, s->data_capacity * sizeof(int));
+        if (s->data == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+    }
+    int clause = (int)s->data_size;
+    s->data[s->data_size++] = size;
+    memcpy(s->data + s->data_size, lits, size * sizeof(int));
+    s->data_size += size;
+    add_watch(s, lits[0], clause);
+    add_watch(s, lits[1], clause);
+    return clause;
+}
+
+// Unit propagation, returns the conflicting clause or -1
+static int propagate(Solver *s){
+    while (s->propagated < s->trail_size){
+        int false_lit = NEG(s->trail[s->propagated++]);
+        WatchList *list = &s->watches[false_lit];
+        size_t i = 0, j = 0;
+        while (i < list->size){
+            int clause = list->clauses[i++];
+            int size = s->data[clause];
+            int *lits = s->data + clause + 1;
+            if (lits[0] == false_lit){
+                lits[0] = lits[1];
+                lits[1] = false_lit;
+            }
+            if (lit_value(s, lits[0]) == 1){
+                list->clauses[j++] = clause;
+                continue;
+            }
+            // look for another literal to watch instead of the false one
+            int moved = 0;
+            for (int k = 2; k < size; k++){
+                if (lit_value(s, lits[k]) != 0){
+                    lits[1] = lits[k];
+                    lits[k] = false_lit;
+                    add_watch(s, lits[1], clause);
+                    moved = 1;
+                    break;
+                }
+            }
+            if (moved){
+                continue;
+            }
+            list->clauses[j++] = clause;
+            if (lit_value(s, lits[0]) == 0){
+                while (i < list->size){
+                    list->clauses[j++] = list->clauses[i++];
+                }
+                list->size = j;
+                s->propagated = s->trail_size;
+                return clause;
+            }
+            enqueue(s, lits[0], clause);
+        }
+        list->size = j;
+    }
+    return -1;
+}
+
+static void cancel_until(Solver *s, int level){
+    if (s->num_levels <= level){
+        return;
+    }
+    for (int i = s->trail_size - 1; i >= s->trail_lim[level]; i--){
+        int v = VAR(s->trail[i]);
+        s->phase[v] = s->value[v];
+        s->value[v] = -1;
+        heap_insert(s, v);
+    }
+    s->trail_size = s->propagated = s->trail_lim[level];
+    s->num_levels = level;
+}
+
+static void bump(Solver *s, int v){
+    s->activity[v] += s->increment;
+    if (s->activity[v] > 1e100){
+        for (int u = 0; u < s->num_vars; u++){
+            s->activity[u] *= 1e-100;
+        }
+        s->increment *= 1e-100;
+    }
+    if (s->heap_index[v] >= 0){
+        heap_up(s, s->heap_index[v]);
+    }
+}
+
+// First-UIP conflict analysis, fills learnt (asserting literal first) and returns the backjump level
+static int analyze(Solver *s, int conflict, int *learnt, int *learnt_size){
+    int size = 1, pending = 0, lit = -1;
+    int index = s->trail_size - 1;
+    do {
+        int clause_size = s->data[conflict];
+        const int *lits = s->data + conflict + 1;
+        for (int k = lit < 0 ? 0 : 1; k < clause_size; k++){
+            int v = VAR(lits[k]);
+            if (!s->seen[v] && s->level[v] > 0){
+                s->seen[v] = 1;
+                bump(s, v);
+                if (s->level[v] >= s->num_levels){
+                    pending++;
+                }
+                else {
+                    learnt[size++] = lits[k];
+                }
+            }
+        }
+        while (!s->seen[VAR(s->trail[index])]){
+            index--;
+        }
+        lit = s->trail[index--];
+        conflict = s->reason[VAR(lit)];
+        s->seen[VAR(lit)] = 0;
+        pending--;
+    } while (pending > 0);
+    learnt[0] = NEG(lit);
+
+    // the literal of the highest remaining level is watched second
+    int level = 0;
+    for (int k = 1; k < size; k++){
+        s->seen[VAR(learnt[k])] = 0;
+        if (s->level[VAR(learnt[k])] > level){
+            level = s->level[VAR(learnt[k])];
+            int tmp = learnt[1];
+            learnt[1] = learnt[k];
+            learnt[k] = tmp;
+        }
+    }
+    s->increment /= 0.95;
+    *learnt_size = size;
+    return level;
+}
+
+// Adds a clause between two solves, returns 0 if the clauses became unsatisfiable
+static int sat_add_clause(Solver *s, const int *lits, int size){
+    if (!s->ok){
+        return 0;
+    }
+    int *kept = sat_alloc(size, sizeof(int));
+    int count = 0;
+    for (int k = 0; k < size; k++){
+        int value = lit_value(s, lits[k]);
+        if (value == 1){
+            free(kept);
+            return 1;  // already satisfied
+        }
+        int duplicate = value == 0;  // false at level 0
+        for (int m = 0; m < count && !duplicate; m++){
+            if (kept[m] == NEG(lits[k])){
+                free(kept);
+                return 1;  // tautology
+            }
+            duplicate = kept[m] == lits[k];
+        }
+        if (!duplicate){
+            kept[count++] = lits[k];
+        }
+    }
+    if (count == 0){
+        s->ok = 0;
+    }
+    else if (count == 1){
+        enqueue(s, kept[0], -1);
+        s->ok = propagate(s) < 0;
+    }
+    else {
+        store_clause(s, kept, count);
+    }
+    free(kept);
+    return s->ok;
+}
+
+static double luby(int i){
+    int size = 1, seq = 0;
+    while (size < i + 1){
+        seq++;
+        size = 2 * size + 1;
+    }
+    while (size - 1 != i){
+        size = (size - 1) >> 1;
+        seq--;
+        i = i % size;
+    }
+    double result = 1.0;
+    while (seq-- > 0){
+        result *= 2.0;
+    }
+    return result;
+}
+
+// Solves under assumptions, returns 1 and fills model if satisfiable, -1 past the deadline
+static int sat_solve(Solver *s, const int *assumptions, int num_assumptions){
+    if (!s->ok){
+        return 0;
+    }
+    int *learnt = sat_alloc(s->num_vars, sizeof(int));
+    int restarts = 0;
+    long conflicts = 0;
+    long limit = (long)(RESTART_BASE * luby(0));
+    int result = -1;
+
+    while (result < 0){
+        int conflict = propagate(s);
+        if (conflict >= 0){
+            conflicts++;
+            if (s->num_levels == 0){
+                s->ok = 0;
+                result = 0;
+                break;
+            }
+            int size;
+            int level = analyze(s, conflict, learnt, &size);
+            cancel_until(s, level);
+            if (size == 1){
+                enqueue(s, learnt[0], -1);
+            }
+            else {
+                enqueue(s, learnt[0], store_clause(s, learnt, size));
+            }
+            continue;
+        }
+
+        if (conflicts >= limit){
+            if (s->deadline > 0 && now_seconds() > s->deadline){
+                break;  // checked on restarts only, result is still -1
+            }
+            conflicts = 0;
+            limit = (long)(RESTART_BASE * luby(++restarts));
+            cancel_until(s, 0);
+            continue;
+        }
+
+        int next = -1;
+        while (s->num_levels < num_assumptions){
+            int lit = assumptions[s->num_levels];
+            int value = lit_value(s, lit);
+            if (value == 0){
+                result = 0;  // the assumptions contradict the clauses
+                break;
+            }
+            s->trail_lim[s->num_levels++] = s->trail_size;
+            if (value < 0){
+                next = lit;
+                break;
+            }
+        }
+        if (result == 0){
+            break;
+        }
+        if (next < 0){
+            while (s->heap_size > 0 && s->value[s->heap[0]] >= 0){
+                heap_pop(s);
+            }
+            if (s->heap_size == 0){
+                for (int v = 0; v < s->num_vars; v++){
+                    s->model[v] = s->value[v];
+                }
+                result = 1;
+                break;
+            }
+            int v = heap_pop(s);
+            next = LIT(v, !s->phase[v]);
+            s->trail_lim[s->num_levels++] = s->trail_size;
+        }
+        enqueue(s, next, -1);
+    }
+
+    cancel_until(s, 0);
+    free(learnt);
+    return result;
+}
+
+/* QUERIES */
+
+// Instruction word whose set bits are the rows answering the statement
+static uint64_t query_word(const Statement *stmt, const uint64_t *values){
+    if (stmt->kind == STMT_EQUIV){
+        return values[stmt->outputs[0]] ^ values[stmt->outputs[1]];
+    }
+    uint64_t ones = 0;
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        ones |= values[stmt->outputs[j]];
+    }
+    return ones;
+}
+
+// Simulates the words first..end-1, returns 1 with the first row found, 0 if none is left, -1 if rows remain
+static int simulate_rows(const Formula *formula, const Statement *stmt, uint64_t *values,
+                         unsigned long first, unsigned long end, unsigned long *row){
+    // 64 declared variables: 2^64 rows, more than any simulation budget
+    unsigned long rows = stmt->num_vars < 64 ? 1UL << stmt->num_vars : 0;
+    for (unsigned long w = first; w < end; w++){
+        unsigned long base = w * 64;
+        if (rows != 0 && base >= rows){
+            return 0;
+        }
+        eval_word(formula, stmt, base, values);
+        uint64_t found = query_word(stmt, values);
+        if (rows != 0){
+            found &= valid_rows_mask(rows, base);
+        }
+        if (found != 0){
+            *row = base + __builtin_ctzll(found);
+            return 1;
+        }
+    }
+    return rows != 0 && end * 64 >= rows ? 0 : -1;
+}
+
+// Encodes the cone of the statement, returns 1 with the first row answering it if there is one
+// (any row when row is NULL), -1 if the solver ran past the deadline
+static int solve_first_row(const Formula *formula, const Statement *stmt, double deadline, unsigned long *row){
+    // one solver variable per input and gate, plus the constant True
+    int num_vars = 1;
+    int *lit = malloc((formula->size + 1) * sizeof(int));
+    int *input_var = malloc((stmt->num_vars + 1) * sizeof(int));
+    if (lit == NULL || input_var == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < stmt->num_vars; j++){
+        input_var[j] = -1;
+    }
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned char op = formula->code[stmt->cone[k]].op;
+        num_vars += op == OP_INPUT || op == OP_AND || op == OP_OR;
+    }
+
+    Solver *s = sat_create(num_vars);
+    s->deadline = deadline;
+    int next_var = 1;
+    int true_lit = LIT(0, 0);
+    sat_add_clause(s, &true_lit, 1);
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &formula->code[i];
+        switch (in->op){
+            case OP_CONST:
+                lit[i] = in->a ? true_lit : NEG(true_lit);
+                break;
+            case OP_INPUT:
+                input_var[in->a] = next_var;
+                lit[i] = LIT(next_var++, 0);
+                break;
+            case OP_NOT:
+                lit[i] = NEG(lit[in->a]);
+                break;
+            case OP_AND:
+            case OP_OR: {
+                // an or gate is an and gate of the negated literals, negated
+                int flip = in->op == OP_OR;
+                int a = lit[in->a] ^ flip, b = lit[in->b] ^ flip, g = LIT(next_var++, 0);
+                int c1[2] = {NEG(g), a}, c2[2] = {NEG(g), b}, c3[3] = {g, NEG(a), NEG(b)};
+                sat_add_clause(s, c1, 2);
+                sat_add_clause(s, c2, 2);
+                sat_add_clause(s, c3, 3);
+                lit[i] = g ^ flip;
+                break;
+            }
+        }
+    }
+
+    // the miter of equiv is a xor b, check asks for any of its names to be true
+    if (stmt->kind == STMT_EQUIV){
+        int a = lit[stmt->outputs[0]], b = lit[stmt->outputs[1]];
+        int c1[2] = {a, b}, c2[2] = {NEG(a), NEG(b)};
+        sat_add_clause(s, c1, 2);
+        sat_add_clause(s, c2, 2);
+    }
+    else {
+        int *any = sat_alloc(stmt->num_outputs, sizeof(int));
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            any[j] = lit[stmt->outputs[j]];
+        }
+        sat_add_clause(s, any, (int)stmt->num_outputs);
+        free(any);
+    }
+
+    int found = sat_solve(s, NULL, 0);
+    if (found == 1 && row != NULL){
+        // smallest row: every variable, most significant first, is 0 unless that is unsatisfiable
+        int *assumptions = sat_alloc(stmt->num_vars, sizeof(int));
+        int num_assumptions = 0;
+        *row = 0;
+        for (size_t j = 0; j < stmt->num_vars; j++){
+            int v = input_var[j];
+            if (v < 0){
+                continue;  // outside the cone, 0 in the first row
+            }
+            assumptions[num_assumptions] = LIT(v, 1);
+            int zero = s->model[v] == 1 ? sat_solve(s, assumptions, num_assumptions + 1) : 1;
+            if (zero < 0){
+                found = -1;
+                break;
+            }
+            if (!zero){
+                assumptions[num_assumptions] = LIT(v, 0);
+                *row |= 1UL << (stmt->num_vars - 1 - j);
+            }
+            num_assumptions++;
+        }
+        free(assumptions);
+    }
+
+    sat_free(s);
+    free(input_var);
+    free(lit);
+    return found;
+}
+
+// 1 when a row makes one of the outputs of a check statement true, 0 when none does, -1 when the
+// solver ran past the deadline (0 for none)
+int check_satisfiable(const Formula *formula, const Statement *stmt, double deadline){
+    return solve_first_row(formula, stmt, deadline, NULL);
+}
+
+// Answers a check or equiv statement with its first satisfying (differing) row, if any. A solver
+// still running after budget seconds (0 for no limit) is stopped and the rest of the table
+// simulated instead, when it has fewer than 2^64 rows.
+void run_query(const Formula *formula, const Statement *stmt, double budget, FILE *out){
+    const char *keyword = stmt->kind == STMT_EQUIV ? "equiv" : "check";
+    fprintf(out, "# %s", keyword);
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        fprintf(out, " %s", stmt->names[j]);
+    }
+
+    uint64_t *values = alloc_values(formula);
+    unsigned long row = 0;
+    int found;
+    if (stmt->kind == STMT_EQUIV && stmt->outputs[0] == stmt->outputs[1]){
+        found = 0;  // same instruction after structural hashing
+    }
+    else {
+        found = simulate_rows(formula, stmt, values, 0, SIMULATED_WORDS, &row);
+        double deadline = budget > 0 && stmt->num_vars < 64 ? now_seconds() + budget : 0;
+        if (found < 0){
+            found = solve_first_row(formula, stmt, deadline, &row);
+        }
+        if (found < 0){
+            // the solver ran out of time, the rest of the table is simulated instead
+            found = simulate_rows(formula, stmt, values, SIMULATED_WORDS, ((1UL << stmt->num_vars) + 63) / 64, &row);
+        }
+    }
+
+    if (stmt->kind == STMT_EQUIV){
+        fputs(found ? ": DIFFERENT\n" : ": EQUIVALENT\n", out);
+    }
+    else {
+        fputs(found ? ": SAT\n" : ": UNSAT\n", out);
+    }
+    if (found){
+        print_header(stmt, formula->variables, out);
+        OutputBuffer *buffer = create_output_buffer(out);
+        eval_word(formula, stmt, row & ~63UL, values);
+        emit_row(buffer, stmt, row, values, row & 63);
+        flush_output(buffer);
+        free(buffer);
+    }
+    free(values);
+}
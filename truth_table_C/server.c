@@ -0,0 +1,987 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "table.h"
+
+/*
+ * Persistent server mode.
+ *
+ * Requests are framed as a header line followed by the formula text:
+ *
+ *     <id> <length> <query>\n<length bytes of formula text>
+ *
+ * and answered with
+ *
+ *     <id> OK <length>\n<payload>      or      <id> ERR <length>\n<message>
+ *
+ * where query is one of
+ *     run                      the show statements of the text itself
+ *     show <names>             full table of names over every declared variable
+ *     show_ones <names>        rows where at least one of names is true
+ *     count <names>            number of those rows
+ *     rows <start> <n> <names> n rows of the full table starting at start
+ *     check <names>            first row where one of names is true, or UNSAT
+ *     equiv <a> <b>            first row where a and b differ, or EQUIVALENT
+ *
+ * Compiled formulas are kept in an LRU cache keyed by the hash of the text,
+ * so repeated requests skip tokenizing, parsing and compiling altogether.
+ *
+ * A worker answers one request of a connection and hands it back: to the queue when the next
+ * request is buffered already, otherwise to the accept loop, which polls the idle connections
+ * and queues them again once they are readable. More connections than workers are served in
+ * turn, and the replies on a connection keep the order of its requests.
+ */
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_CACHE 256
+#define MAX_HEADER 4096
+#define DEFAULT_MAX_FRAME (16 << 20)
+
+/* FORMULA CACHE */
+
+typedef struct CacheEntry {
+    uint64_t key;                 // fnv1a of the formula text
+    char *text;
+    size_t length;
+    Formula *formula;
+    int refs;                     // Requests using the formula, plus one while it is cached
+    struct CacheEntry *prev;      // LRU list, most recently used first
+    struct CacheEntry *next;
+    struct CacheEntry *chain;     // Bucket chain
+} CacheEntry;
+
+typedef struct {
+    CacheEntry **buckets;
+    size_t num_buckets;
+    CacheEntry *head;
+    CacheEntry *tail;
+    size_t count;
+    size_t capacity;
+    unsigned long hits;
+    unsigned long misses;
+    pthread_mutex_t lock;
+} Cache;
+
+static void cache_init(Cache *cache, size_t capacity){
+    cache->capacity = capacity > 0 ? capacity : 1;
+    cache->num_buckets = 2 * cache->capacity;
+    cache->buckets = calloc(cache->num_buckets, sizeof(CacheEntry *));
+    if (cache->buckets == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    cache->head = cache->tail = NULL;
+    cache->count = 0;
+    cache->hits = cache->misses = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+}
+
+static void free_entry(CacheEntry *entry){
+    free_formula(entry->formula);
+    free(entry->text);
+    free(entry);
+}
+
+// Drops one reference, the last one frees the entry (called with the lock held)
+static void release_locked(CacheEntry *entry){
+    if (--entry->refs == 0){
+        free_entry(entry);
+    }
+}
+
+static void release(Cache *cache, CacheEntry *entry){
+    pthread_mutex_lock(&cache->lock);
+    release_locked(entry);
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void lru_unlink(Cache *cache, CacheEntry *entry){
+    if (entry->prev) entry->prev->next = entry->next; else cache->head = entry->next;
+    if (entry->next) entry->next->prev = entry->prev; else cache->tail = entry->prev;
+    entry->prev = entry->next = NULL;
+}
+
+static void lru_push_front(Cache *cache, CacheEntry *entry){
+    entry->prev = NULL;
+    entry->next = cache->head;
+    if (cache->head) cache->head->prev = entry; else cache->tail = entry;
+    cache->head = entry;
+}
+
+static CacheEntry* cache_find_locked(Cache *cache, uint64_t key, const char *text, size_t length){
+    CacheEntry *entry = cache->buckets[key % cache->num_buckets];
+    while (entry != NULL){
+        if (entry->key == key && entry->length == length && memcmp(entry->text, text, length) == 0){
+            return entry;
+        }
+        entry = entry->chain;
+    }
+    return NULL;
+}
+
+static void cache_evict_locked(Cache *cache){
+    CacheEntry *victim = cache->tail;
+    CacheEntry **link = &cache->buckets[victim->key % cache->num_buckets];
+    while (*link != victim){
+        link = &(*link)->chain;
+    }
+    *link = victim->chain;
+    lru_unlink(cache, victim);
+    cache->count--;
+    release_locked(victim);
+}
+
+// Returns the compiled formula for text with a reference held, or NULL with err filled
+static CacheEntry* cache_acquire(Cache *cache, const char *text, size_t length, char *err, size_t err_len){
+    uint64_t key = fnv1a(text, length);
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *entry = cache_find_locked(cache, key, text, length);
+    if (entry != NULL){
+        cache->hits++;
+        lru_unlink(cache, entry);
+        lru_push_front(cache, entry);
+        entry->refs++;
+        pthread_mutex_unlock(&cache->lock);
+        return entry;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+
+    // compile outside the lock, other requests keep being served meanwhile
+    Formula *formula = compile_source(text, length, err, err_len);
+    if (formula == NULL){
+        return NULL;
+    }
+
+    entry = malloc(sizeof(CacheEntry));
+    char *copy = malloc(length + 1);
+    if (entry == NULL || copy == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    entry->key = key;
+    entry->text = copy;
+    entry->length = length;
+    entry->formula = formula;
+    entry->refs = 2;  // the cache and the caller
+
+    pthread_mutex_lock(&cache->lock);
+    CacheEntry *raced = cache_find_locked(cache, key, text, length);
+    if (raced != NULL){
+        // another request compiled the same text meanwhile, keep theirs
+        raced->refs++;
+        pthread_mutex_unlock(&cache->lock);
+        free_entry(entry);
+        return raced;
+    }
+    entry->chain = cache->buckets[key % cache->num_buckets];
+    cache->buckets[key % cache->num_buckets] = entry;
+    lru_push_front(cache, entry);
+    cache->count++;
+    if (cache->count > cache->capacity){
+        cache_evict_locked(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+static void cache_free(Cache *cache){
+    while (cache->count > 0){
+        cache_evict_locked(cache);
+    }
+    free(cache->buckets);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+/* QUERIES */
+
+// Answers query against the formula text, the reply is a malloc'ed buffer
+static int answer(Cache *cache, char *query, const char *text, size_t length, char **reply, size_t *reply_len){
+    char err[256];
+    FILE *out = open_memstream(reply, reply_len);
+    if (out == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    CacheEntry *entry = cache_acquire(cache, text, length, err, sizeof(err));
+    if (entry == NULL){
+        fputs(err, out);
+        fclose(out);
+        return 0;
+    }
+    const Formula *formula = entry->formula;
+
+    char *save_ptr = NULL;
+    char *kind = strtok_r(query, " ", &save_ptr);
+    int ok = 1;
+
+    if (kind == NULL || strcmp(kind, "run") == 0){
+        for (size_t i = 0; i < formula->num_statements; i++){
+            run_statement(formula, &formula->statements[i], out);
+        }
+    }
+    else if (strcmp(kind, "show") == 0 || strcmp(kind, "show_ones") == 0 ||
+             strcmp(kind, "count") == 0 || strcmp(kind, "rows") == 0 ||
+             strcmp(kind, "check") == 0 || strcmp(kind, "equiv") == 0){
+        unsigned long start = 0, count = 0;
+        if (strcmp(kind, "rows") == 0){
+            char *first = strtok_r(NULL, " ", &save_ptr);
+            char *number = strtok_r(NULL, " ", &save_ptr);
+            if (first == NULL || number == NULL){
+                fputs("rows expects a start row and a row count", out);
+                ok = 0;
+            }
+            else {
+                start = strtoul(first, NULL, 10);
+                count = strtoul(number, NULL, 10);
+            }
+        }
+
+        char **names = calloc(1, sizeof(char *));
+        char *name;
+        while (ok && (name = strtok_r(NULL, " ", &save_ptr)) != NULL){
+            names = add(names, name);
+        }
+
+        Statement stmt;
+        size_t unknown;
+        StatementKind stmt_kind = strcmp(kind, "show_ones") == 0 ? STMT_SHOW_ONES :
+                                  strcmp(kind, "check") == 0 ? STMT_CHECK :
+                                  strcmp(kind, "equiv") == 0 ? STMT_EQUIV : STMT_SHOW;
+        int is_query = stmt_kind == STMT_CHECK || stmt_kind == STMT_EQUIV;
+        if (ok && ((stmt_kind == STMT_CHECK && len_array(names) == 0) ||
+                   (stmt_kind == STMT_EQUIV && len_array(names) != 2))){
+            fputs(stmt_kind == STMT_CHECK ? "check expects at least one identifier" :
+                                            "equiv expects exactly two identifiers", out);
+            ok = 0;
+        }
+        else if (ok && !resolve_outputs(formula, &stmt, stmt_kind, names, &unknown)){
+            fprintf(out, "Undeclared variable %s", names[unknown]);
+            ok = 0;
+        }
+        else if (ok && !is_query && formula->num_vars >= 64){
+            fputs("Cannot enumerate the rows of 64 variables", out);
+            free_statement(&stmt);
+            ok = 0;
+        }
+        else if (ok){
+            if (strcmp(kind, "count") == 0){
+                fprintf(out, "%lu\n", count_ones(formula, &stmt, NULL));
+            }
+            else if (strcmp(kind, "rows") == 0){
+                print_header(&stmt, formula->variables, out);
+                show_rows(formula, &stmt, start, count, out);
+            }
+            else {
+                run_statement(formula, &stmt, out);
+            }
+            free_statement(&stmt);
+        }
+        free_array(names, len_array(names));
+    }
+    else {
+        fprintf(out, "Unknown query %s", kind);
+        ok = 0;
+    }
+
+    release(cache, entry);
+    fclose(out);
+    return ok;
+}
+
+/* FRAMING */
+
+// Buffered reader over a file descriptor
+typedef struct {
+    int fd;
+    char data[65536];
+    size_t start;
+    size_t end;
+} Reader;
+
+static int fill(Reader *reader){
+    if (reader->start > 0){
+        memmove(reader->data, reader->data + reader->start, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+    }
+    ssize_t n;
+    do {
+        n = read(reader->fd, reader->data + reader->end, sizeof(reader->data) - reader->end);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0){
+        return 0;
+    }
+    reader->end += n;
+    return 1;
+}
+
+// Reads a line without its newline into line, returns 0 on end of input or overlong lines
+static int read_line(Reader *reader, char *line, size_t size){
+    for (;;){
+        char *newline = memchr(reader->data + reader->start, '\n', reader->end - reader->start);
+        if (newline != NULL){
+            size_t length = newline - (reader->data + reader->start);
+            if (length >= size){
+                return 0;
+            }
+            memcpy(line, reader->data + reader->start, length);
+            line[length] = '\0';
+            reader->start += length + 1;
+            return 1;
+        }
+        if (reader->end - reader->start >= size || !fill(reader)){
+            return 0;
+        }
+    }
+}
+
+static int read_exact(Reader *reader, char *buffer, size_t length){
+    size_t done = 0;
+    while (done < length){
+        if (reader->start == reader->end && !fill(reader)){
+            return 0;
+        }
+        size_t chunk = reader->end - reader->start;
+        if (chunk > length - done){
+            chunk = length - done;
+        }
+        memcpy(buffer + done, reader->data + reader->start, chunk);
+        reader->start += chunk;
+        done += chunk;
+    }
+    return 1;
+}
+
+static int write_all(int fd, const char *data, size_t length){
+    while (length > 0){
+        ssize_t n = write(fd, data, length);
+        if (n < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            return 0;
+        }
+        data += n;
+        length -= n;
+    }
+    return 1;
+}
+
+// A request split into its parts, text is not null terminated
+typedef struct {
+    char id[64];
+    char query[MAX_HEADER];
+    char *text;
+    size_t length;
+} Request;
+
+// Reads the next request, returns 0 at end of input, -1 on a malformed frame and -2 when
+// the text is longer than max_frame or cannot be allocated (request->id is then set)
+static int read_request(Reader *reader, Request *request, size_t max_frame){
+    char header[MAX_HEADER];
+    if (!read_line(reader, header, sizeof(header))){
+        return 0;
+    }
+    char *save_ptr = NULL;
+    char *id = strtok_r(header, " ", &save_ptr);
+    char *length = strtok_r(NULL, " ", &save_ptr);
+    char *query = strtok_r(NULL, "", &save_ptr);
+    if (id == NULL || length == NULL || strlen(id) >= sizeof(request->id)){
+        return -1;
+    }
+    strcpy(request->id, id);
+    snprintf(request->query, sizeof(request->query), "%s", query ? query : "run");
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(length, &end, 10);
+    if (end == length || *end != '\0' || length[0] == '-'){
+        return -1;
+    }
+    if (errno == ERANGE || value > max_frame){
+        return -2;
+    }
+    request->length = value;
+    request->text = malloc(request->length + 1);
+    if (request->text == NULL){
+        return -2;
+    }
+    if (!read_exact(reader, request->text, request->length)){
+        free(request->text);
+        return -1;
+    }
+    return 1;
+}
+
+// Answers a request and writes the framed reply, returns 0 if the peer went away
+static int handle_request(Cache *cache, Request *request, int fd, pthread_mutex_t *write_lock){
+    char *reply = NULL;
+    size_t reply_len = 0;
+    int ok = answer(cache, request->query, request->text, request->length, &reply, &reply_len);
+
+    char header[128];
+    int header_len = snprintf(header, sizeof(header), "%s %s %zu\n", request->id, ok ? "OK" : "ERR", reply_len);
+
+    if (write_lock) pthread_mutex_lock(write_lock);
+    int written = write_all(fd, header, header_len) && write_all(fd, reply, reply_len);
+    if (write_lock) pthread_mutex_unlock(write_lock);
+
+    free(reply);
+    return written;
+}
+
+// Answers a frame that is too large; the text is not read, so the stream cannot go on after it
+static void refuse_request(Request *request, int fd, size_t max_frame, pthread_mutex_t *write_lock){
+    char message[96];
+    int message_len = snprintf(message, sizeof(message), "frame longer than %zu bytes", max_frame);
+    char header[128];
+    int header_len = snprintf(header, sizeof(header), "%s ERR %d\n", request->id, message_len);
+
+    if (write_lock) pthread_mutex_lock(write_lock);
+    write_all(fd, header, header_len);
+    write_all(fd, message, message_len);
+    if (write_lock) pthread_mutex_unlock(write_lock);
+}
+
+/* THREAD POOL */
+
+// A client connection, with what was read from it but not answered yet
+typedef struct Connection {
+    Reader reader;
+    struct Connection *next;      // Connections handed back to the accept loop
+} Connection;
+
+// Either a connection with a request to answer, or a single request read from stdin
+typedef struct Job {
+    Connection *connection;
+    Request *request;
+    struct Job *next;
+} Job;
+
+typedef struct {
+    Cache cache;
+    size_t max_frame;             // Longest formula text accepted in one request
+    Job *head;
+    Job *tail;
+    Connection *returned;         // Idle connections the accept loop has not polled yet
+    int wake[2];                  // Pipe waking the accept loop when a connection is returned
+    int closing;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_mutex_t stdout_lock;
+} Server;
+
+static void push_job(Server *server, Connection *connection, Request *request){
+    Job *job = malloc(sizeof(Job));
+    if (job == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    job->connection = connection;
+    job->request = request;
+    job->next = NULL;
+
+    pthread_mutex_lock(&server->lock);
+    if (server->tail) server->tail->next = job; else server->head = job;
+    server->tail = job;
+    pthread_cond_signal(&server->ready);
+    pthread_mutex_unlock(&server->lock);
+}
+
+// Hands an idle connection back to the accept loop, to be polled until its next request arrives
+static void return_connection(Server *server, Connection *connection){
+    pthread_mutex_lock(&server->lock);
+    connection->next = server->returned;
+    server->returned = connection;
+    pthread_mutex_unlock(&server->lock);
+    char byte = 0;
+    if (write(server->wake[1], &byte, 1) < 0 && errno != EAGAIN){
+        perror("error waking the accept loop");
+    }
+}
+
+static void close_connection(Connection *connection){
+    close(connection->reader.fd);
+    free(connection);
+}
+
+// Answers the next request of a connection, closing it at its end or on a bad frame
+static void serve_connection(Server *server, Connection *connection){
+    int fd = connection->reader.fd;
+    Request request;
+    int status = read_request(&connection->reader, &request, server->max_frame);
+    if (status > 0){
+        int alive = handle_request(&server->cache, &request, fd, NULL);
+        free(request.text);
+        if (alive && connection->reader.start < connection->reader.end){
+            push_job(server, connection, NULL);  // pipelined, behind the requests already queued
+            return;
+        }
+        if (alive){
+            return_connection(server, connection);
+            return;
+        }
+    }
+    else if (status == -2){
+        refuse_request(&request, fd, server->max_frame, NULL);
+    }
+    else if (status < 0){
+        static const char malformed[] = "- ERR 15\nmalformed frame";
+        write_all(fd, malformed, sizeof(malformed) - 1);
+    }
+    close_connection(connection);
+}
+
+static void* worker(void *arg){
+    Server *server = arg;
+    for (;;){
+        pthread_mutex_lock(&server->lock);
+        while (server->head == NULL && !server->closing){
+            pthread_cond_wait(&server->ready, &server->lock);
+        }
+        Job *job = server->head;
+        if (job == NULL){
+            pthread_mutex_unlock(&server->lock);
+            break;
+        }
+        server->head = job->next;
+        if (server->head == NULL){
+            server->tail = NULL;
+        }
+        pthread_mutex_unlock(&server->lock);
+
+        if (job->request != NULL){
+            handle_request(&server->cache, job->request, STDOUT_FILENO, &server->stdout_lock);
+            free(job->request->text);
+            free(job->request);
+        }
+        else {
+            serve_connection(server, job->connection);
+        }
+        free(job);
+    }
+    return NULL;
+}
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void on_signal(int signum){
+    (void)signum;
+    stop_requested = 1;
+}
+
+// Accepts connections and polls the idle ones, queueing each once a request can be read from it
+static void accept_connections(Server *server, int listen_fd){
+    size_t capacity = 64, num_idle = 0;
+    Connection **idle = malloc(capacity * sizeof(Connection *));
+    struct pollfd *fds = malloc((capacity + 2) * sizeof(struct pollfd));
+    if (idle == NULL || fds == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    while (!stop_requested){
+        pthread_mutex_lock(&server->lock);
+        Connection *returned = server->returned;
+        server->returned = NULL;
+        pthread_mutex_unlock(&server->lock);
+        while (returned != NULL){
+            if (num_idle == capacity){
+                capacity *= 2;
+                idle = realloc(idle, capacity * sizeof(Connection *));
+                fds = realloc(fds, (capacity + 2) * sizeof(struct pollfd));
+                if (idle == NULL || fds == NULL){
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(1);
+                }
+            }
+            idle[num_idle++] = returned;
+            returned = returned->next;
+        }
+
+        fds[0].fd = listen_fd;
+        fds[1].fd = server->wake[0];
+        for (size_t i = 0; i < num_idle; i++){
+            fds[i + 2].fd = idle[i]->reader.fd;
+        }
+        for (size_t i = 0; i < num_idle + 2; i++){
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (poll(fds, num_idle + 2, -1) < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+
+        if (fds[1].revents != 0){
+            char bytes[64];
+            while (read(server->wake[0], bytes, sizeof(bytes)) > 0){
+            }
+        }
+        // readable or hung up, either way a worker finds out which
+        size_t kept = 0;
+        for (size_t i = 0; i < num_idle; i++){
+            if (fds[i + 2].revents != 0){
+                push_job(server, idle[i], NULL);
+            }
+            else {
+                idle[kept++] = idle[i];
+            }
+        }
+        num_idle = kept;
+
+        if (fds[0].revents != 0){
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd < 0){
+                if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN){
+                    continue;
+                }
+                perror("accept");
+                break;
+            }
+            Connection *connection = malloc(sizeof(Connection));
+            if (connection == NULL){
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            connection->reader.fd = fd;
+            connection->reader.start = connection->reader.end = 0;
+            return_connection(server, connection);  // polled like the others until it sends a request
+        }
+    }
+
+    for (size_t i = 0; i < num_idle; i++){
+        close_connection(idle[i]);
+    }
+    free(fds);
+    free(idle);
+}
+
+int serve(const char *socket_path, size_t num_threads, size_t cache_size, size_t max_frame){
+    Server server;
+    cache_init(&server.cache, cache_size);
+    server.max_frame = max_frame;
+    server.head = server.tail = NULL;
+    server.returned = NULL;
+    server.closing = 0;
+    if (pipe(server.wake) != 0 || fcntl(server.wake[0], F_SETFL, O_NONBLOCK) != 0 ||
+        fcntl(server.wake[1], F_SETFL, O_NONBLOCK) != 0){
+        perror("error creating pipe");
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.ready, NULL);
+    pthread_mutex_init(&server.stdout_lock, NULL);
+
+    // a client disappearing must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = -1;
+    if (socket_path != NULL){
+        struct sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (strlen(socket_path) >= sizeof(address.sun_path)){
+            fprintf(stderr, "Socket path %s is too long\n", socket_path);
+            return EXIT_FAILURE;
+        }
+        strcpy(address.sun_path, socket_path);
+        unlink(socket_path);
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+            listen(listen_fd, 128) < 0){
+            perror("error opening socket");
+            return EXIT_FAILURE;
+        }
+
+        // no SA_RESTART, so accept() returns when asked to stop
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = on_signal;
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+    }
+
+    pthread_t *workers = malloc(num_threads * sizeof(pthread_t));
+    if (workers == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < num_threads; i++){
+        pthread_create(&workers[i], NULL, worker, &server);
+    }
+
+    if (socket_path != NULL){
+        accept_connections(&server, listen_fd);
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    else {
+        // framed requests on stdin, replies are tagged with the request id and may come out of order
+        Reader *reader = malloc(sizeof(Reader));
+        if (reader == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        reader->fd = STDIN_FILENO;
+        reader->start = reader->end = 0;
+        for (;;){
+            Request *request = malloc(sizeof(Request));
+            if (request == NULL){
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            int status = read_request(reader, request, max_frame);
+            if (status <= 0){
+                if (status == -2){
+                    // the requests already queued are still answered
+                    refuse_request(request, STDOUT_FILENO, max_frame, &server.stdout_lock);
+                    fprintf(stderr, "frame too large on stdin\n");
+                }
+                free(request);
+                if (status == -1){
+                    fprintf(stderr, "malformed frame on stdin\n");
+                }
+                break;
+            }
+            push_job(&server, NULL, request);
+        }
+        free(reader);
+    }
+
+    pthread_mutex_lock(&server.lock);
+    server.closing = 1;
+    pthread_cond_broadcast(&server.ready);
+    pthread_mutex_unlock(&server.lock);
+    for (size_t i = 0; i < num_threads; i++){
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
+    while (server.returned != NULL){
+        // handed back after the accept loop stopped
+        Connection *next = server.returned->next;
+        close_connection(server.returned);
+        server.returned = next;
+    }
+    close(server.wake[0]);
+    close(server.wake[1]);
+
+    fprintf(stderr, "cache: %lu hits, %lu misses\n", server.cache.hits, server.cache.misses);
+    cache_free(&server.cache);
+    pthread_mutex_destroy(&server.lock);
+    pthread_cond_destroy(&server.ready);
+    pthread_mutex_destroy(&server.stdout_lock);
+    return EXIT_SUCCESS;
+}
+
+/* LOAD GENERATOR */
+
+typedef struct {
+    const char *socket_path;
+    const char *text;
+    size_t length;
+    const char *query;
+    size_t num_requests;
+    double *latencies;    // Microseconds, one per request
+    size_t errors;
+} Client;
+
+static double now_us(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void* client_thread(void *arg){
+    Client *client = arg;
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", client->socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0){
+        perror("error connecting to server");
+        client->errors = client->num_requests;
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+
+    Reader *reader = malloc(sizeof(Reader));
+    reader->fd = fd;
+    reader->start = reader->end = 0;
+    char header[MAX_HEADER];
+    char *payload = NULL;
+    size_t payload_cap = 0;
+
+    for (size_t i = 0; i < client->num_requests; i++){
+        int header_len = snprintf(header, sizeof(header), "%zu %zu %s\n", i, client->length, client->query);
+        double start = now_us();
+        if (!write_all(fd, header, header_len) || !write_all(fd, client->text, client->length) ||
+            !read_line(reader, header, sizeof(header))){
+            client->errors += client->num_requests - i;
+            break;
+        }
+        char status[16];
+        size_t reply_len = 0;
+        if (sscanf(header, "%*s %15s %zu", status, &reply_len) != 2){
+            client->errors += client->num_requests - i;
+            break;
+        }
+        if (reply_len > payload_cap){
+            payload_cap = reply_len;
+            payload = realloc(payload, payload_cap);
+        }
+        if (!read_exact(reader, payload, reply_len)){
+            client->errors += client->num_requests - i;
+            break;
+        }
+        client->latencies[i] = now_us() - start;
+        if (strcmp(status, "OK") != 0){
+            client->errors++;
+        }
+    }
+
+    free(payload);
+    free(reader);
+    close(fd);
+    return NULL;
+}
+
+static int compare_doubles(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+int bench_client(const char *socket_path, const char *input_file, size_t num_requests,
+                 size_t num_connections, const char *query){
+    size_t length;
+    char *text = read_text(input_file, &length);
+    if (text == NULL){
+        return EXIT_FAILURE;
+    }
+
+    size_t per_connection = (num_requests + num_connections - 1) / num_connections;
+    Client *clients = calloc(num_connections, sizeof(Client));
+    pthread_t *threads = malloc(num_connections * sizeof(pthread_t));
+    double *latencies = calloc(per_connection * num_connections, sizeof(double));
+    if (clients == NULL || threads == NULL || latencies == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    double start = now_us();
+    for (size_t i = 0; i < num_connections; i++){
+        clients[i].socket_path = socket_path;
+        clients[i].text = text;
+        clients[i].length = length;
+        clients[i].query = query;
+        clients[i].num_requests = per_connection;
+        clients[i].latencies = latencies + i * per_connection;
+        pthread_create(&threads[i], NULL, client_thread, &clients[i]);
+    }
+    size_t errors = 0;
+    for (size_t i = 0; i < num_connections; i++){
+        pthread_join(threads[i], NULL);
+        errors += clients[i].errors;
+    }
+    double elapsed = now_us() - start;
+
+    size_t total = per_connection * num_connections;
+    size_t measured = 0;
+    double sum = 0;
+    for (size_t i = 0; i < total; i++){
+        if (latencies[i] > 0){
+            latencies[measured++] = latencies[i];
+            sum += latencies[i];
+        }
+    }
+    qsort(latencies, measured, sizeof(double), compare_doubles);
+
+    printf("requests: %zu, connections: %zu, errors: %zu\n", total, num_connections, errors);
+    printf("elapsed: %.3f s, throughput: %.0f req/s\n", elapsed / 1e6, measured / (elapsed / 1e6));
+    if (measured > 0){
+        printf("latency us: mean %.1f, p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+               sum / measured, latencies[measured / 2], latencies[measured * 9 / 10],
+               latencies[measured * 99 / 100], latencies[measured - 1]);
+    }
+
+    free(latencies);
+    free(threads);
+    free(clients);
+    free(text);
+    return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* COMMAND LINE */
+
+int server_main(int argc, char *argv[]){
+    size_t num_threads = DEFAULT_THREADS;
+    size_t cache_size = DEFAULT_CACHE;
+    size_t max_frame = DEFAULT_MAX_FRAME;
+    size_t num_requests = 10000;
+    size_t num_connections = 4;
+    const char *socket_path = NULL;
+    const char *query = "run";
+
+    if (strcmp(argv[1], "--serve") == 0){
+        for (int i = 2; i < argc; i++){
+            if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc){
+                socket_path = argv[++i];
+            }
+            else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+                num_threads = strtoul(argv[++i], NULL, 10);
+            }
+            else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc){
+                cache_size = strtoul(argv[++i], NULL, 10);
+            }
+            else if (strcmp(argv[i], "--max-frame") == 0 && i + 1 < argc){
+                max_frame = strtoul(argv[++i], NULL, 10);
+            }
+            else {
+                fprintf(stderr, "Unknown option %s\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        return serve(socket_path, num_threads > 0 ? num_threads : 1, cache_size, max_frame);
+    }
+
+    if (argc < 4){
+        fprintf(stderr, "Usage: %s --bench-client socket_path input_file.txt [--requests n] [--connections n] [--query q]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int i = 4; i < argc; i++){
+        if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc){
+            num_requests = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc){
+            num_connections = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--query") == 0 && i + 1 < argc){
+            query = argv[++i];
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    return bench_client(argv[2], argv[3], num_requests, num_connections > 0 ? num_connections : 1, query);
+}
@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "table.h"
+
+/*
+ * Sharding of the row space across processes.
+ *
+ * "--shard i/N -o file" evaluates the i-th of N contiguous slices of the rows of every
+ * statement and writes them to a shard file: a text header describing the formula, followed
+ * by the bit-packed output columns of each statement on its slice. Slices are whole 64-row
+ * words, so shards concatenate without shifting bits.
+ *
+ *     TTSHARD 1
+ *     formula <hash>
+ *     shard <i> <N>
+ *     variables <n> <names...>
+ *     statements <count>
+ *     statement <show|show_ones> <num_vars> <first_word> <num_words> <num_outputs> <names...>
+ *     ...
+ *     end
+ *     <columns: for each statement, num_outputs * num_words little-endian 64-bit words>
+ *
+ * "merge" checks that a set of shards comes from the same formula and variable order and
+ * covers every row exactly once, then prints the tables, or writes them as a single shard
+ * 0/1 with --binary (which merge accepts again).
+ */
+
+#define SHARD_MAGIC "TTSHARD 1"
+
+typedef struct {
+    StatementKind kind;
+    size_t num_vars;
+    unsigned long first_word;
+    unsigned long num_words;
+    size_t num_outputs;
+    char **names;          // NULL terminated
+    long data_offset;      // Where the columns of the statement start in the file
+} ShardStatement;
+
+typedef struct {
+    const char *path;
+    uint64_t hash;
+    size_t index;
+    size_t count;
+    char **variables;      // NULL terminated
+    size_t num_vars;
+    ShardStatement *statements;
+    size_t num_statements;
+} ShardHeader;
+
+// First word and number of words of slice index out of count
+static void slice_words(unsigned long total_words, size_t index, size_t count,
+                        unsigned long *first, unsigned long *num_words){
+    *first = (unsigned long)((unsigned __int128)total_words * index / count);
+    *num_words = (unsigned long)((unsigned __int128)total_words * (index + 1) / count) - *first;
+}
+
+static void write_word(FILE *file, uint64_t word){
+    unsigned char bytes[8];
+    for (int b = 0; b < 8; b++){
+        bytes[b] = (unsigned char)(word >> (8 * b));
+    }
+    fwrite(bytes, 1, 8, file);
+}
+
+static int read_word(FILE *file, uint64_t *word){
+    unsigned char bytes[8];
+    if (fread(bytes, 1, 8, file) != 8){
+        return 0;
+    }
+    *word = 0;
+    for (int b = 0; b < 8; b++){
+        *word |= (uint64_t)bytes[b] << (8 * b);
+    }
+    return 1;
+}
+
+static void write_names(FILE *file, char **names, size_t count){
+    for (size_t i = 0; i < count; i++){
+        fprintf(file, " %s", names[i]);
+    }
+    fputc('\n', file);
+}
+
+int write_shard(const Formula *formula, size_t index, size_t count, const char *path){
+    for (size_t s = 0; s < formula->num_statements; s++){
+        if (is_query(&formula->statements[s])){
+            fprintf(stderr, "check, equiv and minimize statements do not enumerate rows and cannot be sharded\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL){
+        perror("error opening shard file");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(file, "%s\nformula %016" PRIx64 "\nshard %zu %zu\nvariables %zu",
+            SHARD_MAGIC, formula->hash, index, count, formula->num_vars);
+    write_names(file, formula->variables, formula->num_vars);
+    fprintf(file, "statements %zu\n", formula->num_statements);
+    for (size_t s = 0; s < formula->num_statements; s++){
+        const Statement *stmt = &formula->statements[s];
+        unsigned long first, num_words;
+        slice_words(((1UL << stmt->num_vars) + 63) / 64, index, count, &first, &num_words);
+        fprintf(file, "statement %s %zu %lu %lu %zu", stmt->kind == STMT_SHOW ? "show" : "show_ones",
+                stmt->num_vars, first, num_words, stmt->num_outputs);
+        write_names(file, stmt->names, stmt->num_outputs);
+    }
+    fprintf(file, "end\n");
+
+    uint64_t *values = alloc_values(formula);
+    for (size_t s = 0; s < formula->num_statements; s++){
+        const Statement *stmt = &formula->statements[s];
+        unsigned long rows = 1UL << stmt->num_vars;
+        unsigned long first, num_words;
+        slice_words((rows + 63) / 64, index, count, &first, &num_words);
+
+        uint64_t *columns = malloc((stmt->num_outputs * num_words + 1) * sizeof(uint64_t));
+        if (columns == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (unsigned long w = 0; w < num_words; w++){
+            unsigned long base = (first + w) * 64;
+            eval_word(formula, stmt, base, values);
+            for (size_t j = 0; j < stmt->num_outputs; j++){
+                columns[j * num_words + w] = values[stmt->outputs[j]] & valid_rows_mask(rows, base);
+            }
+        }
+        for (size_t i = 0; i < stmt->num_outputs * num_words; i++){
+            write_word(file, columns[i]);
+        }
+        free(columns);
+    }
+    free(values);
+
+    if (ferror(file) | fclose(file)){
+        perror("error writing shard file");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/* MERGE */
+
+static void free_header(ShardHeader *header){
+    free_array(header->variables, len_array(header->variables));
+    for (size_t s = 0; s < header->num_statements; s++){
+        free_array(header->statements[s].names, len_array(header->statements[s].names));
+    }
+    free(header->statements);
+}
+
+// Splits the rest of a header line into names, checking there are exactly count of them
+static char** parse_names(char *rest, size_t count){
+    char **names = calloc(1, sizeof(char *));
+    char *save_ptr = NULL;
+    char *name = strtok_r(rest, " \n", &save_ptr);
+    while (name != NULL){
+        names = add(names, name);
+        name = strtok_r(NULL, " \n", &save_ptr);
+    }
+    if (len_array(names) != count){
+        free_array(names, len_array(names));
+        return NULL;
+    }
+    return names;
+}
+
+static int read_header(FILE *file, const char *path, ShardHeader *header){
+    char *line = NULL;
+    size_t capacity = 0;
+    int offset = 0;
+    memset(header, 0, sizeof(ShardHeader));
+    header->path = path;
+
+    if (getline(&line, &capacity, file) < 0 || strncmp(line, SHARD_MAGIC "\n", strlen(SHARD_MAGIC) + 1) != 0 ||
+        getline(&line, &capacity, file) < 0 || sscanf(line, "formula %" SCNx64, &header->hash) != 1 ||
+        getline(&line, &capacity, file) < 0 || sscanf(line, "shard %zu %zu", &header->index, &header->count) != 2 ||
+        getline(&line, &capacity, file) < 0 || sscanf(line, "variables %zu%n", &header->num_vars, &offset) != 1 ||
+        (header->variables = parse_names(line + offset, header->num_vars)) == NULL ||
+        getline(&line, &capacity, file) < 0 || sscanf(line, "statements %zu", &header->num_statements) != 1){
+        fprintf(stderr, "%s: not a shard file\n", path);
+        free(line);
+        return 0;
+    }
+
+    header->statements = calloc(header->num_statements + 1, sizeof(ShardStatement));
+    for (size_t s = 0; s < header->num_statements; s++){
+        ShardStatement *stmt = &header->statements[s];
+        char kind[16];
+        if (getline(&line, &capacity, file) < 0 ||
+            sscanf(line, "statement %15s %zu %lu %lu %zu%n", kind, &stmt->num_vars, &stmt->first_word,
+                   &stmt->num_words, &stmt->num_outputs, &offset) != 5 ||
+            (stmt->names = parse_names(line + offset, stmt->num_outputs)) == NULL ||
+            stmt->num_vars > header->num_vars || stmt->num_vars >= 64){
+            fprintf(stderr, "%s: malformed statement %zu\n", path, s);
+            free(line);
+            return 0;
+        }
+        stmt->kind = strcmp(kind, "show") == 0 ? STMT_SHOW : STMT_SHOW_ONES;
+    }
+    if (getline(&line, &capacity, file) < 0 || strcmp(line, "end\n") != 0){
+        fprintf(stderr, "%s: missing end of header\n", path);
+        free(line);
+        return 0;
+    }
+    free(line);
+
+    long position = ftell(file);
+    for (size_t s = 0; s < header->num_statements; s++){
+        header->statements[s].data_offset = position;
+        position += (long)(header->statements[s].num_outputs * header->statements[s].num_words * 8);
+    }
+    // checked before anything is printed, rather than when the columns run out
+    if (fseek(file, 0, SEEK_END) != 0 || ftell(file) < position){
+        fprintf(stderr, "%s: truncated shard\n", path);
+        return 0;
+    }
+    return 1;
+}
+
+// Checks that shard b describes the same formula as shard a
+static int consistent(const ShardHeader *a, const ShardHeader *b){
+    if (a->hash != b->hash || a->count != b->count || a->num_vars != b->num_vars ||
+        a->num_statements != b->num_statements){
+        fprintf(stderr, "%s and %s come from different formulas or shard counts\n", a->path, b->path);
+        return 0;
+    }
+    for (size_t i = 0; i < a->num_vars; i++){
+        if (strcmp(a->variables[i], b->variables[i]) != 0){
+            fprintf(stderr, "%s and %s have a different variable order\n", a->path, b->path);
+            return 0;
+        }
+    }
+    for (size_t s = 0; s < a->num_statements; s++){
+        const ShardStatement *x = &a->statements[s], *y = &b->statements[s];
+        int same = x->kind == y->kind && x->num_vars == y->num_vars && x->num_outputs == y->num_outputs;
+        for (size_t j = 0; same && j < x->num_outputs; j++){
+            same = strcmp(x->names[j], y->names[j]) == 0;
+        }
+        if (!same){
+            fprintf(stderr, "%s and %s differ in statement %zu\n", a->path, b->path, s);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void merge_usage(const char *program){
+    fprintf(stderr, "Usage: %s merge [--binary] [-o output] shard_file...\n", program);
+}
+
+int merge_main(int argc, char *argv[]){
+    const char *output = NULL;
+    int binary = 0;
+    int first_shard = 2;
+    while (first_shard < argc && argv[first_shard][0] == '-'){
+        if (strcmp(argv[first_shard], "--binary") == 0){
+            binary = 1;
+            first_shard++;
+        }
+        else if (strcmp(argv[first_shard], "-o") == 0 && first_shard + 1 < argc){
+            output = argv[first_shard + 1];
+            first_shard += 2;
+        }
+        else {
+            merge_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    size_t num_files = argc - first_shard;
+    if (num_files == 0 || (binary && output == NULL)){
+        merge_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // read every header, ordering the shards by index
+    FILE **files = calloc(num_files, sizeof(FILE *));
+    ShardHeader *headers = calloc(num_files, sizeof(ShardHeader));
+    ShardHeader **by_index = NULL;
+    int ok = 1;
+    for (size_t f = 0; ok && f < num_files; f++){
+        files[f] = fopen(argv[first_shard + f], "rb");
+        if (files[f] == NULL){
+            perror(argv[first_shard + f]);
+            ok = 0;
+        }
+        else {
+            ok = read_header(files[f], argv[first_shard + f], &headers[f]);
+        }
+    }
+    if (ok && headers[0].count != num_files){
+        fprintf(stderr, "expected %zu shards, got %zu\n", headers[0].count, num_files);
+        ok = 0;
+    }
+    if (ok){
+        by_index = calloc(num_files, sizeof(ShardHeader *));
+        for (size_t f = 0; ok && f < num_files; f++){
+            ok = consistent(&headers[0], &headers[f]);
+            if (ok && (headers[f].index >= num_files || by_index[headers[f].index] != NULL)){
+                fprintf(stderr, "%s: duplicate or invalid shard index %zu\n", headers[f].path, headers[f].index);
+                ok = 0;
+            }
+            else if (ok){
+                by_index[headers[f].index] = &headers[f];
+            }
+        }
+    }
+    // the slices of every statement must follow each other and cover the whole table
+    for (size_t s = 0; ok && s < headers[0].num_statements; s++){
+        unsigned long next = 0;
+        for (size_t i = 0; ok && i < num_files; i++){
+            const ShardStatement *stmt = &by_index[i]->statements[s];
+            if (stmt->first_word != next){
+                fprintf(stderr, "%s: statement %zu does not continue the previous shard\n", by_index[i]->path, s);
+                ok = 0;
+            }
+            next += stmt->num_words;
+        }
+        if (ok && next != ((1UL << headers[0].statements[s].num_vars) + 63) / 64){
+            fprintf(stderr, "statement %zu is incomplete\n", s);
+            ok = 0;
+        }
+    }
+
+    FILE *out = stdout;
+    if (ok && output != NULL){
+        out = fopen(output, binary ? "wb" : "w");
+        if (out == NULL){
+            perror("error opening output file");
+            ok = 0;
+        }
+    }
+
+    if (ok && binary){
+        const ShardHeader *h = &headers[0];
+        fprintf(out, "%s\nformula %016" PRIx64 "\nshard 0 1\nvariables %zu", SHARD_MAGIC, h->hash, h->num_vars);
+        write_names(out, h->variables, h->num_vars);
+        fprintf(out, "statements %zu\n", h->num_statements);
+        for (size_t s = 0; s < h->num_statements; s++){
+            const ShardStatement *stmt = &h->statements[s];
+            fprintf(out, "statement %s %zu 0 %lu %zu", stmt->kind == STMT_SHOW ? "show" : "show_ones",
+                    stmt->num_vars, ((1UL << stmt->num_vars) + 63) / 64, stmt->num_outputs);
+            write_names(out, stmt->names, stmt->num_outputs);
+        }
+        fprintf(out, "end\n");
+    }
+
+    for (size_t s = 0; ok && s < headers[0].num_statements; s++){
+        const ShardStatement *info = &headers[0].statements[s];
+        unsigned long rows = 1UL << info->num_vars;
+
+        // formatting view of the statement: output j is value j
+        Statement view;
+        memset(&view, 0, sizeof(view));
+        view.kind = info->kind;
+        view.num_vars = info->num_vars;
+        view.num_outputs = info->num_outputs;
+        view.names = info->names;
+        view.outputs = malloc((info->num_outputs + 1) * sizeof(unsigned int));
+        for (size_t j = 0; j < info->num_outputs; j++){
+            view.outputs[j] = j;
+        }
+        uint64_t *values = calloc(info->num_outputs + 1, sizeof(uint64_t));
+        OutputBuffer *buffer = NULL;
+        if (!binary){
+            print_header(&view, headers[0].variables, out);
+            buffer = create_output_buffer(out);
+        }
+
+        for (size_t i = 0; ok && !binary && i < num_files; i++){
+            const ShardStatement *stmt = &by_index[i]->statements[s];
+            FILE *file = files[by_index[i] - headers];
+            uint64_t *columns = malloc((stmt->num_outputs * stmt->num_words + 1) * sizeof(uint64_t));
+            fseek(file, stmt->data_offset, SEEK_SET);
+            for (size_t k = 0; ok && k < stmt->num_outputs * stmt->num_words; k++){
+                if (!read_word(file, &columns[k])){
+                    fprintf(stderr, "%s: truncated shard\n", by_index[i]->path);
+                    ok = 0;
+                }
+            }
+            for (unsigned long w = 0; ok && w < stmt->num_words; w++){
+                unsigned long base = (stmt->first_word + w) * 64;
+                uint64_t ones = 0;
+                for (size_t j = 0; j < stmt->num_outputs; j++){
+                    values[j] = columns[j * stmt->num_words + w];
+                    ones |= values[j];
+                }
+                uint64_t selected = valid_rows_mask(rows, base);
+                if (info->kind == STMT_SHOW_ONES){
+                    selected &= ones;
+                }
+                while (selected != 0){
+                    unsigned int bit = __builtin_ctzll(selected);
+                    emit_row(buffer, &view, base + bit, values, bit);
+                    selected &= selected - 1;
+                }
+            }
+            free(columns);
+        }
+
+        if (ok && binary){
+            // output-major layout: column j of every shard in index order
+            for (size_t j = 0; ok && j < info->num_outputs; j++){
+                for (size_t i = 0; ok && i < num_files; i++){
+                    const ShardStatement *stmt = &by_index[i]->statements[s];
+                    FILE *file = files[by_index[i] - headers];
+                    fseek(file, stmt->data_offset + (long)(j * stmt->num_words * 8), SEEK_SET);
+                    for (unsigned long w = 0; ok && w < stmt->num_words; w++){
+                        uint64_t word = 0;
+                        if (!read_word(file, &word)){
+                            fprintf(stderr, "%s: truncated shard\n", by_index[i]->path);
+                            ok = 0;
+                        }
+                        write_word(out, word);
+                    }
+                }
+            }
+        }
+
+        if (buffer != NULL){
+            flush_output(buffer);
+            free(buffer);
+        }
+        free(values);
+        free(view.outputs);
+    }
+
+    if (out != stdout && out != NULL && fclose(out) != 0){
+        perror("error writing output file");
+        ok = 0;
+    }
+    for (size_t f = 0; f < num_files; f++){
+        if (files[f] != NULL){
+            fclose(files[f]);
+        }
+        free_header(&headers[f]);
+    }
+    free(by_index);
+    free(headers);
+    free(files);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
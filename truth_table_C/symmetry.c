@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "table.h"
+
+/*
+ * Classes of totally symmetric variables, and counting and printing over their weights.
+ *
+ * Two variables x and y are symmetric when swapping them leaves every output unchanged, that is
+ * when the cofactors f(x=0, y=1) and f(x=1, y=0) are the same function. Symmetry is an
+ * equivalence relation, so each variable is only compared with the first variable of every
+ * class found before it. A comparison runs the cone on a few words of random rows with and
+ * without the two inputs swapped, which refutes almost every pair at once, then builds the two
+ * cofactors into a scratch formula. Structural hashing and constant folding often make them the
+ * same instructions; otherwise the SAT solver of check statements gets a short time to show
+ * that their miter is never true, within a budget for the whole search set by the caller. A
+ * pair it cannot settle in time is left apart, so a class is never wrong, only sometimes
+ * smaller than it could be. The declared variables the outputs do
+ * not depend on form one class.
+ *
+ * The outputs only depend on how many variables of each class are 1, so a class of k variables
+ * takes k + 1 evaluations instead of 2^k: the table is evaluated on one representative row per
+ * assignment of class weights (a point), with the first variables of each class set. Counting
+ * weighs every point by the rows it stands for, a product of binomials. Printing goes through
+ * the pipeline, which looks the outputs of each word up where it would evaluate them: the index
+ * of a point is linear in the class weights, so the index of a row is that of its word plus
+ * that of its low 6 bits, and a lookup costs a few operations per row. show_ones only looks up
+ * the words below a true point. Fixing the first d variables of a row bounds the weight of every
+ * class between the members set among them and that plus its members left, so for each depth a
+ * bitset over the points says whether a point within those bounds is true, built from the one
+ * of the next depth by also looking one more member of the class of variable d up. The rows are
+ * walked as the tree of their variables, and a subtree of rows whose node reaches no true point
+ * is skipped whole. The columns and the reach tables take a word per 64 points and output or
+ * depth, so only classes that cut the table to a quarter or less, within a memory cap, are
+ * evaluated; the other statements are evaluated row by row.
+ */
+
+#define SYMMETRY_SAMPLE_WORDS 4     // Words of random rows a pair is simulated on
+#define SYMMETRY_SOLVE_SECONDS 0.05 // Time the solver gets to prove a pair symmetric
+
+typedef struct {
+    const Formula *formula;
+    const Statement *stmt;
+    uint64_t *inputs;       // SYMMETRY_SAMPLE_WORDS words of random rows of each variable
+    uint64_t *expected;     // Outputs on them, SYMMETRY_SAMPLE_WORDS words per output
+    uint64_t *values;
+    Formula *scratch;       // Cofactors built by the comparisons
+    unsigned int *map;      // Instruction of the scratch formula standing for each one of the cone
+    unsigned int *cofactor; // Outputs of the first cofactor of a pair
+    double deadline;        // The solver is not called past it
+} Comparison;
+
+// eval_word on given words of the inputs rather than on consecutive rows
+static void eval_inputs(const Formula *formula, const Statement *stmt, const uint64_t *inputs, uint64_t *values){
+    const Instr *code = formula->code;
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &code[i];
+        switch (in->op){
+            case OP_CONST:
+                values[i] = in->a ? ~0ULL : 0;
+                break;
+            case OP_INPUT:
+                values[i] = inputs[in->a];
+                break;
+            case OP_NOT:
+                values[i] = ~values[in->a];
+                break;
+            case OP_AND:
+                values[i] = values[in->a] & values[in->b];
+                break;
+            case OP_OR:
+                values[i] = values[in->a] | values[in->b];
+                break;
+        }
+    }
+}
+
+// Builds the cofactor of the outputs with x and y set to the given values into the scratch formula
+static void build_pair_cofactor(Comparison *cmp, size_t x, int x_value, size_t y, int y_value, unsigned int *outputs){
+    const Statement *stmt = cmp->stmt;
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &cmp->formula->code[i];
+        switch (in->op){
+            case OP_CONST:
+                cmp->map[i] = emit_instr(cmp->scratch, OP_CONST, in->a, 0);
+                break;
+            case OP_INPUT:
+                if (in->a == x || in->a == y){
+                    cmp->map[i] = emit_instr(cmp->scratch, OP_CONST, in->a == x ? x_value : y_value, 0);
+                }
+                else {
+                    cmp->map[i] = emit_instr(cmp->scratch, OP_INPUT, in->a, 0);
+                }
+                break;
+            case OP_NOT:
+                cmp->map[i] = emit_instr(cmp->scratch, OP_NOT, cmp->map[in->a], 0);
+                break;
+            default:
+                cmp->map[i] = emit_instr(cmp->scratch, in->op, cmp->map[in->a], cmp->map[in->b]);
+                break;
+        }
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        outputs[j] = cmp->map[stmt->outputs[j]];
+    }
+}
+
+// 1 when swapping x and y is proven to leave every output unchanged
+static int symmetric_pair(Comparison *cmp, size_t x, size_t y){
+    const Statement *stmt = cmp->stmt;
+    size_t num_vars = stmt->num_vars;
+    int same = 1;
+    for (size_t w = 0; w < SYMMETRY_SAMPLE_WORDS && same; w++){
+        uint64_t *inputs = cmp->inputs + w * num_vars;
+        uint64_t tmp = inputs[x];
+        inputs[x] = inputs[y];
+        inputs[y] = tmp;
+        eval_inputs(cmp->formula, stmt, inputs, cmp->values);
+        inputs[y] = inputs[x];
+        inputs[x] = tmp;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            if (cmp->values[stmt->outputs[j]] != cmp->expected[j * SYMMETRY_SAMPLE_WORDS + w]){
+                same = 0;
+                break;
+            }
+        }
+    }
+    if (!same){
+        return 0;
+    }
+
+    // the miter of the two cofactors: any output where they differ
+    unsigned int *swapped = cmp->cofactor + stmt->num_outputs;
+    build_pair_cofactor(cmp, x, 0, y, 1, cmp->cofactor);
+    build_pair_cofactor(cmp, x, 1, y, 0, swapped);
+    Formula *scratch = cmp->scratch;
+    unsigned int miter = emit_instr(scratch, OP_CONST, 0, 0);
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        unsigned int a = cmp->cofactor[j], b = swapped[j];
+        unsigned int differ = emit_instr(scratch, OP_OR,
+                                         emit_instr(scratch, OP_AND, a, emit_instr(scratch, OP_NOT, b, 0)),
+                                         emit_instr(scratch, OP_AND, emit_instr(scratch, OP_NOT, a, 0), b));
+        miter = emit_instr(scratch, OP_OR, miter, differ);
+    }
+    if (scratch->code[miter].op == OP_CONST){
+        return !scratch->code[miter].a;  // the same instructions, or folded to constants
+    }
+
+    double now = now_seconds();
+    if (now >= cmp->deadline){
+        return 0;
+    }
+    Statement check;
+    memset(&check, 0, sizeof(Statement));
+    check.kind = STMT_CHECK;
+    check.num_vars = num_vars;
+    check.num_outputs = 1;
+    check.outputs = &miter;
+    compute_cone(scratch, &check);
+    double deadline = now + SYMMETRY_SOLVE_SECONDS < cmp->deadline ? now + SYMMETRY_SOLVE_SECONDS : cmp->deadline;
+    int found = check_satisfiable(scratch, &check, deadline);
+    free(check.cone);
+    return found == 0;
+}
+
+// Groups the variables of the statement into classes, the solver running for at most budget seconds in all
+void find_symmetry(const Formula *formula, const Statement *stmt, double budget, Symmetry *symmetry){
+    size_t num_vars = stmt->num_vars;
+    memset(symmetry, 0, sizeof(Symmetry));
+    size_t *class_of = malloc((num_vars + 1) * sizeof(size_t));  // First variable of the class of each one
+    unsigned char *in_support = calloc(num_vars + 1, 1);
+    size_t *heads = malloc((num_vars + 1) * sizeof(size_t));
+    if (class_of == NULL || in_support == NULL || heads == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        const Instr *in = &formula->code[stmt->cone[k]];
+        if (in->op == OP_INPUT){
+            in_support[in->a] = 1;
+        }
+    }
+
+    Comparison cmp;
+    memset(&cmp, 0, sizeof(cmp));
+    cmp.formula = formula;
+    cmp.stmt = stmt;
+    cmp.inputs = malloc((SYMMETRY_SAMPLE_WORDS * num_vars + 1) * sizeof(uint64_t));
+    cmp.expected = malloc((SYMMETRY_SAMPLE_WORDS * stmt->num_outputs + 1) * sizeof(uint64_t));
+    cmp.map = malloc((formula->size + 1) * sizeof(unsigned int));
+    cmp.cofactor = malloc((2 * stmt->num_outputs + 1) * sizeof(unsigned int));
+    if (cmp.inputs == NULL || cmp.expected == NULL || cmp.map == NULL || cmp.cofactor == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    cmp.values = alloc_values(formula);
+    cmp.scratch = create_formula();
+    cmp.deadline = now_seconds() + budget;
+    for (size_t i = 0; i < SYMMETRY_SAMPLE_WORDS * num_vars; i++){
+        uint64_t mixed = (i + 1) * 0x9E3779B97F4A7C15ULL;
+        mixed = (mixed ^ (mixed >> 31)) * 0xBF58476D1CE4E5B9ULL;
+        cmp.inputs[i] = mixed ^ (mixed >> 29);
+    }
+    for (size_t w = 0; w < SYMMETRY_SAMPLE_WORDS; w++){
+        eval_inputs(formula, stmt, cmp.inputs + w * num_vars, cmp.values);
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            cmp.expected[j * SYMMETRY_SAMPLE_WORDS + w] = cmp.values[stmt->outputs[j]];
+        }
+    }
+
+    size_t num_heads = 0, unused = num_vars;
+    for (size_t v = 0; v < num_vars; v++){
+        if (!in_support[v]){
+            if (unused == num_vars){
+                unused = v;
+                heads[num_heads++] = v;
+            }
+            class_of[v] = unused;
+            continue;
+        }
+        class_of[v] = v;
+        for (size_t h = 0; h < num_heads; h++){
+            if (in_support[heads[h]] && symmetric_pair(&cmp, heads[h], v)){
+                class_of[v] = heads[h];
+                break;
+            }
+        }
+        if (class_of[v] == v){
+            heads[num_heads++] = v;
+        }
+    }
+
+    // classes in the order of their first variable, the last one varying fastest in a point
+    symmetry->num_classes = num_heads;
+    symmetry->first = malloc((num_heads + 1) * sizeof(size_t));
+    symmetry->members = malloc((num_vars + 1) * sizeof(size_t));
+    symmetry->mask = malloc((num_heads + 1) * sizeof(uint64_t));
+    symmetry->stride = malloc((num_heads + 1) * sizeof(unsigned long));
+    if (symmetry->first == NULL || symmetry->members == NULL || symmetry->mask == NULL || symmetry->stride == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    size_t next = 0;
+    for (size_t c = 0; c < num_heads; c++){
+        symmetry->first[c] = next;
+        symmetry->mask[c] = 0;
+        for (size_t v = heads[c]; v < num_vars; v++){
+            if (class_of[v] == heads[c]){
+                symmetry->members[next++] = v;
+                symmetry->mask[c] |= 1ULL << (num_vars - 1 - v);
+            }
+        }
+    }
+    symmetry->first[num_heads] = next;
+    symmetry->points = 1;
+    for (size_t c = num_heads; c-- > 0; ){
+        symmetry->stride[c] = symmetry->points;
+        symmetry->points *= symmetry->first[c + 1] - symmetry->first[c] + 1;
+    }
+
+    free_formula(cmp.scratch);
+    free(cmp.values);
+    free(cmp.cofactor);
+    free(cmp.map);
+    free(cmp.expected);
+    free(cmp.inputs);
+    free(heads);
+    free(in_support);
+    free(class_of);
+}
+
+void free_symmetry(Symmetry *symmetry){
+    free(symmetry->first);
+    free(symmetry->members);
+    free(symmetry->mask);
+    free(symmetry->stride);
+    free(symmetry->bits);
+    free(symmetry->reach);
+}
+
+// Index of the point of a row
+static unsigned long point_of_row(const Symmetry *symmetry, unsigned long row){
+    unsigned long point = 0;
+    for (size_t c = 0; c < symmetry->num_classes; c++){
+        point += symmetry->stride[c] * __builtin_popcountll(row & symmetry->mask[c]);
+    }
+    return point;
+}
+
+// Whether the points are worth evaluating instead of the rows: a quarter of the rows at most, and
+// the columns and reach tables of evaluate_symmetry within MAX_SYMMETRY_BYTES
+int symmetry_pays(const Statement *stmt, const Symmetry *symmetry){
+    unsigned long rows = 1UL << stmt->num_vars;
+    if (symmetry->num_classes == 0 || symmetry->points > rows / 4){
+        return 0;
+    }
+    unsigned long point_words = (symmetry->points + 63) / 64;
+    size_t columns = stmt->num_vars + 1 + stmt->num_outputs;
+    return point_words <= MAX_SYMMETRY_BYTES / sizeof(uint64_t) / columns;
+}
+
+// Evaluates the outputs on every point, one column of bits per output
+void evaluate_symmetry(const Formula *formula, const Statement *stmt, Symmetry *symmetry){
+    size_t num_vars = stmt->num_vars;
+    unsigned long point_words = (symmetry->points + 63) / 64;
+    symmetry->bits = malloc((stmt->num_outputs * point_words + 1) * sizeof(uint64_t));
+    uint64_t *inputs = malloc((num_vars + 1) * sizeof(uint64_t));
+    if (symmetry->bits == NULL || inputs == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    uint64_t *values = alloc_values(formula);
+
+    for (unsigned long w = 0; w < point_words; w++){
+        memset(inputs, 0, num_vars * sizeof(uint64_t));
+        for (unsigned int bit = 0; bit < 64 && w * 64 + bit < symmetry->points; bit++){
+            // the representative row sets the first variables of every class, as many as its weight
+            unsigned long point = w * 64 + bit;
+            for (size_t c = 0; c < symmetry->num_classes; c++){
+                size_t weight = point / symmetry->stride[c];
+                point %= symmetry->stride[c];
+                for (size_t m = 0; m < weight; m++){
+                    inputs[symmetry->members[symmetry->first[c] + m]] |= 1ULL << bit;
+                }
+            }
+        }
+        eval_inputs(formula, stmt, inputs, values);
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            symmetry->bits[j * point_words + w] = values[stmt->outputs[j]];
+        }
+    }
+    for (unsigned int bit = 0; bit < 64; bit++){
+        symmetry->low_point[bit] = point_of_row(symmetry, bit);
+    }
+
+    // reach at depth num_vars: the points where an output is true
+    symmetry->reach = calloc((num_vars + 1) * point_words + 1, sizeof(uint64_t));
+    if (symmetry->reach == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    uint64_t *last = symmetry->reach + num_vars * point_words;
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        for (unsigned long w = 0; w < point_words; w++){
+            last[w] |= symmetry->bits[j * point_words + w];
+        }
+    }
+    // depth d from depth d + 1: the variable d may be set, one more member of its class
+    for (size_t d = num_vars; d-- > 0; ){
+        const uint64_t *below = symmetry->reach + (d + 1) * point_words;
+        uint64_t *reach = symmetry->reach + d * point_words;
+        size_t c = 0;
+        while (!(symmetry->mask[c] & (1ULL << (num_vars - 1 - d)))){
+            c++;
+        }
+        unsigned long stride = symmetry->stride[c];
+        size_t size = symmetry->first[c + 1] - symmetry->first[c];
+        for (unsigned long point = 0; point < symmetry->points; point++){
+            int set = (below[point / 64] >> (point % 64)) & 1;
+            if (!set && (point / stride) % (size + 1) < size){
+                unsigned long more = point + stride;
+                set = (below[more / 64] >> (more % 64)) & 1;
+            }
+            reach[point / 64] |= (uint64_t)set << (point % 64);
+        }
+    }
+
+    free(values);
+    free(inputs);
+}
+
+// First word at or after row base, and before row end, whose rows may make an output true
+unsigned long next_true_word(const Statement *stmt, const Symmetry *symmetry, unsigned long base, unsigned long end){
+    size_t num_vars = stmt->num_vars;
+    unsigned long point_words = (symmetry->points + 63) / 64;
+    unsigned long row = base & ~63UL;
+    while (row < end){
+        // the largest subtree starting at row, descended while it reaches a true point
+        size_t k = row == 0 ? num_vars : (size_t)__builtin_ctzl(row);
+        if (k > num_vars){
+            k = num_vars;
+        }
+        for (;;){
+            const uint64_t *reach = symmetry->reach + (num_vars - k) * point_words;
+            unsigned long point = point_of_row(symmetry, row);
+            if (!((reach[point / 64] >> (point % 64)) & 1)){
+                row += 1UL << k;
+                break;
+            }
+            if (k <= 6){
+                return row;
+            }
+            k--;
+        }
+    }
+    return end;
+}
+
+// eval_word from the evaluated points: the outputs on rows base..base+63 are looked up
+void lookup_word(const Statement *stmt, const Symmetry *symmetry, unsigned long base, uint64_t *values){
+    unsigned long point_words = (symmetry->points + 63) / 64;
+    unsigned long base_point = point_of_row(symmetry, base);
+    uint64_t valid = valid_rows_mask(1UL << stmt->num_vars, base);
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        const uint64_t *column = symmetry->bits + j * point_words;
+        uint64_t word = 0;
+        for (uint64_t left = valid; left != 0; left &= left - 1){
+            unsigned int bit = __builtin_ctzll(left);
+            unsigned long point = base_point + symmetry->low_point[bit];
+            word |= ((column[point / 64] >> (point % 64)) & 1) << bit;
+        }
+        values[stmt->outputs[j]] = word;
+    }
+}
+
+// Rows where at least one output is true, from the evaluated points
+unsigned long count_symmetric(const Statement *stmt, const Symmetry *symmetry){
+    unsigned long point_words = (symmetry->points + 63) / 64;
+
+    // binomial[k][w]: rows of a class of k variables with w of them set
+    unsigned long binomial[64][64];
+    memset(binomial, 0, sizeof(binomial));
+    for (size_t k = 0; k < 64; k++){
+        binomial[k][0] = 1;
+        for (size_t w = 1; w <= k; w++){
+            binomial[k][w] = binomial[k - 1][w - 1] + (w < k ? binomial[k - 1][w] : 0);
+        }
+    }
+
+    unsigned long total = 0;
+    for (unsigned long point = 0; point < symmetry->points; point++){
+        int one = 0;
+        for (size_t j = 0; j < stmt->num_outputs && !one; j++){
+            one = (symmetry->bits[j * point_words + point / 64] >> (point % 64)) & 1;
+        }
+        if (!one){
+            continue;
+        }
+        unsigned long weight_rows = 1, rest = point;
+        for (size_t c = 0; c < symmetry->num_classes; c++){
+            size_t size = symmetry->first[c + 1] - symmetry->first[c];
+            weight_rows *= binomial[size][rest / symmetry->stride[c]];
+            rest %= symmetry->stride[c];
+        }
+        total += weight_rows;
+    }
+    return total;
+}
@@ -3,54 +3,10 @@
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-// Forward declaration of TreeNode
-struct TreeNode;
-
-// Entry structure definition
-typedef struct {
-    char *key;
-    struct TreeNode *node;  // Use the forward-declared TreeNode pointer
-} Entry;
-
-// Dictionary (Hash Table) structure definition
-typedef struct {
-    Entry **entries; // Array of pointers to entries
-    unsigned long size; // Size of the hash table
-    char **vars; // Added: Array to store variable names
-} Dict;
-
-// Full TreeNode definition
-typedef struct TreeNode {
-    int (*evaluate)(struct TreeNode*, Dict *assignments);  // Function pointer for evaluating the tree node
-} TreeNode;
-
-
-// Token list definition
-typedef struct {
-    char **tokens;  // Array of token strings (each token is a dynamically allocated string)
-    char **types;
-    size_t size;    // Number of tokens stored
-    size_t capacity;  // Total list space used
-} TokenList;
-
-
-//utilities for arrays
-char** add(char **array, char *new_element);
-void free_array(char **array, size_t size);
-size_t len_array(char **array);
-size_t total_arrlen(char **array);
-void free_tree(TreeNode *node);
-char** concatenate(char **arr1, char **arr2);
-
-//DICT prototypes
-
-unsigned long hash(const char *str, unsigned long size);
-Dict* initialize_dict(unsigned long size);
-void insert(Dict *assignments, const char *key, TreeNode *node);
-TreeNode* get(Dict *assignments, const char *key);
-void free_dict(Dict* assignments);
-Dict* assignment(TokenList *token_list, int *index, char **variables);
+#include "table.h"
 
 
 //ARRAY functions
@@ -105,37 +61,6 @@ char** add(char **array, char *new_element){
     return new_array;
 }
 
-char** concatenate(char **arr1, char **arr2){
-    size_t size1 = len_array(arr1);
-    size_t size2 = len_array(arr2);
-    char **result = malloc((size1 + size2) * sizeof(char*));
-    if (result == NULL){
-        fprintf(stderr, "Memory allocation failed");
-        exit(1);
-    }
-
-    //copy elements of arr1
-    for(size_t i = 0; i < size1; i++){
-        result[i] = malloc((strlen(arr1[i])+ 1) * sizeof(char));
-        if (result[i] == NULL){
-            fprintf(stderr, "Memory allocation failed");
-            exit(1);
-        }
-        strcpy(result[i], arr1[i]);
-    }
-    //copy elements of arr2
-    for(size_t j = 0; j < size1; j++){
-        result[size1 + j] = malloc((strlen(arr2[j])+ 1) * sizeof(char));
-        if (result[size1 + j] == NULL){
-            fprintf(stderr, "Memory allocation failed");
-            exit(1);
-        }
-        strcpy(result[size1 + j], arr2[j]);
-    }
-
-    return result;
-}
-
 /* ASSIGNMENT */
 
 unsigned long hash(const char *str, unsigned long size){
@@ -168,7 +93,7 @@ void insert(Dict *assignments, const char *key, TreeNode *node){
         fprintf(stderr, "Memory allocation failed");
         exit(1);
     }
-    new_entry->key = malloc(sizeof(strlen(key) + 1 )); //+1 for null terminator
+    new_entry->key = malloc(strlen(key) + 1); //+1 for null terminator
     if (new_entry->key == NULL) {
         // Handle malloc failure
         free(new_entry);
@@ -187,24 +112,51 @@ void insert(Dict *assignments, const char *key, TreeNode *node){
     }
 
     strcpy(new_entry->key, key);
-    
+
+    //linear probing on collisions, the table is sized so that it never fills up
+    while (assignments->entries[index] != NULL){
+        index = (index + 1) % assignments->size;
+    }
     assignments->entries[index] = new_entry;
 
     //assume variables were not added before
     assignments->vars = add(assignments->vars, (char*)key);
-    
-    //assume there won't be collisions, use linked lists otherwise
-    
 }
 
 TreeNode* get(Dict* assignments, const char *key){
     unsigned long index = hash(key, assignments->size);
 
-    Entry *entry = assignments->entries[index];
-    if(entry != NULL && strcmp(entry->key, key) == 0){
-        return entry->node;
+    for (unsigned long probes = 0; probes < assignments->size; probes++){
+        Entry *entry = assignments->entries[index];
+        if (entry == NULL){
+            break;
+        }
+        if (strcmp(entry->key, key) == 0){
+            return entry->node;
+        }
+        index = (index + 1) % assignments->size;
     }
-    
+
+    return NULL;
+}
+
+// Removes the node stored under key from the dictionary and hands it to the caller
+TreeNode* take(Dict* assignments, const char *key){
+    unsigned long index = hash(key, assignments->size);
+
+    for (unsigned long probes = 0; probes < assignments->size; probes++){
+        Entry *entry = assignments->entries[index];
+        if (entry == NULL){
+            break;
+        }
+        if (entry->node != NULL && strcmp(entry->key, key) == 0){
+            TreeNode *node = entry->node;
+            entry->node = NULL;  // free_dict skips it, free_tree(NULL) is a no-op
+            return node;
+        }
+        index = (index + 1) % assignments->size;
+    }
+
     return NULL;
 }
 
@@ -217,7 +169,7 @@ void free_dict(Dict *assignments){
         }
     }
     free(assignments->entries);
-    for (int i = 0; assignments->vars[i] != NULL; i++){
+    for (int i = 0; assignments->vars != NULL && assignments->vars[i] != NULL; i++){
         free(assignments->vars[i]);
     }
     free(assignments->vars);
@@ -227,11 +179,6 @@ void free_dict(Dict *assignments){
 /* ABSTRACT SYNTAX TREE */
 
 // Bool Node
-typedef struct {
-    TreeNode base;
-    int value;
-} BoolNode;
-
 int evaluate_boolean(TreeNode *node, Dict *assignments) {
     BoolNode *boolNode = (BoolNode*) node;
     return boolNode->value;   
@@ -245,11 +192,6 @@ TreeNode* create_bool(int value) {
 }
 
 // Variable Node
-typedef struct {
-    TreeNode base;
-    char *name;  // Flexible array member
-} Var;
-
 int evaluate_variable(TreeNode *node, Dict *assignments) {
     Var *varNode = (Var*) node;
     TreeNode *assigned_node = get(assignments, varNode->name);
@@ -269,11 +211,6 @@ TreeNode* create_var(char *name) {
 }
 
 // Not Node
-typedef struct {
-    TreeNode base;
-    TreeNode *child;
-} Not;
-
 int evaluate_not(TreeNode *node, Dict *assignments) {
     Not *notNode = (Not*) node;  // Cast to Not type
     return !(notNode->child->evaluate(notNode->child, assignments));
@@ -287,12 +224,6 @@ TreeNode* create_not(TreeNode *child) {
 }
 
 // Or Node
-typedef struct {
-    TreeNode base;
-    TreeNode *left;
-    TreeNode *right; 
-} Or;
-
 int evaluate_or(TreeNode *node, Dict *assignments) {
     Or *orNode = (Or*) node;  // Cast to Or type
     return orNode->left->evaluate(orNode->left, assignments) ||
@@ -308,12 +239,6 @@ TreeNode* create_or(TreeNode* left, TreeNode* right) {
 }
 
 // And Node
-typedef struct {
-    TreeNode base;
-    TreeNode *left;
-    TreeNode *right;
-} And;
-
 int evaluate_and(TreeNode *node, Dict *assignments) {
     And *andNode = (And*) node;  // Cast to And type
     return (andNode->left->evaluate(andNode->left, assignments) &&
@@ -328,51 +253,40 @@ TreeNode* create_and(TreeNode *left, TreeNode *right) {
     return (TreeNode*) node;
 }
 
+// Frees the nodes from an explicit stack, so deeply nested expressions don't exhaust the C stack
 void free_tree(TreeNode *node){
     if (node == NULL){
         return;
     }
-    if (((BoolNode*)node)->base.evaluate == evaluate_boolean) {
-        free(node);
-    } else if (((Var*)node)->base.evaluate == evaluate_variable) {
-        free(((Var*)node)->name);
-        free(node);
-    } else if (((Not*)node)->base.evaluate == evaluate_not) {
-        free_tree(((Not*)node)->child);
-        free(node);
-    } else if (((And*)node)->base.evaluate == evaluate_and ||
-               ((Or*)node)->base.evaluate == evaluate_or) {
-        free_tree(((And*)node)->left);
-        free_tree(((And*)node)->right);
+    size_t capacity = 64, count = 0;
+    TreeNode **stack = malloc(capacity * sizeof(TreeNode *));
+    if (stack == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    stack[count++] = node;
+    while (count > 0){
+        node = stack[--count];
+        if (count + 2 > capacity){
+            capacity *= 2;
+            stack = realloc(stack, capacity * sizeof(TreeNode *));
+            if (stack == NULL){
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+        }
+        if (node->evaluate == evaluate_variable) {
+            free(((Var*)node)->name);
+        } else if (node->evaluate == evaluate_not) {
+            stack[count++] = ((Not*)node)->child;
+        } else if (node->evaluate == evaluate_and || node->evaluate == evaluate_or) {
+            stack[count++] = ((And*)node)->left;
+            stack[count++] = ((And*)node)->right;
+        }
         free(node);
     }
-
+    free(stack);
 }
-/*FUNCTION PROTOTYPES*/
-
-// 1) Tokenizer
-TokenList* create_token_list(size_t initial_capacity);
-void add_token(TokenList *list, const char *token, const char *type);
-void free_token_list(TokenList *list);
-TokenList* tokenize(char *input_data);
-int is_comment_or_empty(const char *line);
-int is_keyword(const char *word);
-
-// 2) Parsing
-int startswith(char *string, char *prefix);
-
-// 2.1) Utility functions
-int belongs_to(char **array, char *element);
-char** variable_declaration(TokenList *token_list, int *index);
-TreeNode* parsing(TokenList *token_list, int *index);
-
-// 3) Show
-void show(Dict *assignments, char **variables, char **variables_to_show);
-void show_ones(Dict *assignments, char **variables, char **variables_to_show);
-
-// 4) Other
-TokenList* read_file(const char *input_file);
-
 
 /* TOKENIZATION */
 
@@ -381,18 +295,24 @@ TokenList* create_token_list(size_t initial_capacity) {
     TokenList* list = malloc(sizeof(TokenList));
     list->tokens = malloc(initial_capacity * sizeof(char *));
     list->types = malloc(initial_capacity * sizeof(char *));
+    list->lines = malloc(initial_capacity * sizeof(unsigned int));
+    list->columns = malloc(initial_capacity * sizeof(unsigned int));
     list->size = 0;
     list->capacity = initial_capacity;
     return list;
 }
 
 // Add a token to the list
-void add_token(TokenList *list, const char *token, const char *type) {
+void add_token(TokenList *list, const char *token, const char *type, unsigned int line, unsigned int column) {
     if (list->size >= list->capacity) {
         list->capacity *= 2;
         list->tokens = realloc(list->tokens, list->capacity * sizeof(char *));
         list->types = realloc(list->types, list->capacity * sizeof(char *));
+        list->lines = realloc(list->lines, list->capacity * sizeof(unsigned int));
+        list->columns = realloc(list->columns, list->capacity * sizeof(unsigned int));
     }
+    list->lines[list->size] = line;
+    list->columns[list->size] = column;
     list->tokens[list->size] = malloc((strlen(token) + 1) * sizeof(char));
     list->types[list->size] = malloc((strlen(type) + 1) * sizeof(char));
     strcpy(list->tokens[list->size], token);
@@ -408,12 +328,14 @@ void free_token_list(TokenList *list) {
     }
     free(list->types);
     free(list->tokens);
+    free(list->lines);
+    free(list->columns);
     free(list);
 }
 
 // Special tokens and keywords
 const char *special[] = {"(", ")", "=", ";"};
-const char *keywords[] = {"var", "show", "show_ones", "and", "or", "not", "True", "False"};
+const char *keywords[] = {"var", "show", "show_ones", "check", "equiv", "minimize", "and", "or", "not", "True", "False"};
 
 // Check if a word is a keyword
 int is_keyword(const char *word) {
@@ -438,16 +360,23 @@ int is_comment_or_empty(const char *line) {
 TokenList* tokenize(char *input_data) {
     TokenList *token_list = create_token_list(10);  // Create an initial token list
 
-    char *line = strtok(input_data, "\n"); //splits input data according to a separator
+    unsigned int line_number = 0;  // Lines are split in place, counting the skipped ones too
+    char *line = input_data;
     while (line != NULL) {
+        char *next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        line_number++;
         if (is_comment_or_empty(line)) {
-            line = strtok(NULL, "\n");
+            line = next;
             continue;  // Skip comments and empty lines
         }
 
         int length = strlen(line);
         char word[256]; // Buffer to store construction of words
         memset(word, 0, sizeof(word)); // Initialize word
+        unsigned int word_column = 0;  // Column where the word being built starts
 
         for (int i = 0; i < length; ) {
             char current = line[i];
@@ -456,12 +385,12 @@ TokenList* tokenize(char *input_data) {
             if (strchr("();=", current)) {
                 if (strlen(word) > 0) {
                     // Modify to add identifier with correct prefix
-                    add_token(token_list, word, is_keyword(word) ? "keyword" : "identifier"); // Token type handling
+                    add_token(token_list, word, is_keyword(word) ? "keyword" : "identifier", line_number, word_column); // Token type handling
                     memset(word, 0, sizeof(word)); // Clear the word
                 }
 
                 char special_token[2] = {current, '\0'}; // Create a string for the special character
-                add_token(token_list, special_token, "special");
+                add_token(token_list, special_token, "special", line_number, i + 1);
                 i++;
                 continue;
             }
@@ -470,7 +399,7 @@ TokenList* tokenize(char *input_data) {
             if (isspace(current)) {
                 if (strlen(word) > 0) {
                     // Modify to add identifier with correct prefix
-                    add_token(token_list, word, is_keyword(word) ? "keyword" : "identifier"); // Token type handling
+                    add_token(token_list, word, is_keyword(word) ? "keyword" : "identifier", line_number, word_column); // Token type handling
                     memset(word, 0, sizeof(word)); // Clear the word
                 }
                 i++;
@@ -479,12 +408,21 @@ TokenList* tokenize(char *input_data) {
 
             // words
             if (isalnum(current) || current == '_') {
+                if (strlen(word) >= sizeof(word) - 1) {
+                    fprintf(stderr, "Error: Identifier longer than %zu characters at line %u, column %u.\n",
+                            sizeof(word) - 1, line_number, word_column);
+                    free_token_list(token_list);
+                    return NULL;
+                }
+                if (strlen(word) == 0) {
+                    word_column = i + 1;
+                }
                 strncat(word, &current, 1); // Add character to word buffer
                 i++;
             } 
             else {
                 // Handle unexpected characters
-                printf("Error: Invalid character '%c' in input.\n", current);
+                fprintf(stderr, "Error: Invalid character '%c' at line %u, column %d.\n", current, line_number, i + 1);
                 free_token_list(token_list);
                 return NULL;
             }
@@ -493,10 +431,10 @@ TokenList* tokenize(char *input_data) {
         // remaining word at the end of the input
         if (strlen(word) > 0) {
             // Modify to add identifier with correct prefix
-            add_token(token_list, word, is_keyword(word) ? "keyword" : "identifier"); // Token type handling
+            add_token(token_list, word, is_keyword(word) ? "keyword" : "identifier", line_number, word_column); // Token type handling
         }
 
-        line = strtok(NULL, "\n");
+        line = next;
     }
 
     return token_list;  // Return the token list
@@ -522,363 +460,1081 @@ int belongs_to(char **array, char *element){
     return 0;
 }
 
-char** variable_declaration(TokenList *token_list, int *index){
-    
-    int num_variables = 0;
 
-    for(int i = 0; i < token_list->size; i++){
-        if(startswith(token_list->tokens[i], "identifier: ")){
-            num_variables +=1;
-        }
+/* PARSING */
+
+// Message of the last parse failure, kept per thread so concurrent compilations don't clash
+static _Thread_local char parse_error_message[256];
+
+const char* parse_error(void){
+    return parse_error_message;
+}
+
+// Prefixes the message with the position of token index, or of the last token when index is past the end
+static void describe_error(char *err, size_t err_len, const TokenList *token_list, size_t index,
+                           const char *message, const char *token){
+    int used = 0;
+    if (token_list->size > 0){
+        size_t at = index < token_list->size ? index : token_list->size - 1;
+        used = snprintf(err, err_len, "line %u, column %u: ", token_list->lines[at], token_list->columns[at]);
+    }
+    if (used >= 0 && (size_t)used < err_len){
+        snprintf(err + used, err_len - used, message, token);
     }
-    //allocate memory for variables, +1 for null terminator
-    char **variables = calloc(num_variables + 1, sizeof(char *));
+}
 
-    //The NULL terminator acts as a sentinel value, marking the end of the array.
-    //useful when you don't know the exact number of elements in the array or if
-    //you're dynamically allocating memory
-    if(variables == NULL){
-        fprintf(stderr, "memory allocation failed \n");
-        exit(1);
+static TreeNode* parse_fail(const TokenList *token_list, size_t index, const char *message, const char *token){
+    describe_error(parse_error_message, sizeof(parse_error_message), token_list, index, message, token);
+    return NULL;
+}
+
+// Entries of the operator stack
+typedef enum {
+    PARSE_OPEN,     // '(' waiting for its ')'
+    PARSE_NOT,      // Applies to the next complete operand
+    PARSE_OR,       // Lowest precedence
+    PARSE_AND
+} ParseOp;
+
+typedef struct {
+    ParseOp op;
+    size_t index;   // Token of the operator, for error positions
+} ParseEntry;
+
+typedef struct {
+    ParseEntry *ops;
+    size_t num_ops;
+    TreeNode **operands;
+    size_t num_operands;
+} ParseStacks;
+
+static void push_op(ParseStacks *stacks, ParseOp op, size_t index){
+    stacks->ops[stacks->num_ops].op = op;
+    stacks->ops[stacks->num_ops++].index = index;
+}
+
+// Pops the operator on top and applies it to the operands on top
+static void reduce(ParseStacks *stacks){
+    ParseOp op = stacks->ops[--stacks->num_ops].op;
+    if (op == PARSE_NOT){
+        TreeNode *child = stacks->operands[stacks->num_operands - 1];
+        stacks->operands[stacks->num_operands - 1] = create_not(child);
+        return;
     }
-    
-    int var_index = 0;
+    TreeNode *right = stacks->operands[--stacks->num_operands];
+    TreeNode *left = stacks->operands[stacks->num_operands - 1];
+    stacks->operands[stacks->num_operands - 1] = op == PARSE_AND ? create_and(left, right) : create_or(left, right);
+}
+
+// An operand was completed: the pending nots before it apply now
+static void reduce_nots(ParseStacks *stacks){
+    while (stacks->num_ops > 0 && stacks->ops[stacks->num_ops - 1].op == PARSE_NOT){
+        reduce(stacks);
+    }
+}
+
+static TreeNode* parse_abort(ParseStacks *stacks){
+    for (size_t i = 0; i < stacks->num_operands; i++){
+        free_tree(stacks->operands[i]);
+    }
+    free(stacks->ops);
+    free(stacks->operands);
+    return NULL;
+}
+
+/*
+ * Precedence climbing over the token array itself (not binds tighter than and, and tighter than
+ * or, both left associative), with explicit operator and operand stacks instead of recursion, so
+ * neither long chains nor deep nesting grow the C stack. Every token pushes at most one entry on
+ * either stack, which bounds both by the length of the expression.
+ */
+TreeNode* parse_expression(const TokenList *token_list, size_t start, size_t end){
     char **tokens = token_list->tokens;
     char **types = token_list->types;
-
-    if (strcmp(tokens[*index], "var") != 0){
-        fprintf(stderr, "The first token should be var");
-        free_array(variables, len_array(variables));
+    ParseStacks stacks;
+    stacks.ops = malloc((end - start + 1) * sizeof(ParseEntry));
+    stacks.operands = malloc((end - start + 1) * sizeof(TreeNode *));
+    stacks.num_ops = stacks.num_operands = 0;
+    if (stacks.ops == NULL || stacks.operands == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
         exit(1);
     }
-    (*index)++;
 
-    while(*index < token_list->size){
+    int expect_operand = 1;
+    size_t depth = 0;  // Parentheses still open
+    for (size_t i = start; i < end; i++){
+        const char *token = tokens[i];
+        int keyword = strcmp(types[i], "keyword") == 0;
 
-        char *curr_tok= tokens[*index];
-        char *curr_type = types[*index];
-        if (strcmp(curr_tok, ";") == 0){
-            (*index)++;
-            break;
+        if (expect_operand){
+            if (strcmp(token, "(") == 0){
+                push_op(&stacks, PARSE_OPEN, i);
+                depth++;
+                continue;
+            }
+            if (keyword && strcmp(token, "not") == 0){
+                push_op(&stacks, PARSE_NOT, i);
+                continue;
+            }
+            if (strcmp(types[i], "identifier") == 0){
+                stacks.operands[stacks.num_operands++] = create_var(tokens[i]);
+            }
+            else if (keyword && (strcmp(token, "True") == 0 || strcmp(token, "False") == 0)){
+                stacks.operands[stacks.num_operands++] = create_bool(token[0] == 'T');
+            }
+            else {
+                parse_fail(token_list, i, "Expected operand, but got %s", token);
+                return parse_abort(&stacks);
+            }
+            reduce_nots(&stacks);
+            expect_operand = 0;
         }
-        if (strcmp(curr_type, "identifier") == 0){
-            char *var = curr_tok;
-            
-            if (var_index >= 64){
-                fprintf(stderr, "Cannot declare more than 64 variables\\n");
-                exit(1);
+        else if (keyword && (strcmp(token, "and") == 0 || strcmp(token, "or") == 0)){
+            ParseOp op = token[0] == 'a' ? PARSE_AND : PARSE_OR;
+            while (stacks.num_ops > 0 && stacks.ops[stacks.num_ops - 1].op >= op){
+                reduce(&stacks);  // left associative
             }
-            if (!isalnum(var[0]) && var[0] != '_'){
-                fprintf(stderr, "Invalid identifier name %s\n", var);
-                exit(1);
+            push_op(&stacks, op, i);
+            expect_operand = 1;
+        }
+        else if (strcmp(token, ")") == 0){
+            while (stacks.num_ops > 0 && stacks.ops[stacks.num_ops - 1].op != PARSE_OPEN){
+                reduce(&stacks);
             }
-            if (belongs_to(variables, var)){
-                fprintf(stderr, "variable %s has already been declared\n", var);
-                exit(1);
+            if (stacks.num_ops == 0){
+                parse_fail(token_list, i, "Unexpected token %s in expression", token);
+                return parse_abort(&stacks);
             }
-            variables = add(variables, var);
-            var_index++;
+            stacks.num_ops--;
+            depth--;
+            reduce_nots(&stacks);
         }
-        else{
-            fprintf(stderr, "Expected identifier but got another type of token %s\n", curr_type);
-            exit(1);
+        else {
+            parse_fail(token_list, i, depth > 0 ? "Expected ')' after expression, got %s" :
+                                                  "Unexpected token %s in expression", token);
+            return parse_abort(&stacks);
+        }
+    }
+
+    if (expect_operand){
+        parse_fail(token_list, end, "Unexpected end of tokens while parsing%s", "");
+        return parse_abort(&stacks);
+    }
+    while (stacks.num_ops > 0){
+        if (stacks.ops[stacks.num_ops - 1].op == PARSE_OPEN){
+            parse_fail(token_list, stacks.ops[stacks.num_ops - 1].index, "Expected ')' after expression%s", "");
+            return parse_abort(&stacks);
         }
-        (*index)++; // Increment index for the next token
+        reduce(&stacks);
     }
-    variables[var_index] = NULL;  // Null terminate the variables array
-    return variables;
+    TreeNode *node = stacks.operands[0];
+    free(stacks.ops);
+    free(stacks.operands);
+    return node;
 }
 
-/* PARSING */
+/* SYMBOL TABLE */
 
-// Forward declarations with recursive calls
-static TreeNode* parse_operand(TokenList *token_list, int *index);
-static TreeNode* parse_and(TokenList *token_list, int *index);
-static TreeNode* parse_or(TokenList *token_list, int *index);
+static void symtab_init(Symtab *table, unsigned long size){
+    table->size = size;
+    table->count = 0;
+    table->keys = calloc(size, sizeof(char *));
+    table->values = calloc(size, sizeof(unsigned int));
+    table->is_input = calloc(size, sizeof(unsigned char));
+    if (table->keys == NULL || table->values == NULL || table->is_input == NULL){
+        allocation_failed();
+    }
+}
 
-// Main parsing function
-TreeNode* parsing(TokenList *token_list, int *index) {
-    return parse_or(token_list, index);
+static void symtab_free(Symtab *table){
+    for (unsigned long i = 0; i < table->size; i++){
+        free(table->keys[i]);
+    }
+    free(table->keys);
+    free(table->values);
+    free(table->is_input);
 }
 
-// Parse operand
-static TreeNode* parse_operand(TokenList *token_list, int *index) {
-    char **tokens = token_list->tokens;
-    char **types = token_list->types;
+// Slot holding key, or the empty slot where it would be inserted
+static unsigned long symtab_slot(const Symtab *table, const char *key){
+    unsigned long index = hash(key, table->size);
+    while (table->keys[index] != NULL && strcmp(table->keys[index], key) != 0){
+        index = (index + 1) % table->size;
+    }
+    return index;
+}
 
-    if ((*index) >= token_list->size) {
-        fprintf(stderr, "Unexpected end of tokens while parsing\n");
-        exit(1);
+static void symtab_put(Symtab *table, const char *key, unsigned int value, int is_input){
+    //keep the load factor under one half
+    if ((table->count + 1) * 2 > table->size){
+        Symtab grown;
+        symtab_init(&grown, table->size * 2);
+        for (unsigned long i = 0; i < table->size; i++){
+            if (table->keys[i] != NULL){
+                unsigned long slot = symtab_slot(&grown, table->keys[i]);
+                grown.keys[slot] = table->keys[i];
+                grown.values[slot] = table->values[i];
+                grown.is_input[slot] = table->is_input[i];
+                grown.count++;
+            }
+        }
+        free(table->keys);
+        free(table->values);
+        free(table->is_input);
+        *table = grown;
     }
 
-    if (strcmp(tokens[*index], "(") == 0) {
-        (*index)++;
-        TreeNode* node = parse_or(token_list, index);
-        if ((*index) >= token_list->size || strcmp(tokens[*index], ")") != 0) {
-            fprintf(stderr, "Expected ')' after expression\n");
+    unsigned long slot = symtab_slot(table, key);
+    if (table->keys[slot] == NULL){
+        table->keys[slot] = malloc(strlen(key) + 1);
+        if (table->keys[slot] == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
             exit(1);
         }
-        (*index)++;
-        return node;
+        strcpy(table->keys[slot], key);
+        table->count++;
     }
-    else if (strcmp(types[*index], "identifier") == 0) {
-        return create_var(tokens[(*index)++]);
+    table->values[slot] = value;
+    table->is_input[slot] = is_input;
+}
+
+// Returns 1 and sets value (and is_input if not NULL) when key is known, 0 otherwise
+int lookup_symbol(const Symtab *table, const char *key, unsigned int *value, int *is_input){
+    unsigned long slot = symtab_slot(table, key);
+    if (table->keys[slot] == NULL){
+        return 0;
+    }
+    *value = table->values[slot];
+    if (is_input != NULL){
+        *is_input = table->is_input[slot];
+    }
+    return 1;
+}
+
+/* COMPILATION */
+
+void (*out_of_memory)(void) = NULL;
+
+void allocation_failed(void){
+    if (out_of_memory != NULL){
+        out_of_memory();  // does not return
     }
-    else if (strcmp(types[*index], "keyword") == 0) {
-        if (strcmp(tokens[*index], "True") == 0) {
-            (*index)++;
-            return create_bool(true);
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(1);
+}
+
+Formula* create_formula(void){
+    Formula *formula = calloc(1, sizeof(Formula));
+    if (formula == NULL){
+        allocation_failed();
+    }
+    formula->variables = calloc(1, sizeof(char *));
+    formula->capacity = 64;
+    formula->code = malloc(formula->capacity * sizeof(Instr));
+    formula->num_buckets = 128;
+    formula->buckets = calloc(formula->num_buckets, sizeof(unsigned int));
+    if (formula->variables == NULL || formula->code == NULL || formula->buckets == NULL){
+        allocation_failed();
+    }
+    symtab_init(&formula->symbols, 64);
+    return formula;
+}
+
+void free_statement(Statement *stmt){
+    free_array(stmt->names, stmt->num_outputs);
+    free(stmt->outputs);
+    free(stmt->cone);
+    free(stmt->report);
+}
+
+void free_formula(Formula *formula){
+    if (formula == NULL){
+        return;
+    }
+    for (size_t i = 0; i < formula->num_statements; i++){
+        free_statement(&formula->statements[i]);
+    }
+    free(formula->statements);
+    free_array(formula->variables, formula->num_vars);
+    free(formula->code);
+    free(formula->buckets);
+    symtab_free(&formula->symbols);
+    free(formula);
+}
+
+static unsigned long instr_hash(unsigned char op, unsigned int a, unsigned int b){
+    uint64_t h = ((uint64_t)a << 32 | b) ^ ((uint64_t)op * 0x9E3779B97F4A7C15ULL);
+    h ^= h >> 31;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    h ^= h >> 29;
+    return (unsigned long)h;
+}
+
+// Appends an instruction unless an identical one exists already (structural hashing)
+static unsigned int emit_unique(Formula *formula, unsigned char op, unsigned int a, unsigned int b){
+    if ((formula->size + 1) * 2 > formula->num_buckets){
+        unsigned long num_buckets = formula->num_buckets * 2;
+        unsigned int *buckets = calloc(num_buckets, sizeof(unsigned int));
+        if (buckets == NULL){
+            allocation_failed();
         }
-        else if (strcmp(tokens[*index], "False") == 0) {
-            (*index)++;
-            return create_bool(false);
+        for (size_t i = 0; i < formula->size; i++){
+            const Instr *in = &formula->code[i];
+            unsigned long slot = instr_hash(in->op, in->a, in->b) & (num_buckets - 1);
+            while (buckets[slot] != 0){
+                slot = (slot + 1) & (num_buckets - 1);
+            }
+            buckets[slot] = i + 1;
         }
-        else if (strcmp(tokens[*index], "not") == 0) {
-            (*index)++;
-            return create_not(parse_operand(token_list, index));
+        free(formula->buckets);
+        formula->buckets = buckets;
+        formula->num_buckets = num_buckets;
+    }
+
+    unsigned long mask = formula->num_buckets - 1;
+    unsigned long slot = instr_hash(op, a, b) & mask;
+    while (formula->buckets[slot] != 0){
+        const Instr *in = &formula->code[formula->buckets[slot] - 1];
+        if (in->op == op && in->a == a && in->b == b){
+            return formula->buckets[slot] - 1;
         }
+        slot = (slot + 1) & mask;
     }
 
-    fprintf(stderr, "Expected operand, but got %s\n", tokens[*index]);
-    exit(1);
+    if (formula->size >= formula->capacity){
+        Instr *code = realloc(formula->code, formula->capacity * 2 * sizeof(Instr));
+        if (code == NULL){
+            allocation_failed();  // the formula keeps its code, free_formula() still releases it
+        }
+        formula->code = code;
+        formula->capacity *= 2;
+    }
+    formula->code[formula->size].op = op;
+    formula->code[formula->size].a = a;
+    formula->code[formula->size].b = b;
+    formula->buckets[slot] = formula->size + 1;
+    return formula->size++;
 }
 
-// Parse AND expressions
-static TreeNode* parse_and(TokenList *token_list, int *index) {
-    TreeNode *node = parse_operand(token_list, index);
-    while ((*index) < token_list->size && 
-           strcmp(token_list->types[*index], "keyword") == 0 && 
-           strcmp(token_list->tokens[*index], "and") == 0) {
-        (*index)++;
-        node = create_and(node, parse_operand(token_list, index));
+// Drops the instructions from size on, newest first: each one emptied the slot its insertion
+// filled, so the probe sequences of the others are as before they were emitted
+void truncate_code(Formula *formula, size_t size){
+    unsigned long mask = formula->num_buckets - 1;
+    while (formula->size > size){
+        const Instr *in = &formula->code[--formula->size];
+        unsigned long slot = instr_hash(in->op, in->a, in->b) & mask;
+        while (formula->buckets[slot] != formula->size + 1){
+            slot = (slot + 1) & mask;
+        }
+        formula->buckets[slot] = 0;
     }
-    return node;
 }
 
-// Parse OR expressions
-static TreeNode* parse_or(TokenList *token_list, int *index) {
-    TreeNode *node = parse_and(token_list, index);
-    while ((*index) < token_list->size && 
-           strcmp(token_list->types[*index], "keyword") == 0 && 
-           strcmp(token_list->tokens[*index], "or") == 0) {
-        (*index)++;
-        node = create_or(node, parse_and(token_list, index));
+// Emits an instruction after constant folding and simple algebraic simplification
+unsigned int emit_instr(Formula *formula, unsigned char op, unsigned int a, unsigned int b){
+    const Instr *code = formula->code;
+
+    if (op == OP_NOT){
+        if (code[a].op == OP_CONST){
+            return emit_unique(formula, OP_CONST, !code[a].a, 0);
+        }
+        if (code[a].op == OP_NOT){
+            return code[a].a;  // not not x = x
+        }
+        return emit_unique(formula, OP_NOT, a, 0);
     }
-    return node;
+
+    if (op == OP_AND || op == OP_OR){
+        // absorbing element of the operation: False for and, True for or
+        unsigned int absorbing = (op == OP_OR);
+        if (a > b){
+            unsigned int tmp = a;
+            a = b;
+            b = tmp;
+        }
+        if (code[a].op == OP_CONST){
+            return code[a].a == absorbing ? a : b;
+        }
+        if (code[b].op == OP_CONST){
+            return code[b].a == absorbing ? b : a;
+        }
+        if (a == b){
+            return a;
+        }
+        if ((code[a].op == OP_NOT && code[a].a == b) || (code[b].op == OP_NOT && code[b].a == a)){
+            return emit_unique(formula, OP_CONST, absorbing, 0);  // x and not x, x or not x
+        }
+    }
+
+    return emit_unique(formula, op, a, b);
 }
 
+typedef struct {
+    TreeNode *node;
+    int expanded;   // Children already scheduled
+} CompileFrame;
+
+// Compiles an expression tree, returns 0 and sets undeclared to the first undeclared identifier.
+// Children are compiled left to right before their parent, from explicit stacks.
+static int compile_tree(Formula *formula, TreeNode *node, unsigned int *result, const char **undeclared){
+    size_t capacity = 64, num_frames = 0, num_done = 0;
+    CompileFrame *frames = malloc(capacity * sizeof(CompileFrame));
+    unsigned int *done = malloc(capacity * sizeof(unsigned int));  // Instructions of compiled subtrees
+    if (frames == NULL || done == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    frames[num_frames].node = node;
+    frames[num_frames++].expanded = 0;
+
+    while (num_frames > 0){
+        if (num_frames + 2 > capacity || num_done + 2 > capacity){
+            capacity *= 2;
+            frames = realloc(frames, capacity * sizeof(CompileFrame));
+            done = realloc(done, capacity * sizeof(unsigned int));
+            if (frames == NULL || done == NULL){
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+        }
+        node = frames[num_frames - 1].node;
 
-Dict* assignment(TokenList *token_list, int *index, char **variables){
-    size_t size = token_list->size;
-    Dict *assignments = initialize_dict(size);
-    if (assignments->vars == NULL) {
-        assignments->vars = malloc(sizeof(char *));
-            assignments->vars[0] = NULL;
+        if (node->evaluate == evaluate_boolean) {
+            done[num_done++] = emit_instr(formula, OP_CONST, ((BoolNode*)node)->value != 0, 0);
+            num_frames--;
+        }
+        else if (node->evaluate == evaluate_variable) {
+            if (!lookup_symbol(&formula->symbols, ((Var*)node)->name, &done[num_done++], NULL)){
+                *undeclared = ((Var*)node)->name;
+                free(frames);
+                free(done);
+                return 0;
+            }
+            num_frames--;
+        }
+        else if (!frames[num_frames - 1].expanded) {
+            frames[num_frames - 1].expanded = 1;
+            if (node->evaluate == evaluate_not) {
+                frames[num_frames].node = ((Not*)node)->child;
+                frames[num_frames++].expanded = 0;
+            }
+            else {
+                // right below left, so the left subtree is compiled first
+                frames[num_frames].node = ((And*)node)->right;
+                frames[num_frames++].expanded = 0;
+                frames[num_frames].node = ((And*)node)->left;
+                frames[num_frames++].expanded = 0;
+            }
+        }
+        else if (node->evaluate == evaluate_not) {
+            done[num_done - 1] = emit_instr(formula, OP_NOT, done[num_done - 1], 0);
+            num_frames--;
+        }
+        else {
+            unsigned int right = done[--num_done];
+            done[num_done - 1] = emit_instr(formula, node->evaluate == evaluate_and ? OP_AND : OP_OR,
+                                            done[num_done - 1], right);
+            num_frames--;
+        }
+    }
+
+    *result = done[0];
+    free(frames);
+    free(done);
+    return 1;
+}
+
+// Collects the instructions the outputs depend on, children first
+void compute_cone(const Formula *formula, Statement *stmt){
+    unsigned char *marked = calloc(formula->size + 1, 1);
+    unsigned int *stack = malloc((formula->size + 1) * sizeof(unsigned int));
+    if (marked == NULL || stack == NULL){
+        allocation_failed();
+    }
+    size_t top = 0;
+    for (size_t i = 0; i < stmt->num_outputs; i++){
+        if (!marked[stmt->outputs[i]]){
+            marked[stmt->outputs[i]] = 1;
+            stack[top++] = stmt->outputs[i];
+        }
+    }
+    while (top > 0){
+        const Instr *in = &formula->code[stack[--top]];
+        if (in->op == OP_NOT || in->op == OP_AND || in->op == OP_OR){
+            if (!marked[in->a]){
+                marked[in->a] = 1;
+                stack[top++] = in->a;
+            }
+            if (in->op != OP_NOT && !marked[in->b]){
+                marked[in->b] = 1;
+                stack[top++] = in->b;
+            }
+        }
+    }
+
+    stmt->cone_size = 0;
+    for (size_t i = 0; i < formula->size; i++){
+        if (marked[i]){
+            stack[stmt->cone_size++] = i;
+        }
+    }
+    stmt->cone = stack;
+    free(marked);
+}
+
+// Fills a statement showing names against the current declarations, returns 0 and sets unknown
+// to the position of the first undeclared name
+int resolve_outputs(const Formula *formula, Statement *stmt, StatementKind kind, char **names, size_t *unknown){
+    size_t num_outputs = len_array(names);
+    stmt->kind = kind;
+    stmt->num_vars = formula->num_vars;
+    stmt->num_outputs = num_outputs;
+    stmt->names = calloc(num_outputs + 1, sizeof(char *));
+    stmt->outputs = malloc((num_outputs + 1) * sizeof(unsigned int));
+    stmt->cone = NULL;
+    stmt->cone_size = 0;
+    stmt->report = NULL;
+    if (stmt->names == NULL || stmt->outputs == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < num_outputs; i++){
+        stmt->names[i] = malloc(strlen(names[i]) + 1);
+        if (stmt->names[i] == NULL){
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        strcpy(stmt->names[i], names[i]);
+        if (!lookup_symbol(&formula->symbols, names[i], &stmt->outputs[i], NULL)){
+            *unknown = i;
+            free_statement(stmt);
+            return 0;
+        }
+    }
+    compute_cone(formula, stmt);
+    return 1;
+}
+
+static int compile_fail(char *err, size_t err_len, const TokenList *token_list, size_t index,
+                        const char *message, const char *token){
+    describe_error(err, err_len, token_list, index, message, token);
+    return 0;
+}
+
+// Forgets declarations, assignments and statements but keeps the instructions already emitted
+static void reset_declarations(Formula *formula){
+    for (size_t i = 0; i < formula->num_statements; i++){
+        free_statement(&formula->statements[i]);
+    }
+    free(formula->statements);
+    formula->statements = NULL;
+    formula->num_statements = 0;
+    free_array(formula->variables, formula->num_vars);
+    formula->variables = calloc(1, sizeof(char *));
+    formula->num_vars = 0;
+    symtab_free(&formula->symbols);
+    symtab_init(&formula->symbols, 64);
+}
+
+// Text of tokens start..end-1 joined by spaces, used as the key of a parsed expression
+static char* expression_key(char **tokens, size_t start, size_t end){
+    size_t length = 1;
+    for (size_t i = start; i < end; i++){
+        length += strlen(tokens[i]) + 1;
+    }
+    char *key = malloc(length);
+    if (key == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    char *p = key;
+    for (size_t i = start; i < end; i++){
+        size_t token_len = strlen(tokens[i]);
+        memcpy(p, tokens[i], token_len);
+        p += token_len;
+        *p++ = ' ';
     }
+    *p = '\0';
+    return key;
+}
+
+/*
+ * Compiles every statement of the file in order: declarations, assignments and show statements.
+ * Instructions already in formula are kept, so recompiling an edited file gives unchanged
+ * assignments the same instructions as before. When parsed is given, every expression tree is
+ * stored there keyed by its text, and trees found in reuse are taken over instead of reparsed.
+ * Returns 0 with err filled on malformed input.
+ */
+int compile_into(Formula *formula, TokenList *token_list, Dict *reuse, Dict *parsed, char *err, size_t err_len){
+    reset_declarations(formula);
+    size_t size = token_list->size;
     char **tokens = token_list->tokens;
     char **types = token_list->types;
+    size_t index = 0;
 
-    while((*index) < size){
-        if(strcmp(tokens[*index], ";") == 0){
-            (*index)++;
+    while (index < size){
+        if (strcmp(tokens[index], ";") == 0){
+            index++;
             continue;
         }
-        else if(strcmp(types[*index], "identifier") == 0){
-            char *var = tokens[*index];
-            if(!belongs_to(assignments->vars, var) && !belongs_to(variables, var)){
-                assignments->vars = add(assignments->vars, var);
+
+        if (strcmp(types[index], "keyword") == 0 && strcmp(tokens[index], "var") == 0){
+            index++;
+            while (index < size && strcmp(tokens[index], ";") != 0){
+                char *var = tokens[index];
+                unsigned int previous;
+                if (strcmp(types[index], "identifier") != 0){
+                    return compile_fail(err, err_len, token_list, index, "Expected identifier but got %s", var);
+                }
+                if (!isalpha(var[0]) && var[0] != '_'){
+                    return compile_fail(err, err_len, token_list, index, "Invalid identifier name %s", var);
+                }
+                if (lookup_symbol(&formula->symbols, var, &previous, NULL)){
+                    return compile_fail(err, err_len, token_list, index, "variable %s has already been declared", var);
+                }
+                if (formula->num_vars >= 64){
+                    return compile_fail(err, err_len, token_list, index, "Cannot declare more than 64 variables%s", "");
+                }
+                formula->variables = add(formula->variables, var);
+                unsigned int input = emit_instr(formula, OP_INPUT, formula->num_vars++, 0);
+                symtab_put(&formula->symbols, var, input, 1);
+                index++;
+            }
+            if (index >= size){
+                return compile_fail(err, err_len, token_list, index, "Expected ';' after declaration%s", "");
+            }
+            index++;
+        }
+        else if (strcmp(types[index], "keyword") == 0 &&
+                 (strcmp(tokens[index], "show") == 0 || strcmp(tokens[index], "show_ones") == 0 ||
+                  strcmp(tokens[index], "check") == 0 || strcmp(tokens[index], "equiv") == 0)){
+            StatementKind kind = strcmp(tokens[index], "show") == 0 ? STMT_SHOW :
+                                 strcmp(tokens[index], "show_ones") == 0 ? STMT_SHOW_ONES :
+                                 strcmp(tokens[index], "check") == 0 ? STMT_CHECK : STMT_EQUIV;
+            size_t keyword_index = index;
+            char **names = calloc(1, sizeof(char *));
+            index++;
+            while (index < size && strcmp(tokens[index], ";") != 0){
+                if (strcmp(types[index], "identifier") != 0){
+                    free_array(names, len_array(names));
+                    return compile_fail(err, err_len, token_list, index, "Expected identifier but got %s", tokens[index]);
+                }
+                names = add(names, tokens[index]);
+                index++;
+            }
+            index++; //skip the semicolon
+            if ((kind == STMT_CHECK && len_array(names) == 0) || (kind == STMT_EQUIV && len_array(names) != 2)){
+                free_array(names, len_array(names));
+                return compile_fail(err, err_len, token_list, keyword_index, "%s",
+                                    kind == STMT_CHECK ? "check expects at least one identifier" :
+                                                         "equiv expects exactly two identifiers");
             }
-            (*index)++;
-            if (((*index)>= size) || strcmp(tokens[*index], "=") != 0){
-                fprintf(stderr, "Expected '=', got %s", tokens[*index]);
-                exit(1);  
-            } 
 
-            (*index)++;
-            size_t start = (*index);
-            int stack_count = 0;
+            formula->statements = realloc(formula->statements, (formula->num_statements + 1) * sizeof(Statement));
+            if (formula->statements == NULL){
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            size_t unknown;
+            if (!resolve_outputs(formula, &formula->statements[formula->num_statements], kind, names, &unknown)){
+                compile_fail(err, err_len, token_list, keyword_index + 1 + unknown, "Undeclared variable %s", names[unknown]);
+                free_array(names, len_array(names));
+                return 0;
+            }
+            free_array(names, len_array(names));
+            if (!is_query(&formula->statements[formula->num_statements])){
+                map_luts(formula, &formula->statements[formula->num_statements]);
+            }
+            formula->num_statements++;
+        }
+        else if (strcmp(types[index], "keyword") == 0 && strcmp(tokens[index], "minimize") == 0){
+            index++;
+            if (index + 1 >= size || strcmp(types[index], "identifier") != 0 || strcmp(tokens[index + 1], ";") != 0){
+                return compile_fail(err, err_len, token_list, index, "%s", "minimize expects exactly one identifier");
+            }
+            char *var = tokens[index];
+            unsigned int instr;
+            int is_input = 0;
+            if (!lookup_symbol(&formula->symbols, var, &instr, &is_input)){
+                return compile_fail(err, err_len, token_list, index, "Undeclared variable %s", var);
+            }
+            if (is_input){
+                return compile_fail(err, err_len, token_list, index, "Cannot minimize declared variable %s", var);
+            }
+            index += 2;
+
+            // later statements see the minimized form
+            char *report;
+            symtab_put(&formula->symbols, var, minimize_instr(formula, var, instr, &report), 0);
+            char *names[2] = {var, NULL};
+            formula->statements = realloc(formula->statements, (formula->num_statements + 1) * sizeof(Statement));
+            if (formula->statements == NULL){
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            Statement *stmt = &formula->statements[formula->num_statements++];
+            size_t unknown;
+            resolve_outputs(formula, stmt, STMT_MINIMIZE, names, &unknown);  // declared, looked up above
+            stmt->report = report;
+        }
+        else if (strcmp(types[index], "identifier") == 0){
+            char *var = tokens[index];
+            unsigned int previous;
+            int is_input = 0;
+            if (lookup_symbol(&formula->symbols, var, &previous, &is_input) && is_input){
+                return compile_fail(err, err_len, token_list, index, "Cannot assign to declared variable %s", var);
+            }
+            index++;
+            if (index >= size || strcmp(tokens[index], "=") != 0){
+                return compile_fail(err, err_len, token_list, index, "Expected '=', got %s", index < size ? tokens[index] : "EOF");
+            }
 
-            while((*index) < size){
-                if(strcmp(tokens[*index], ";") == 0 && stack_count == 0){
-                        break;
+            index++;
+            size_t start = index;
+            int stack_count = 0;
+            while (index < size){
+                if (strcmp(tokens[index], ";") == 0 && stack_count == 0){
+                    break;
                 }
-                if(strcmp(tokens[*index], "(") == 0){
+                if (strcmp(tokens[index], "(") == 0){
                     stack_count++;
-                    } 
-                else if(strcmp(tokens[*index], ")") == 0){
+                }
+                else if (strcmp(tokens[index], ")") == 0){
                     stack_count--;
-                    }
-                (*index)++;
                 }
+                index++;
+            }
+            size_t end = index;
+            index++; //skip the semicolon
 
-            size_t end = (*index);
-            if((*index) < size && strcmp(tokens[*index], ";") == 0){
-                (*index)++;
+            TreeNode *expression = NULL;
+            char *key = parsed != NULL ? expression_key(tokens, start, end) : NULL;
+            if (reuse != NULL){
+                expression = take(reuse, key);
             }
-            // create a subarray of the tokens in the expression
-            TokenList *exp_tokens = create_token_list(end - start + 1);
-            for(size_t i = start; i < end; i++){
-                add_token(exp_tokens, tokens[i], types[i]);
+
+            if (expression == NULL){
+                expression = parse_expression(token_list, start, end);
+                if (expression == NULL){
+                    free(key);
+                    snprintf(err, err_len, "%s", parse_error());  // positioned already
+                    return 0;
+                }
             }
-            int exp_index = 0;
-            TreeNode *expression = parsing(exp_tokens, &exp_index);
-            //start -2 index since whe have expression and '='
-            insert(assignments, tokens[start - 2], expression); 
-            free_token_list(exp_tokens);
+
+            unsigned int result;
+            const char *undeclared = NULL;
+            int ok = compile_tree(formula, expression, &result, &undeclared);
+            if (!ok){
+                // compilation stops at the leftmost undeclared identifier, so its first token is the one
+                size_t at = start;
+                while (at < end && strcmp(tokens[at], undeclared) != 0){
+                    at++;
+                }
+                compile_fail(err, err_len, token_list, at, "Undeclared variable %s", undeclared);
             }
-        else if (strcmp(tokens[*index], "show") == 0 || strcmp(tokens[*index], "show_ones") == 0){
-            break;
+            if (parsed != NULL){
+                insert(parsed, key, expression);
+                free(key);
+            }
+            else {
+                free_tree(expression);
+            }
+            if (!ok){
+                return 0;
+            }
+            symtab_put(&formula->symbols, var, result, 0);
         }
-        else{
-            fprintf(stderr, "Unexpected token %s in assignments", tokens[*index]);
-            exit(1);
+        else {
+            return compile_fail(err, err_len, token_list, index, "Unexpected token %s", tokens[index]);
         }
     }
-    return assignments;
+
+    //hash of the token stream, insensitive to whitespace and comments
+    uint64_t h = fnv1a("", 0);
+    for (size_t i = 0; i < size; i++){
+        h ^= fnv1a(tokens[i], strlen(tokens[i]));
+        h *= 0x100000001B3ULL;
+        h ^= fnv1a(types[i], strlen(types[i]));
+        h *= 0x100000001B3ULL;
     }
-    
-/* SHOW TRUTH TABLE */
+    formula->hash = h;
+    return 1;
+}
 
-void show(Dict *assignments, char **variables, char **variables_to_show) {
+Formula* compile_formula(TokenList *token_list, char *err, size_t err_len){
+    Formula *formula = create_formula();
+    if (!compile_into(formula, token_list, NULL, NULL, err, err_len)){
+        free_formula(formula);
+        return NULL;
+    }
+    return formula;
+}
 
-    char **header = concatenate(variables, variables_to_show);
-    //counts size of all strings
-    size_t len_head = len_array(header);
-    // print '#'
-    printf("# ");
+Formula* compile_source(const char *text, size_t length, char *err, size_t err_len){
+    //tokenize works in place, so it gets its own copy of the text
+    char *content = malloc(length + 1);
+    if (content == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(content, text, length);
+    content[length] = '\0';
 
-    //print the header array element wise
-    for (size_t i = 0; i < len_head; i++){
-        printf("%s", header[i]);
-        //space unless last string
-        if (i != len_head - 1){
-            printf(" ");
-        }
+    TokenList *token_list = tokenize(content);
+    free(content);
+    if (token_list == NULL){
+        snprintf(err, err_len, "tokenization failed");
+        return NULL;
     }
-    // newline at the end
-    printf("\n");
+    Formula *formula = compile_formula(token_list, err, err_len);
+    free_token_list(token_list);
+    return formula;
+}
 
-    size_t num_vars = len_array(variables);
-    // Total number of rows in the truth table (all possible combinations of 0 and 1)
-    unsigned long int rows = 1UL << num_vars;
-
-    for(unsigned long int i = 0; i < rows; i++ ){
-        Dict *truth_table = initialize_dict(num_vars * 2); //num_vars * 2 to avoid collisions    
-
-        //truth table for the row
-        for(size_t j = 0; j < num_vars; j++){
-            int bit = (i >> (num_vars - 1 -j)) & 1;
-            TreeNode *valueNode = create_bool(bit);
-            insert(truth_table, variables[j], valueNode); //iterates through all possibilities of 0 and 1 for all vars
-        }
-
-        //evaluate assignments
-        for(size_t j = 0; assignments->vars[j] != NULL; j++ ){
-            char *var = assignments->vars[j];
-            TreeNode *expr = get(assignments, var);
-            if (expr != NULL){
-                int result = expr->evaluate(expr, truth_table);
-                TreeNode *result_node = create_bool(result);
-                insert(truth_table, var, result_node);
+/* EVALUATION */
+
+// Values of the six lowest row bits across the 64 rows of a word
+const uint64_t low_bit_patterns[6] = {
+    0xAAAAAAAAAAAAAAAAULL, 0xCCCCCCCCCCCCCCCCULL, 0xF0F0F0F0F0F0F0F0ULL,
+    0xFF00FF00FF00FF00ULL, 0xFFFF0000FFFF0000ULL, 0xFFFFFFFF00000000ULL
+};
+
+// Evaluates the statement's cone on rows base..base+63, bit i of values[k] is instruction k on row base+i
+void eval_word(const Formula *formula, const Statement *stmt, unsigned long base, uint64_t *values){
+    const Instr *code = formula->code;
+    for (size_t k = 0; k < stmt->cone_size; k++){
+        unsigned int i = stmt->cone[k];
+        const Instr *in = &code[i];
+        switch (in->op){
+            case OP_CONST:
+                values[i] = in->a ? ~0ULL : 0;
+                break;
+            case OP_INPUT: {
+                // the first declared variable is the most significant bit of the row index
+                size_t bit = stmt->num_vars - 1 - in->a;
+                values[i] = bit < 6 ? low_bit_patterns[bit] : (((base >> bit) & 1) ? ~0ULL : 0);
+                break;
             }
+            case OP_NOT:
+                values[i] = ~values[in->a];
+                break;
+            case OP_AND:
+                values[i] = values[in->a] & values[in->b];
+                break;
+            case OP_OR:
+                values[i] = values[in->a] | values[in->b];
+                break;
         }
+    }
+}
 
-        //Print row
-        for(size_t j = 0; j < len_head; j++){
-            TreeNode *node = get(truth_table, header[j]);
-            printf("%d", node ? node->evaluate(node, truth_table) : 0);
-            if(j != len_head -1) {
-                printf(" ");
-            }
-        }
-        
-        printf("\n");
+// Mask of the rows of the word starting at base that are part of the table
+uint64_t valid_rows_mask(unsigned long rows, unsigned long base){
+    return rows - base >= 64 ? ~0ULL : (1ULL << (rows - base)) - 1;
+}
 
-        free_dict(truth_table);
+/* SHOW TRUTH TABLE */
 
+void print_header(const Statement *stmt, char **variables, FILE *out){
+    // print '#'
+    fputs("#", out);
+    for (size_t i = 0; i < stmt->num_vars; i++){
+        fprintf(out, " %s", variables[i]);
     }
+    for (size_t i = 0; i < stmt->num_outputs; i++){
+        fprintf(out, " %s", stmt->names[i]);
+    }
+    fputs("\n", out);
+}
 
-    free_array(header, len_head);
-
+void flush_output(OutputBuffer *buffer){
+    fwrite(buffer->data, 1, buffer->used, buffer->out);
+    buffer->used = 0;
 }
 
-void show_ones(Dict *assignments, char **variables, char **variables_to_show) {
+// Appends "b b b ... b\n" for the row, bit is the position of the row inside the evaluated word
+void emit_row(OutputBuffer *buffer, const Statement *stmt, unsigned long row,
+              const uint64_t *values, unsigned int bit){
+    size_t width = 2 * (stmt->num_vars + stmt->num_outputs);
+    if (buffer->used + width + 1 > OUTPUT_BUFFER_SIZE){
+        flush_output(buffer);
+    }
+    char *p = buffer->data + buffer->used;
+    for (size_t j = 0; j < stmt->num_vars; j++){
+        *p++ = '0' + ((row >> (stmt->num_vars - 1 - j)) & 1);
+        *p++ = ' ';
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        *p++ = '0' + ((values[stmt->outputs[j]] >> bit) & 1);
+        *p++ = ' ';
+    }
+    if (width == 0){
+        *p++ = ' ';
+    }
+    p[-1] = '\n';  // newline instead of the trailing space
+    buffer->used = p - buffer->data;
+}
 
-    char **header = concatenate(variables, variables_to_show);
-    //counts size of all strings
-    size_t len_head = len_array(header);
-    // print '#'
-    printf("# ");
+OutputBuffer* create_output_buffer(FILE *out){
+    OutputBuffer *buffer = malloc(sizeof(OutputBuffer));
+    if (buffer == NULL){
+        allocation_failed();
+    }
+    buffer->used = 0;
+    buffer->out = out;
+    return buffer;
+}
 
-    //print the header array element wise
-    for (size_t i = 0; i < len_head; i++){
-        printf("%s", header[i]);
-        //space unless last string
-        if (i != len_head - 1){
-            printf(" ");
-        }
+uint64_t* alloc_values(const Formula *formula){
+    uint64_t *values = malloc((formula->size + 1) * sizeof(uint64_t));
+    if (values == NULL){
+        allocation_failed();
     }
-    // newline at the end
-    printf("\n");
+    return values;
+}
 
-    size_t num_vars = len_array(variables);
+// Prints count rows of the full table starting at row start (no header)
+void show_rows(const Formula *formula, const Statement *stmt, unsigned long start,
+               unsigned long count, FILE *out){
     // Total number of rows in the truth table (all possible combinations of 0 and 1)
-    unsigned long int rows = 1UL << num_vars;
-
-    for(unsigned long int i = 0; i < rows; i++ ){
-        Dict *truth_table = initialize_dict(num_vars * 2); //num_vars * 2 to avoid collisions    
-
-        //truth table for the row
-        for(size_t j = 0; j < num_vars; j++){
-            int bit = (i >> (num_vars - 1 -j)) & 1;
-            TreeNode *valueNode = create_bool(bit);
-            insert(truth_table, variables[j], valueNode); //iterates through all possibilities of 0 and 1 for all vars
-        }
-
-        //evaluate assignments
-        for(size_t j = 0; assignments->vars[j] != NULL; j++ ){
-            char *var = assignments->vars[j];
-            TreeNode *expr = get(assignments, var);
-            if (expr != NULL){
-                int result = expr->evaluate(expr, truth_table);
-                TreeNode *result_node = create_bool(result);
-                insert(truth_table, var, result_node);
-            }
+    unsigned long rows = 1UL << stmt->num_vars;
+    if (start >= rows){
+        return;
+    }
+    unsigned long end = (count > rows - start) ? rows : start + count;
+
+    uint64_t *values = alloc_values(formula);
+    OutputBuffer *buffer = create_output_buffer(out);
+
+    for (unsigned long base = start & ~63UL; base < end; base += 64){
+        eval_word(formula, stmt, base, values);
+        unsigned long first = base < start ? start : base;
+        unsigned long last = end - base > 64 ? base + 64 : end;
+        for (unsigned long row = first; row < last; row++){
+            emit_row(buffer, stmt, row, values, row - base);
         }
+    }
 
-        // Check if any of the specified variables are True and print the row if so
-        bool print_row = false;
-        for(size_t j; variables_to_show[j] != NULL; j++){
-            TreeNode *node = get(truth_table, variables_to_show[j]);
-            if (node && node->evaluate(node, truth_table)) {
-                print_row = true;
-                break;
-            }
+    flush_output(buffer);
+    free(buffer);
+    free(values);
+}
+
+void show(const Formula *formula, const Statement *stmt, FILE *out) {
+    print_header(stmt, formula->variables, out);
+    show_rows(formula, stmt, 0, 1UL << stmt->num_vars, out);
+}
+
+// Prints the rows where at least one of the shown variables is true
+void show_ones(const Formula *formula, const Statement *stmt, FILE *out) {
+    print_header(stmt, formula->variables, out);
+
+    unsigned long rows = 1UL << stmt->num_vars;
+    uint64_t *values = alloc_values(formula);
+    OutputBuffer *buffer = create_output_buffer(out);
+
+    for (unsigned long base = 0; base < rows; base += 64){
+        eval_word(formula, stmt, base, values);
+        uint64_t ones = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            ones |= values[stmt->outputs[j]];
+        }
+        ones &= valid_rows_mask(rows, base);
+        while (ones != 0){
+            unsigned int bit = __builtin_ctzll(ones);
+            emit_row(buffer, stmt, base + bit, values, bit);
+            ones &= ones - 1;
         }
+    }
 
-        //Print row
-        if (print_row){
-            for(size_t j = 0; j < len_head; j++){
-                TreeNode *node = get(truth_table, header[j]);
-                printf("%d", node ? node->evaluate(node, truth_table) : 0);
-                if(j != len_head -1) {
-                    printf(" ");
-                }
-            }
+    flush_output(buffer);
+    free(buffer);
+    free(values);
+}
+
+// Number of rows where at least one of the shown variables is true. symmetry holds the classes
+// a plan found for the statement, or is NULL to look for them here.
+unsigned long count_ones(const Formula *formula, const Statement *stmt, Symmetry *symmetry){
+    unsigned long rows = 1UL << stmt->num_vars;
+    unsigned long total = 0;
+    uint64_t *values = alloc_values(formula);
+    Symmetry found;
+    if (symmetry == NULL && stmt->num_vars >= SYMMETRY_MIN_VARS){
+        // symmetric variables only matter through how many of them are set, the solver proving
+        // them so gets a share of the time the first word says evaluating every row takes
+        double start = now_seconds();
+        eval_word(formula, stmt, 0, values);
+        double budget = (now_seconds() - start) * (rows / 64) * SYMMETRY_BUDGET_SHARE;
+        find_symmetry(formula, stmt, budget, &found);
+        symmetry = &found;
+    }
+    int reduced = symmetry != NULL && symmetry_pays(stmt, symmetry);
+    if (reduced){
+        evaluate_symmetry(formula, stmt, symmetry);
+        total = count_symmetric(stmt, symmetry);
+    }
+    if (symmetry == &found){
+        free_symmetry(&found);
+    }
+    if (reduced){
+        free(values);
+        return total;
+    }
+
+    for (unsigned long base = 0; base < rows; base += 64){
+        eval_word(formula, stmt, base, values);
+        uint64_t ones = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            ones |= values[stmt->outputs[j]];
         }
-        
-        printf("\n");
+        total += __builtin_popcountll(ones & valid_rows_mask(rows, base));
+    }
 
-        free_dict(truth_table);
+    free(values);
+    return total;
+}
+
+// check, equiv and minimize statements do not enumerate the rows of the table
+int is_query(const Statement *stmt){
+    return stmt->kind == STMT_CHECK || stmt->kind == STMT_EQUIV || stmt->kind == STMT_MINIMIZE;
+}
 
+void run_statement(const Formula *formula, const Statement *stmt, FILE *out){
+    if (stmt->kind == STMT_MINIMIZE){
+        fputs(stmt->report, out);
+        return;
+    }
+    if (is_query(stmt)){
+        run_query(formula, stmt, 0, out);
+        return;
+    }
+    if (stmt->num_vars >= 64){
+        fprintf(stderr, "Cannot enumerate the rows of %zu variables\n", stmt->num_vars);
+        return;
+    }
+    if (stmt->kind == STMT_SHOW){
+        show(formula, stmt, out);  // Show full truth table
+    }
+    else {
+        show_ones(formula, stmt, out);  // Show only when at least one is True
     }
+}
 
-    free_array(header, len_head);
+/* INPUT */
 
+uint64_t fnv1a(const void *data, size_t length){
+    const unsigned char *bytes = data;
+    uint64_t h = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < length; i++){
+        h ^= bytes[i];
+        h *= 0x100000001B3ULL;
+    }
+    return h;
 }
 
-// Read the input file
-TokenList* read_file(const char *input_file) {
+// Read the whole input file into a null terminated string
+char* read_text(const char *input_file, size_t *length) {
     FILE* file = fopen(input_file, "r");
     if (file == NULL) {
         perror("error opening file");
@@ -896,23 +1552,106 @@ TokenList* read_file(const char *input_file) {
         return NULL;
     }
 
-    fread(content, 1, file_size, file);
-    content[file_size] = '\0';  // Null-terminate the string as a C string
+    size_t read = fread(content, 1, file_size, file);
+    content[read] = '\0';  // Null-terminate the string as a C string
     fclose(file);
 
+    if (length != NULL) {
+        *length = read;
+    }
+    return content;
+}
+
+// Read and tokenize the input file
+TokenList* read_file(const char *input_file) {
+    char *content = read_text(input_file, NULL);
+    if (content == NULL) {
+        return NULL;
+    }
+
     TokenList* token_list = tokenize(content);
     free(content);
 
     return token_list;
 }
 
+// The Python extension links this file as a library and defines TABLE_NO_MAIN
+#ifndef TABLE_NO_MAIN
+
+static void usage(const char *program) {
+    printf("Usage: %s [-j threads] [--split k] [--inflight n] [--explain] [-v] [-o output] input_file.txt\n", program);
+    printf("       %s --checkpoint file [--checkpoint-every seconds] [--resume] -o output input_file.txt\n", program);
+    printf("       %s --shard i/N -o shard_file input_file.txt\n", program);
+    printf("       %s merge [--binary] [-o output] shard_file...\n", program);
+    printf("       %s --watch input_file.txt\n", program);
+    printf("       %s --serve [--socket path] [--threads n] [--cache n] [--max-frame bytes]\n", program);
+    printf("       %s --bench-client socket_path input_file.txt [--requests n] [--connections n] [--query q]\n", program);
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        printf("Usage: %s input_file.txt\n", argv[0]);
+    if (argc >= 2 && (strcmp(argv[1], "--serve") == 0 || strcmp(argv[1], "--bench-client") == 0)) {
+        return server_main(argc, argv);
+    }
+    if (argc == 3 && strcmp(argv[1], "--watch") == 0) {
+        return watch(argv[2]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "merge") == 0) {
+        return merge_main(argc, argv);
+    }
+
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 1;
+    const char *input_file = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            options.num_threads = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--split") == 0 && i + 1 < argc) {
+            options.split = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            options.checkpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            options.checkpoint_interval = strtod(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--resume") == 0) {
+            options.resume = 1;
+        }
+        else if (strcmp(argv[i], "--inflight") == 0 && i + 1 < argc) {
+            options.inflight = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--explain") == 0) {
+            options.explain = 1;
+        }
+        else if (strcmp(argv[i], "-v") == 0) {
+            options.verbose = 1;
+        }
+        else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%zu/%zu", &options.shard_index, &options.shard_count) != 2 ||
+                options.shard_index >= options.shard_count) {
+                fprintf(stderr, "--shard expects i/N with 0 <= i < N\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            options.output = argv[++i];
+        }
+        else if (input_file == NULL && argv[i][0] != '-') {
+            input_file = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (input_file == NULL || (options.shard_count > 0 && options.output == NULL) ||
+        ((options.checkpoint != NULL || options.resume) && (options.output == NULL || options.checkpoint == NULL))) {
+        usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    const char *input_file = argv[1];
     TokenList *token_list = read_file(input_file);
     
     if (token_list == NULL) {
@@ -920,137 +1659,122 @@ int main(int argc, char* argv[]) {
         return EXIT_FAILURE;
     }
 
-    int index = 0;
-    //pass the index by reference, allowing variable_declaration to modify it.
-    char **variables = variable_declaration(token_list, &index);
-    //now i can use the updated index
-
-    if (variables == NULL){
-        fprintf(stderr, "declaration failed");
-        free_token_list(token_list);
+    char err[256];
+    Formula *formula = compile_formula(token_list, err, sizeof(err));
+    free_token_list(token_list);
+    if (formula == NULL) {
+        fprintf(stderr, "%s\n", err);
         return EXIT_FAILURE;
     }
-    
-    Dict *assignments = assignment(token_list, &index, variables);
-    
-    char **show_vars = malloc(sizeof(char *));
-    char **show_ones_vars = malloc(sizeof(char *));
-    char **vars_to_show = NULL;
 
-    // Initialize with NULL terminator
-    if (show_vars != NULL) {
-        show_vars[0] = NULL;
+    if (options.shard_count > 0) {
+        int status = write_shard(formula, options.shard_index, options.shard_count, options.output);
+        free_formula(formula);
+        return status;
     }
-    if (show_ones_vars != NULL) {
-        show_ones_vars[0] = NULL;
+
+    Progress progress;
+    long long offset = 0;
+    if (options.checkpoint != NULL) {
+        progress.path = options.checkpoint;
+        progress.hash = formula->hash;
+        progress.statement = 0;
+        progress.row = 0;
+        progress.interval = options.checkpoint_interval > 0 ? options.checkpoint_interval : CHECKPOINT_INTERVAL;
+        start_progress(&progress);
+        options.progress = &progress;
+    }
+    if (options.resume && !load_checkpoint(&progress, formula, &offset, err, sizeof(err))) {
+        fprintf(stderr, "%s\n", err);
+        free_formula(formula);
+        return EXIT_FAILURE;
     }
 
-    size_t len_tok = token_list->size;
-    while (index < len_tok){
-        if(strcmp(token_list->tokens[index], "show") == 0 && strcmp(token_list->types[index], "keyword") == 0){
-            index++;
-            vars_to_show = malloc(sizeof(char *));
-            if(vars_to_show == NULL) {
-                fprintf(stderr, "Memory alloc failed");
-                exit(1);
-            }
-            vars_to_show[0] = NULL;  // Initialize with NULL terminator
-            while(index < len_tok && strcmp(token_list->tokens[index], ";") != 0){
-                if (strcmp(token_list->types[index], "identifier") == 0){
-                    vars_to_show = add(vars_to_show, token_list->tokens[index]);
-                }
-                index++;
-            }
-            index++; //skip the semicolon
-            show_vars = concatenate(show_vars, vars_to_show);
-            free_array(vars_to_show, len_array(vars_to_show));
-            vars_to_show = NULL;
+    FILE *out = stdout;
+    if (options.output != NULL) {
+        out = fopen(options.output, options.resume ? "r+" : "w+");  // readable, to be mapped
+        if (out == NULL) {
+            perror("error opening output file");
+            free_formula(formula);
+            return EXIT_FAILURE;
         }
-        else if(strcmp(token_list->tokens[index], "show_ones") == 0 && strcmp(token_list->types[index], "keyword") == 0){
-            index++;
-            vars_to_show = malloc(sizeof(char *));
-            if(vars_to_show == NULL) {
-                fprintf(stderr, "Memory alloc failed");
-                exit(1);
-            }
-            vars_to_show[0] = NULL;  // Initialize with NULL terminator
-            while(index < len_tok && strcmp(token_list->tokens[index], ";") != 0){
-                if (strcmp(token_list->types[index], "identifier") == 0){
-                    vars_to_show = add(vars_to_show, token_list->tokens[index]);
-                }
-                index++;
-            }
-            index++;
-            show_ones_vars = concatenate(show_ones_vars, vars_to_show);
-            free_array(vars_to_show, len_array(vars_to_show));
-            vars_to_show = NULL;
-        }
-        else {
-            index++;
+    }
+    if (options.resume) {
+        // whatever was printed after the checkpoint is printed again
+        struct stat status;
+        if (fstat(fileno(out), &status) != 0 || status.st_size < offset ||
+            ftruncate(fileno(out), offset) != 0 || fseeko(out, offset, SEEK_SET) != 0) {
+            fprintf(stderr, "output file does not match checkpoint %s\n", options.checkpoint);
+            fclose(out);
+            free_formula(formula);
+            return EXIT_FAILURE;
         }
     }
 
-    // Display the results
-    if(show_vars && show_vars[0] != NULL){
-        show(assignments, variables, show_vars);  // Show full truth table
+    // Every statement is measured once, its plan deciding fusion and then running it
+    size_t first = options.resume ? progress.statement : 0;
+    Plan *plans = calloc(formula->num_statements + 1, sizeof(Plan));
+    if (plans == NULL) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
     }
-    if(show_ones_vars && show_ones_vars[0] != NULL){
-        show_ones(assignments, variables, show_ones_vars);  // Show only when at least one is True
+    for (size_t i = first; i < formula->num_statements; i++) {
+        plan_statement(formula, &formula->statements[i], &options, &plans[i]);
     }
 
-    /* Prints*/
-
-    // Print tokens with their types
-    printf("Tokens:\n");
-    printf("[");
-    for (size_t i = 0; i < token_list->size; i++) {
-        printf("%s:%s ", token_list->types[i], token_list->tokens[i]);
-    }
-    printf("]\n");
-    
-    printf("Variables:\n");
-    printf("[");
-    for (size_t i = 0; variables[i] != NULL; i++) {
-        printf(" %s ", variables[i]);
-    }
-    printf("]\n");
-
-    // Print assignments
-    printf("Assignments:\n");
-    printf("{");
-    int first = 1;
-    for (unsigned long i = 0; i < assignments->size; i++) {
-        if (assignments->entries[i] != NULL) {
-            if (!first) {
-                printf(", ");
+    // Display the results, in the order of the show statements, consecutive ones fused when cheaper
+    size_t alone = first;  // statements before this one were already found cheaper one by one
+    for (size_t i = first; i < formula->num_statements; i++) {
+        if (options.progress != NULL) {
+            progress.statement = i;
+            progress.row = options.resume && i == first ? progress.row : 0;
+        }
+        size_t end = i + 1;
+        double fused = 0, separate = 0;
+        int fuse = i >= alone && plan_fusion(formula, plans, i, &options, &end, &fused, &separate);
+        if (i >= alone) {
+            alone = end;
+        }
+        if (options.explain) {
+            if (end > i + 1) {
+                fprintf(out, "statements %zu to %zu: one sweep %.3g s, one by one %.3g s%s\n",
+                        i + 1, end, fused, separate, fuse ? "  <- one sweep" : "");
             }
-            printf("%s: ", assignments->entries[i]->key);
-            TreeNode *node = assignments->entries[i]->node;
-            if (node != NULL) {
-                printf("%d", node->evaluate(node, assignments));
-            } else {
-                printf("NULL");
+            if (fuse) {
+                i = end - 1;
+                continue;
             }
-            first = 0;
+            explain_plan(formula, &formula->statements[i], &plans[i], out);
+            continue;
+        }
+        if (fuse) {
+            run_fused(formula, i, end, &options, out);
+            i = end - 1;
+            continue;
+        }
+        run_planned(formula, &formula->statements[i], &plans[i], &options, out);
+        if (options.progress != NULL) {
+            fflush(out);
+            progress.statement = i + 1;
+            progress.row = 0;
+            save_checkpoint(&progress, fileno(out), lseek(fileno(out), 0, SEEK_CUR));
         }
     }
-    printf("}\n");
 
-    // Free allocated memory
-    if (show_vars != NULL) {
-        free_array(show_vars, len_array(show_vars));
+    for (size_t i = first; i < formula->num_statements; i++) {
+        free_plan(&plans[i]);
     }
+    free(plans);
+    free_formula(formula);
 
-    if (show_ones_vars != NULL) {
-        free_array(show_ones_vars, len_array(show_ones_vars));
+    if (out != stdout && fclose(out) != 0) {
+        perror("error writing output file");
+        return EXIT_FAILURE;
     }
-
-    if (variables != NULL) {
-        free_array(variables, len_array(variables));
+    if (options.progress != NULL) {
+        remove(options.checkpoint);  // complete, nothing left to resume
     }
-
-    free_token_list(token_list);
-    free_dict(assignments);
-
     return EXIT_SUCCESS; 
 }
+
+#endif
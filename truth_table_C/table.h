@@ -0,0 +1,374 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+// Forward declaration of TreeNode
+struct TreeNode;
+
+// Entry structure definition
+typedef struct {
+    char *key;
+    struct TreeNode *node;  // Use the forward-declared TreeNode pointer
+} Entry;
+
+// Dictionary (Hash Table) structure definition
+typedef struct {
+    Entry **entries; // Array of pointers to entries
+    unsigned long size; // Size of the hash table
+    char **vars; // Added: Array to store variable names
+} Dict;
+
+// Full TreeNode definition
+typedef struct TreeNode {
+    int (*evaluate)(struct TreeNode*, Dict *assignments);  // Function pointer for evaluating the tree node
+} TreeNode;
+
+// Bool Node
+typedef struct {
+    TreeNode base;
+    int value;
+} BoolNode;
+
+// Variable Node
+typedef struct {
+    TreeNode base;
+    char *name;
+} Var;
+
+// Not Node
+typedef struct {
+    TreeNode base;
+    TreeNode *child;
+} Not;
+
+// Or Node
+typedef struct {
+    TreeNode base;
+    TreeNode *left;
+    TreeNode *right;
+} Or;
+
+// And Node
+typedef struct {
+    TreeNode base;
+    TreeNode *left;
+    TreeNode *right;
+} And;
+
+
+// Token list definition
+typedef struct {
+    char **tokens;  // Array of token strings (each token is a dynamically allocated string)
+    char **types;
+    unsigned int *lines;    // Line of each token in the source, from 1
+    unsigned int *columns;  // Column of each token's first character, from 1
+    size_t size;    // Number of tokens stored
+    size_t capacity;  // Total list space used
+} TokenList;
+
+
+/* COMPILED FORMULA */
+
+// Operations of the compiled formula, children always come before their parents
+typedef enum {
+    OP_CONST,   // a = constant value
+    OP_INPUT,   // a = index of the declared variable
+    OP_NOT,     // a = child
+    OP_AND,     // a, b = children
+    OP_OR       // a, b = children
+} OpCode;
+
+typedef struct {
+    unsigned char op;
+    unsigned int a;
+    unsigned int b;
+} Instr;
+
+// Kinds of output statements
+typedef enum {
+    STMT_SHOW,
+    STMT_SHOW_ONES,
+    STMT_CHECK,     // First row where one of the names is true
+    STMT_EQUIV,     // First row where the two names differ
+    STMT_MINIMIZE   // Sum of products of an assignment, which replaces it afterwards
+} StatementKind;
+
+// An output statement (show, show_ones, check, equiv, minimize), resolved against the declarations seen so far
+typedef struct {
+    StatementKind kind;
+    size_t num_vars;        // Variables declared when the statement was reached
+    size_t num_outputs;
+    char **names;           // Shown identifiers, NULL terminated
+    unsigned int *outputs;  // Instruction computing each shown identifier
+    unsigned int *cone;     // Instructions the outputs depend on, in evaluation order
+    size_t cone_size;
+    char *report;           // Printed text of a minimize statement, NULL otherwise
+} Statement;
+
+// Name -> instruction table (open addressing)
+typedef struct {
+    char **keys;
+    unsigned int *values;
+    unsigned char *is_input; // 1 for declared variables, 0 for assignments
+    unsigned long size;
+    unsigned long count;
+} Symtab;
+
+typedef struct {
+    char **variables;       // Declared variables in declaration order, NULL terminated
+    size_t num_vars;
+
+    Instr *code;            // Structurally hashed instructions
+    size_t size;
+    size_t capacity;
+    unsigned int *buckets;  // Hash-consing table over code, 0 is empty (index + 1 otherwise)
+    unsigned long num_buckets;
+
+    Symtab symbols;
+
+    Statement *statements;
+    size_t num_statements;
+
+    uint64_t hash;          // Hash of the token stream the formula was compiled from
+} Formula;
+
+
+//utilities for arrays
+char** add(char **array, char *new_element);
+void free_array(char **array, size_t size);
+size_t len_array(char **array);
+size_t total_arrlen(char **array);
+void free_tree(TreeNode *node);
+int belongs_to(char **array, char *element);
+int startswith(char *string, char *prefix);
+
+//DICT prototypes
+unsigned long hash(const char *str, unsigned long size);
+Dict* initialize_dict(unsigned long size);
+void insert(Dict *assignments, const char *key, TreeNode *node);
+TreeNode* get(Dict *assignments, const char *key);
+TreeNode* take(Dict *assignments, const char *key);
+void free_dict(Dict* assignments);
+
+// AST constructors
+TreeNode* create_bool(int value);
+TreeNode* create_var(char *name);
+TreeNode* create_not(TreeNode *child);
+TreeNode* create_or(TreeNode* left, TreeNode* right);
+TreeNode* create_and(TreeNode *left, TreeNode *right);
+int evaluate_boolean(TreeNode *node, Dict *assignments);
+int evaluate_variable(TreeNode *node, Dict *assignments);
+int evaluate_not(TreeNode *node, Dict *assignments);
+int evaluate_or(TreeNode *node, Dict *assignments);
+int evaluate_and(TreeNode *node, Dict *assignments);
+
+// Tokenizer
+TokenList* create_token_list(size_t initial_capacity);
+void add_token(TokenList *list, const char *token, const char *type, unsigned int line, unsigned int column);
+void free_token_list(TokenList *list);
+TokenList* tokenize(char *input_data);
+int is_comment_or_empty(const char *line);
+int is_keyword(const char *word);
+
+// Parsing of the expression in tokens start..end-1, returns NULL and sets the message read by
+// parse_error() on malformed input
+TreeNode* parse_expression(const TokenList *token_list, size_t start, size_t end);
+const char* parse_error(void);
+
+// Allocation failures of compilation, evaluation and the LUT mapping end in allocation_failed(),
+// which exits unless out_of_memory is set (the Python extension sets it to raise MemoryError)
+extern void (*out_of_memory)(void);
+void allocation_failed(void);
+
+// Compilation
+Formula* create_formula(void);
+unsigned int emit_instr(Formula *formula, unsigned char op, unsigned int a, unsigned int b);
+void truncate_code(Formula *formula, size_t size);
+int compile_into(Formula *formula, TokenList *token_list, Dict *reuse, Dict *parsed, char *err, size_t err_len);
+Formula* compile_formula(TokenList *token_list, char *err, size_t err_len);
+Formula* compile_source(const char *text, size_t length, char *err, size_t err_len);
+void free_formula(Formula *formula);
+int lookup_symbol(const Symtab *table, const char *key, unsigned int *value, int *is_input);
+int resolve_outputs(const Formula *formula, Statement *stmt, StatementKind kind, char **names, size_t *unknown);
+void free_statement(Statement *stmt);
+void compute_cone(const Formula *formula, Statement *stmt);
+
+// Evaluation, 64 consecutive rows per word starting at base (a multiple of 64)
+extern const uint64_t low_bit_patterns[6];
+void eval_word(const Formula *formula, const Statement *stmt, unsigned long base, uint64_t *values);
+uint64_t valid_rows_mask(unsigned long rows, unsigned long base);
+uint64_t* alloc_values(const Formula *formula);
+
+// Rows are formatted into a local buffer and written out in large chunks
+#define OUTPUT_BUFFER_SIZE 65536
+
+typedef struct {
+    char data[OUTPUT_BUFFER_SIZE];
+    size_t used;
+    FILE *out;
+} OutputBuffer;
+
+struct Symmetry;  // symmetry.c
+
+// Show
+OutputBuffer* create_output_buffer(FILE *out);
+void flush_output(OutputBuffer *buffer);
+void emit_row(OutputBuffer *buffer, const Statement *stmt, unsigned long row,
+              const uint64_t *values, unsigned int bit);
+void print_header(const Statement *stmt, char **variables, FILE *out);
+void show(const Formula *formula, const Statement *stmt, FILE *out);
+void show_ones(const Formula *formula, const Statement *stmt, FILE *out);
+void show_rows(const Formula *formula, const Statement *stmt, unsigned long start,
+               unsigned long count, FILE *out);
+unsigned long count_ones(const Formula *formula, const Statement *stmt, struct Symmetry *symmetry);
+void run_statement(const Formula *formula, const Statement *stmt, FILE *out);
+int is_query(const Statement *stmt);
+
+// Other
+TokenList* read_file(const char *input_file);
+char* read_text(const char *input_file, size_t *length);
+uint64_t fnv1a(const void *data, size_t length);
+
+#define CHECKPOINT_INTERVAL 30.0  // Default seconds between checkpoints
+
+// Position of a run printing to a file with --checkpoint
+typedef struct {
+    const char *path;       // Checkpoint file
+    uint64_t hash;          // Hash of the formula being printed
+    size_t statement;       // Statement being printed
+    unsigned long row;      // Rows of that statement already in the output
+    double interval;        // Seconds between checkpoints
+    double last;            // When the last checkpoint was written
+} Progress;
+
+// Command line options of a normal run
+typedef struct {
+    size_t num_threads;   // -j n
+    size_t split;         // --split k, 0 picks the number of splitting variables from the threads
+    int verbose;          // -v, statistics on stderr
+    size_t shard_index;   // --shard i/N
+    size_t shard_count;   // 0 when not sharding
+    const char *output;   // -o file
+    size_t inflight;      // --inflight n, blocks of rows between evaluation and output, 0 for the default
+    const char *checkpoint;     // --checkpoint file
+    double checkpoint_interval; // --checkpoint-every seconds, 0 for the default
+    int resume;                 // --resume
+    Progress *progress;         // Checkpointing state, NULL when not checkpointing
+    int explain;                // --explain, print the plan of every statement instead of running it
+    unsigned long first_row;    // Rows of the statement already printed, with its header, by another engine
+    const struct Symmetry *symmetry;  // Outputs looked up on its evaluated points instead of evaluated, or NULL
+} Options;
+
+// Shannon-cofactor parallel evaluation (cofactor.c)
+void run_statement_parallel(const Formula *formula, const Statement *stmt, const Options *options, FILE *out);
+size_t split_variables(const Formula *formula, const Statement *stmt, const Options *options, int *split_bit);
+
+// Evaluation workers feeding a writer thread (pipeline.c)
+void run_statement_pipelined(const Formula *formula, const Statement *stmt, const Options *options, FILE *out);
+
+// Rows rendered in place in the mapped -o file (mapped.c)
+int run_statement_mapped(const Formula *formula, const Statement *stmt, const Options *options, FILE *out);
+
+// show_ones with three-valued prefix pruning (prune.c)
+#define PRUNE_LEAF_VARS 10  // Subcubes of at most 2^10 rows are evaluated without pruning
+unsigned long show_ones_pruned(const Formula *formula, const Statement *stmt, const Options *options,
+                               double deadline, FILE *out);
+double kleene_decided(const Formula *formula, const Statement *stmt, const int *fixed_bit,
+                      size_t num_fixed, unsigned long samples);
+
+// Classes of totally symmetric variables, evaluated over their weights (symmetry.c)
+#define SYMMETRY_MIN_VARS 12  // Smaller tables are counted directly
+#define SYMMETRY_BUDGET_SHARE 0.125  // Of the time evaluating every row takes, given to the solver
+#define MAX_SYMMETRY_BYTES (1UL << 28)  // Point columns and reach tables before the rows are evaluated instead
+typedef struct Symmetry {
+    size_t num_classes;
+    size_t *first;          // Start of each class in members, num_classes + 1 entries
+    size_t *members;        // Declared variables grouped by class, in declaration order
+    uint64_t *mask;         // Row bits of the variables of each class
+    unsigned long *stride;  // Step of the point index per variable of the class set
+    unsigned long points;   // Assignments of class weights, the product of the class sizes plus one
+    uint64_t *bits;         // Outputs on every point, one column per output, NULL until evaluated
+    uint64_t *reach;        // For each depth, points within the weights of a row prefix one of which is true
+    unsigned long low_point[64];  // Index of the point of each of the rows 0 to 63
+} Symmetry;
+
+void find_symmetry(const Formula *formula, const Statement *stmt, double budget, Symmetry *symmetry);
+int symmetry_pays(const Statement *stmt, const Symmetry *symmetry);
+void evaluate_symmetry(const Formula *formula, const Statement *stmt, Symmetry *symmetry);
+void lookup_word(const Statement *stmt, const Symmetry *symmetry, unsigned long base, uint64_t *values);
+unsigned long next_true_word(const Statement *stmt, const Symmetry *symmetry, unsigned long base, unsigned long end);
+unsigned long count_symmetric(const Statement *stmt, const Symmetry *symmetry);
+void free_symmetry(Symmetry *symmetry);
+
+// Engines printing a statement
+typedef enum {
+    ENGINE_REPORT,      // minimize: text computed when compiling
+    ENGINE_SAT,         // check, equiv: simulation of the first rows, then the SAT solver
+    ENGINE_SCAN,        // run_statement, 64 rows per word on the calling thread
+    ENGINE_PIPELINE,    // run_statement_pipelined
+    ENGINE_COFACTOR,    // run_statement_parallel
+    ENGINE_PRUNE,       // show_ones_pruned
+    ENGINE_MAPPED,      // run_statement_mapped
+    ENGINE_SYMMETRY,    // run_statement_pipelined on the points of find_symmetry
+    NUM_ENGINES
+} Engine;
+
+// Measurements of a statement and the engine picked for it (plan.c)
+typedef struct {
+    Engine engine;
+    Engine fallback;            // Takes over when the engine runs past its budget
+    double budget;              // Seconds, 0 for none
+    double cost[NUM_ENGINES];   // Estimated seconds, negative when the engine does not apply
+    size_t support;             // Declared variables the outputs depend on
+    double shared;              // Fraction of the cone used more than once
+    double word_seconds;        // Time of eval_word on one word
+    double density;             // Estimated fraction of the rows printed
+    double pruned;              // Estimated fraction of the rows pruning decides without evaluating
+    double folded;              // Estimated fraction of the cofactors folding to constants
+    size_t num_split;           // Splitting variables of the cofactor engine
+    Symmetry symmetry;          // Classes of symmetric variables, no classes when not looked for
+} Plan;
+
+void plan_statement(const Formula *formula, const Statement *stmt, const Options *options, Plan *plan);
+void explain_plan(const Formula *formula, const Statement *stmt, const Plan *plan, FILE *out);
+void run_planned(const Formula *formula, const Statement *stmt, Plan *plan, const Options *options, FILE *out);
+int plan_fusion(const Formula *formula, const Plan *plans, size_t first, const Options *options, size_t *end,
+                double *fused, double *separate);
+void free_plan(Plan *plan);
+
+// Consecutive statements printed from one sweep (fuse.c)
+void fused_statement(const Formula *formula, size_t first, size_t end, Statement *result);
+void run_fused(const Formula *formula, size_t first, size_t end, const Options *options, FILE *out);
+
+// Checkpoints of long runs (checkpoint.c)
+double now_seconds(void);
+void start_progress(Progress *progress);
+int checkpoint_due(const Progress *progress);
+int save_checkpoint(Progress *progress, int fd, long long offset);
+int load_checkpoint(Progress *progress, const Formula *formula, long long *offset, char *err, size_t err_len);
+
+// Sharding of the row space and merging of the shards (shard.c)
+int write_shard(const Formula *formula, size_t index, size_t count, const char *path);
+int merge_main(int argc, char *argv[]);
+
+// check and equiv statements, answered by simulation and a SAT solver (sat.c)
+void run_query(const Formula *formula, const Statement *stmt, double budget, FILE *out);
+int check_satisfiable(const Formula *formula, const Statement *stmt, double deadline);
+
+// k-LUT mapping of a statement's cone (lut.c)
+void map_luts(Formula *formula, Statement *stmt);
+
+// Two-level minimization of an assignment (minimize.c)
+unsigned int minimize_instr(Formula *formula, const char *name, unsigned int instr, char **report);
+
+// Watch mode (watch.c)
+int watch(const char *input_file);
+
+// Server mode and its load generator (server.c)
+int server_main(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,654 @@
+# Tests of the C binary, run from anywhere with
+#     python3 truth_table_C/tests/test_table.py
+# The binary and the unit tests of units.c are built into a temporary directory first, so the
+# checked in binary is left alone.
+import io
+import itertools
+import os
+import random
+import re
+import shutil
+import socket
+import subprocess
+import tempfile
+import threading
+import time
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOURCES = os.path.dirname(HERE)
+BUILD = tempfile.mkdtemp(prefix="table_tests_")
+TABLE = os.path.join(BUILD, "table")
+UNITS = os.path.join(BUILD, "units")  # tests/units.c, linked with the sources but not main
+
+
+def setUpModule():
+    sources = sorted(os.path.join(SOURCES, name) for name in os.listdir(SOURCES) if name.endswith(".c"))
+    compiler = [os.environ.get("CC", "cc"), "-O2", "-Wall", "-pthread"]
+    subprocess.run(compiler + ["-o", TABLE] + sources, check=True)
+    subprocess.run(compiler + ["-DTABLE_NO_MAIN", "-o", UNITS, os.path.join(HERE, "units.c")] + sources, check=True)
+
+
+def tearDownModule():
+    shutil.rmtree(BUILD, ignore_errors=True)
+
+
+def write_input(text):
+    path = os.path.join(BUILD, "input_%d.txt" % write_input.count)
+    write_input.count += 1
+    with open(path, "w") as f:
+        f.write(text)
+    return path
+
+
+write_input.count = 0
+
+
+def run_table(*args):
+    result = subprocess.run([TABLE] + list(args), capture_output=True, text=True, timeout=120)
+    return result.returncode, result.stdout, result.stderr
+
+
+class UnitTestCase(unittest.TestCase):
+    # Runs one test of units.c
+    def run_unit(self, name):
+        result = subprocess.run([UNITS, name], capture_output=True, text=True, timeout=120)
+        self.assertEqual(result.returncode, 0, result.stderr)
+
+
+class WatchTest(unittest.TestCase):
+    # Saves text the way editors that write a new file and rename it over the old one do
+    def save(self, path, text):
+        with open(path + ".new", "w") as f:
+            f.write(text)
+        os.replace(path + ".new", path)
+
+    # Reads the tables printed for text, returns the report that follows them on stderr
+    def reprint(self, process, text):
+        _, expected, _ = run_table(write_input(text))
+        printed = "".join(process.stdout.readline() for _ in expected.splitlines())
+        self.assertEqual(printed, expected)
+        return process.stderr.readline().rstrip("\n")
+
+    def test_reprints_after_each_save(self):
+        first = "var a b c;\nx = a and b;\ny = b or c;\nshow x y;\nshow_ones y;\n"
+        path = write_input(first)
+        process = subprocess.Popen([TABLE, "--watch", path], stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                                   text=True)
+        timer = threading.Timer(60, process.kill)  # a reprint that never comes fails instead of hanging
+        timer.start()
+        try:
+            report = self.reprint(process, first)
+            self.assertEqual(report, "watch: 2 of 2 expressions reparsed, 2 of 2 columns evaluated")
+
+            # x is neither reparsed nor evaluated again
+            second = first.replace("b or c", "not c")
+            with open(path, "w") as f:
+                f.write(second)
+            report = self.reprint(process, second)
+            self.assertEqual(report, "watch: 1 of 2 expressions reparsed, 1 of 2 columns evaluated")
+
+            # a malformed save is reported, and the columns of the last good one are kept
+            self.save(path, second.replace("not c", "not"))
+            self.assertFalse(process.stderr.readline().startswith("watch:"))
+            third = second.replace("a and b", "a or b")
+            self.save(path, third)
+            report = self.reprint(process, third)
+            self.assertEqual(report, "watch: 2 of 2 expressions reparsed, 1 of 2 columns evaluated")
+        finally:
+            timer.cancel()
+            process.kill()
+            process.wait()
+
+
+COFACTORED = ("var %s;\n" % " ".join("a%d" % j for j in range(14)) +
+              "x = a0 and a1 and (a2 or a3) and not (a4 and a5) and (a6 or a9 or a12);\n"
+              "y = (a0 and not a7) or (a8 and a9 and a10 and a11) or (a13 and a2);\n"
+              "show_ones x;\nshow x y;\nvar b;\nz = (x and b) or (y and not b);\nshow_ones z y;\n")
+
+
+class CofactorTest(unittest.TestCase):
+    def test_cofactors_are_printed_in_row_order(self):
+        path = write_input(COFACTORED)
+        _, expected, _ = run_table(path)
+        for threads, split in [(1, 1), (3, 4), (4, 8), (2, 20)]:
+            code, out, err = run_table("-j", str(threads), "--split", str(split), path)
+            self.assertEqual((code, out), (0, expected), "-j %d --split %d: %s" % (threads, split, err))
+
+    def test_conjunctions_fold(self):
+        code, _, err = run_table("-j", "2", "--split", "4", "-v", write_input(COFACTORED))
+        self.assertEqual(code, 0)
+        # x is false unless a0 and a1 are set, and false again on a4 and a5
+        self.assertIn("cofactors: 13 of 16 folded to constants (split on 4 variables)", err)
+
+
+SHARDED = ("var a b c d e f g h i j;\nx = (a and b) or (c and not d) or (e and f and g);\nshow x;\nshow_ones x;\n"
+           "var k l;\ny = x and (k or l) and not (h and j);\nshow_ones y;\nshow x y;\n")
+
+
+class ShardTest(unittest.TestCase):
+    def shards(self, text, count, prefix):
+        path = write_input(text)
+        paths = []
+        for i in range(count):
+            paths.append(os.path.join(BUILD, "%s%d.tts" % (prefix, i)))
+            code, _, err = run_table("--shard", "%d/%d" % (i, count), "-o", paths[-1], path)
+            self.assertEqual(code, 0, err)
+        return paths
+
+    def assertMergeFails(self, paths, message):
+        code, out, err = run_table("merge", *paths)
+        self.assertNotEqual(code, 0)
+        self.assertEqual(out, "")
+        self.assertIn(message, err)
+
+    def test_merge_is_the_direct_run(self):
+        _, expected, _ = run_table(write_input(SHARDED))
+        parts = self.shards(SHARDED, 3, "round")
+        code, out, err = run_table("merge", parts[2], parts[0], parts[1])
+        self.assertEqual((code, out), (0, expected), err)
+
+        whole = os.path.join(BUILD, "whole.tts")
+        code, _, err = run_table("merge", "--binary", "-o", whole, *parts)
+        self.assertEqual(code, 0, err)
+        self.assertEqual(run_table("merge", whole)[:2], (0, expected))
+
+    def test_merge_rejects_incomplete_sets(self):
+        parts = self.shards(SHARDED, 3, "set")
+        self.assertMergeFails(parts[:2], "expected 3 shards, got 2")
+        self.assertMergeFails([parts[0], parts[0], parts[1]], "duplicate or invalid shard index 0")
+
+        halves = self.shards(SHARDED, 2, "half")
+        self.assertMergeFails([halves[0]] + parts[1:], "expected 2 shards, got 3")
+        other = self.shards(SHARDED.replace("e and f and g", "e or f or g"), 2, "other")
+        self.assertMergeFails([halves[0], other[1]], "come from different formulas or shard counts")
+
+    def test_merge_rejects_damaged_files(self):
+        parts = self.shards(SHARDED, 3, "damaged")
+        with open(parts[1], "rb") as f:
+            data = f.read()
+
+        truncated = os.path.join(BUILD, "truncated.tts")
+        with open(truncated, "wb") as f:
+            f.write(data[:-100])
+        self.assertMergeFails([parts[0], truncated, parts[2]], "truncated shard")
+
+        # a statement of another shape, with the formula hash left as it was
+        reshaped = os.path.join(BUILD, "reshaped.tts")
+        with open(reshaped, "wb") as f:
+            f.write(data.replace(b"statement show 10", b"statement show_ones 10", 1))
+        self.assertMergeFails([parts[0], reshaped, parts[2]], "differ in statement 0")
+
+        self.assertMergeFails([write_input(SHARDED)], "not a shard file")
+
+    def test_queries_are_not_sharded(self):
+        path = write_input("var a b;\nz = a and b;\ncheck z;\n")
+        code, _, err = run_table("--shard", "0/2", "-o", os.path.join(BUILD, "query.tts"), path)
+        self.assertNotEqual(code, 0)
+        self.assertIn("cannot be sharded", err)
+
+
+# Random formula over the given variables, as text
+def random_expression(rng, names, depth):
+    if depth == 0 or rng.random() < 0.15:
+        name = rng.choice(names)
+        return name if rng.random() < 0.7 else "not " + name
+    op = rng.choice(["and", "or", "and", "or", "not"])
+    if op == "not":
+        return "not (%s)" % random_expression(rng, names, depth - 1)
+    return "(%s %s %s)" % (random_expression(rng, names, depth - 1), op, random_expression(rng, names, depth - 1))
+
+
+# Function of an expression in the input syntax, which is also Python, as a set of minterms over names
+def minterms(expression, names):
+    code = compile(expression, "<formula>", "eval")
+    result = set()
+    for values in itertools.product([False, True], repeat=len(names)):
+        if eval(code, {}, dict(zip(names, values))):
+            result.add(values)
+    return result
+
+
+# The products of a printed cover, as {name: value} literals
+def cover_cubes(cover):
+    if cover == "False":
+        return []
+    cubes = []
+    for term in cover.split(" or "):
+        cube = {}
+        for literal in term.strip("()").split(" and "):
+            if literal != "True":
+                cube[literal.split()[-1]] = not literal.startswith("not ")
+        cubes.append(cube)
+    return cubes
+
+
+def cube_minterms(cube, names):
+    return set(itertools.product(*[[cube[name]] if name in cube else [False, True] for name in names]))
+
+
+# Fewest products, then fewest literals, of a cover of on by prime implicants, by exhaustive search
+def minimum_cover(on, names):
+    cubes = []
+    for signs in itertools.product([None, False, True], repeat=len(names)):
+        cube = {name: sign for name, sign in zip(names, signs) if sign is not None}
+        if cube_minterms(cube, names) <= on:
+            cubes.append(cube)
+    primes = [c for c in cubes if not any(d != c and d.items() < c.items() for d in cubes)]
+    for count in range(len(on) + 1):
+        best = None
+        for chosen in itertools.combinations(primes, count):
+            if set().union(*(cube_minterms(c, names) for c in chosen)) == on:
+                literals = sum(len(c) for c in chosen)
+                best = literals if best is None else min(best, literals)
+        if best is not None:
+            return count, best
+
+
+class MinimizeTest(unittest.TestCase):
+    # Minimizes z = expression, returns the terms and literals reported and the printed cover
+    def minimize(self, names, expression):
+        text = "var %s;\nz = %s;\nminimize z;\n" % (" ".join(names), expression)
+        code, out, err = run_table(write_input(text))
+        self.assertEqual(code, 0, err)
+        report, assignment = out.splitlines()
+        found = re.match(r"# minimize z: (\d+) terms, (\d+) literals, \d+ -> \d+ instructions \((\w+)\)", report)
+        self.assertIsNotNone(found, report)
+        self.assertTrue(assignment.startswith("z = ") and assignment.endswith(";"), assignment)
+        return int(found.group(1)), int(found.group(2)), found.group(3), assignment[4:-1]
+
+    def test_exact_covers_are_minimum(self):
+        rng = random.Random(310)
+        for case in range(40):
+            names = ["a", "b", "c", "d"][:rng.randint(2, 4)]
+            expression = random_expression(rng, names, 4)
+            support = [name for name in names if re.search(r"\b%s\b" % name, expression)]
+            on = minterms(expression, support)
+            terms, literals, method, cover = self.minimize(names, expression)
+            self.assertEqual(method, "exact")
+            self.assertEqual(minterms(cover, support), on, expression)
+            cubes = cover_cubes(cover)
+            self.assertEqual((len(cubes), sum(len(c) for c in cubes)), (terms, literals))
+            self.assertEqual((terms, literals), minimum_cover(on, support), expression)
+
+    def test_heuristic_covers_are_prime(self):
+        rng = random.Random(311)
+        names = ["a%d" % j for j in range(14)]
+        cases = 0
+        while cases < 3:
+            expression = "(%s) and (%s)" % (random_expression(rng, names, 5), random_expression(rng, names, 5))
+            support = [name for name in names if re.search(r"\b%s\b" % name, expression)]
+            if len(support) <= 12:
+                continue  # exact
+            on = minterms(expression, support)
+            if len(on) in (0, 2 ** len(support)):
+                continue  # constant
+            cases += 1
+            terms, literals, method, cover = self.minimize(names, expression)
+            self.assertEqual(method, "heuristic")
+            self.assertEqual(minterms(cover, support), on, expression)
+            # no literal can be dropped from a product without covering a row outside the function
+            for cube in cover_cubes(cover):
+                for name in cube:
+                    wider = {n: v for n, v in cube.items() if n != name}
+                    self.assertFalse(cube_minterms(wider, support) <= on, cover)
+
+    def test_factored_form_is_kept(self):
+        # the 8 products of the sum have more instructions than the 3 factors
+        text = "var a b c d e f;\nz = (a or b) and (c or d) and (e or f);\nminimize z;\nshow z;\n"
+        code, out, _ = run_table(write_input(text))
+        self.assertEqual(code, 0)
+        report = out.splitlines()
+        self.assertRegex(report[0], r"^# minimize z: 8 terms, 24 literals, 11 -> \d+ instructions \(exact\), original kept$")
+        self.assertEqual(report[1].count(" or "), 7)
+
+        code, out, _ = run_table("--explain", write_input(text))
+        self.assertIn("show z\n  6 variables, support 6 (z 6), cone of 11 instructions", out)
+
+    def test_smaller_cover_replaces(self):
+        text = "var a b c;\nz = (a and b) or (a and not b) or (a and c);\nminimize z;\nshow z;\n"
+        code, out, _ = run_table(write_input(text))
+        report = out.splitlines()
+        self.assertRegex(report[0], r"^# minimize z: 1 terms, 1 literals, \d+ -> 1 instructions \(exact\)$")
+        self.assertEqual(report[1], "z = a;")
+
+        code, out, _ = run_table("--explain", write_input(text))
+        self.assertIn("show z\n  3 variables, support 1 (z 1), cone of 1 instructions", out)
+
+
+class CheckpointTest(unittest.TestCase):
+    TEXT = "var %s;\nf = a0 and (a1 or not a2);\ng = a3 or a4;\nshow f;\nshow_ones g;\n" % " ".join(
+        "a%d" % j for j in range(21))
+
+    def test_killed_run_resumes_to_the_same_file(self):
+        path = write_input(self.TEXT)
+        expected = os.path.join(BUILD, "uninterrupted.txt")
+        self.assertEqual(run_table("-o", expected, path)[0], 0)
+
+        output = os.path.join(BUILD, "resumed.txt")
+        checkpoint = os.path.join(BUILD, "run.ckpt")
+        process = subprocess.Popen([TABLE, "--checkpoint", checkpoint, "--checkpoint-every", "0.01", "-o", output, path])
+        # killed once a checkpoint lies inside the first statement, rows printed after it left in the file
+        fields = []
+        while process.poll() is None and not (len(fields) == 5 and int(fields[3]) > 0):
+            try:
+                with open(checkpoint) as f:
+                    fields = f.read().split()
+            except FileNotFoundError:
+                pass
+            time.sleep(0.002)
+        process.kill()
+        process.wait()
+        self.assertTrue(fields[2:3] == ["0"], "the run finished its first statement before being killed")
+
+        code, _, err = run_table("--checkpoint", checkpoint, "--resume", "-o", output, path)
+        self.assertEqual(code, 0, err)
+        self.assertFalse(os.path.exists(checkpoint))
+        with open(expected, "rb") as a, open(output, "rb") as b:
+            self.assertTrue(a.read() == b.read())
+
+
+# Frames a request as the server expects it
+def frame(request_id, query, text):
+    data = text.encode()
+    return b"%s %d %s\n" % (request_id.encode(), len(data), query.encode()) + data
+
+
+# Reads one framed reply, returns (id, status, payload)
+def read_reply(stream):
+    header = stream.readline()
+    if not header:
+        return None
+    request_id, status, length = header.decode().split()
+    return request_id, status, stream.read(int(length)).decode()
+
+
+class Server:
+    def __init__(self, *args):
+        self.path = os.path.join(BUILD, "server_%d.sock" % os.getpid())
+        self.process = subprocess.Popen([TABLE, "--serve", "--socket", self.path] + list(args),
+                                        stderr=subprocess.PIPE, text=True)
+        deadline = time.time() + 10
+        while not os.path.exists(self.path):
+            if time.time() > deadline or self.process.poll() is not None:
+                raise RuntimeError("server did not start")
+            time.sleep(0.01)
+
+    def connect(self):
+        connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        connection.connect(self.path)
+        return connection
+
+    # Sends frames on a new connection and returns the replies read back
+    def exchange(self, data, count):
+        with self.connect() as connection:
+            connection.sendall(data)
+            stream = connection.makefile("rb")
+            return [read_reply(stream) for _ in range(count)]
+
+    # Stops the server and returns what it printed on stderr
+    def stop(self):
+        self.process.terminate()
+        _, err = self.process.communicate(timeout=10)
+        return err
+
+
+XOR = "var x y;\nz = (x or y) and (not (x and y));\nshow z;\n"
+
+
+class ServerTest(unittest.TestCase):
+    def test_oversized_frame_is_refused(self):
+        server = Server("--max-frame", "1024")
+        try:
+            with server.connect() as connection:
+                connection.sendall(b"1 99999999999999 run\n")
+                stream = connection.makefile("rb")
+                request_id, status, message = read_reply(stream)
+                self.assertEqual((request_id, status), ("1", "ERR"))
+                self.assertIn("1024", message)
+                self.assertEqual(stream.read(), b"")  # the connection is closed
+
+            data = frame("2", "run", "var x;\n" + " " * 2000 + "show x;\n")
+            self.assertEqual(server.exchange(data, 1)[0][:2], ("2", "ERR"))
+
+            # the server is still up and answers normal requests
+            self.assertEqual(server.exchange(frame("3", "count z", XOR), 1), [("3", "OK", "2\n")])
+            self.assertIsNone(server.process.poll())
+        finally:
+            server.stop()
+
+    def test_pipelined_requests(self):
+        server = Server("--threads", "2")
+        try:
+            data = (frame("a", "count z", XOR) + frame("b", "show_ones z", XOR) + frame("c", "rows 1 2 z", XOR) +
+                    frame("d", "frob z", XOR) + frame("e", "count q", XOR) + frame("f", "run", XOR))
+            replies = server.exchange(data, 6)
+            self.assertEqual(replies[0], ("a", "OK", "2\n"))
+            self.assertEqual(replies[1], ("b", "OK", "# x y z\n0 1 1\n1 0 1\n"))
+            self.assertEqual(replies[2], ("c", "OK", "# x y z\n0 1 1\n1 0 1\n"))
+            self.assertEqual(replies[3], ("d", "ERR", "Unknown query frob"))
+            self.assertEqual(replies[4], ("e", "ERR", "Undeclared variable q"))
+            self.assertEqual(replies[5], ("f", "OK", "# x y z\n0 0 0\n0 1 1\n1 0 1\n1 1 0\n"))
+
+            # a request cut anywhere, here into single bytes, is read whole
+            with server.connect() as connection:
+                for byte in frame("g", "count z", XOR):
+                    connection.sendall(bytes([byte]))
+                self.assertEqual(read_reply(connection.makefile("rb")), ("g", "OK", "2\n"))
+
+            # a header without a length ends the connection
+            with server.connect() as connection:
+                connection.sendall(b"h\n")
+                stream = connection.makefile("rb")
+                self.assertEqual(read_reply(stream), ("-", "ERR", "malformed frame"))
+                self.assertEqual(stream.read(), b"")
+        finally:
+            server.stop()
+
+    def test_connections_share_a_worker(self):
+        server = Server("--threads", "1")
+        try:
+            with server.connect() as first, server.connect() as second:
+                first.settimeout(10)
+                second.settimeout(10)
+                first_stream, second_stream = first.makefile("rb"), second.makefile("rb")
+                # the only worker is not kept by the first connection while it stays open
+                first.sendall(frame("a", "count z", XOR))
+                self.assertEqual(read_reply(first_stream), ("a", "OK", "2\n"))
+                second.sendall(frame("b", "count z", XOR) + frame("c", "rows 0 1 z", XOR))
+                self.assertEqual(read_reply(second_stream), ("b", "OK", "2\n"))
+                self.assertEqual(read_reply(second_stream), ("c", "OK", "# x y z\n0 0 0\n"))
+                first.sendall(frame("d", "count z", XOR))
+                self.assertEqual(read_reply(first_stream), ("d", "OK", "2\n"))
+        finally:
+            server.stop()
+
+    def test_cache_is_least_recently_used(self):
+        server = Server("--cache", "2")
+        texts = {name: "var x y;\n%s = x and y;\nshow %s;\n" % (name, name) for name in "abc"}
+        try:
+            # a, b, a again (hit), c evicts b, b evicts a, a again
+            for i, name in enumerate("abacba"):
+                reply = server.exchange(frame(str(i), "count " + name, texts[name]), 1)[0]
+                self.assertEqual(reply, (str(i), "OK", "1\n"))
+        finally:
+            err = server.stop()
+        self.assertIn("cache: 1 hits, 5 misses", err)
+
+    def test_requests_on_stdin(self):
+        data = b"".join(frame(str(i), "count z", XOR) for i in range(20))
+        result = subprocess.run([TABLE, "--serve", "--threads", "4"], input=data, capture_output=True, timeout=30)
+        self.assertEqual(result.returncode, 0)
+        replies = []
+        stream = io.BytesIO(result.stdout)
+        while True:
+            reply = read_reply(stream)
+            if reply is None:
+                break
+            replies.append(reply)
+        self.assertEqual(sorted(replies), sorted((str(i), "OK", "2\n") for i in range(20)))
+        # workers missing at the same time each compile the text, once at most
+        hits, misses = map(int, re.search(rb"cache: (\d+) hits, (\d+) misses", result.stderr).groups())
+        self.assertEqual(hits + misses, 20)
+        self.assertTrue(1 <= misses <= 4)
+
+    def test_oversized_frame_on_stdin(self):
+        data = frame("1", "count z", XOR) + b"2 99999999999999 run\n"
+        result = subprocess.run([TABLE, "--serve"], input=data, capture_output=True, timeout=30)
+        self.assertEqual(result.returncode, 0)
+        self.assertIn(b"1 OK 2\n2\n", result.stdout)
+        self.assertIn(b"2 ERR ", result.stdout)
+
+
+VARIABLES = " ".join("a%d" % j for j in range(20))
+
+
+# Fraction of the rows --explain expects the first statement to print
+def explained_density(text):
+    code, out, _ = run_table("--explain", write_input(text))
+    if code != 0:
+        raise RuntimeError("--explain failed")
+    return float(re.search(r"([0-9.]+)% of the rows printed", out).group(1)) / 100
+
+
+class PlannerTest(unittest.TestCase):
+    def test_density_of_every_variable(self):
+        # a variable on any bit of the row, in the word or in the word index, is sampled both ways
+        for j in range(20):
+            density = explained_density("var %s;\nf = a%d;\nshow_ones f;\n" % (VARIABLES, j))
+            self.assertTrue(0.35 <= density <= 0.65, "a%d: %g" % (j, density))
+
+    def test_density_on_low_word_bits(self):
+        # a12 and a13 are row bits 7 and 6, the low bits of the index of a word
+        density = explained_density("var %s;\nf = a12 or a13;\nshow_ones f;\n" % VARIABLES)
+        self.assertAlmostEqual(density, 0.75, delta=0.1)
+
+
+class LutTest(UnitTestCase):
+    def test_rejected_mapping(self):
+        self.run_unit("lut_rejected_mapping")
+
+
+class EngineTest(UnitTestCase):
+    # every engine forced on statements the planner would give it, against the scan
+    def test_cofactor(self):
+        self.run_unit("engine_cofactor")
+
+    def test_fusion(self):
+        self.run_unit("engine_fusion")
+
+    def test_mapped(self):
+        self.run_unit("engine_mapped")
+
+    def test_pipeline(self):
+        self.run_unit("engine_pipeline")
+
+    def test_prune(self):
+        self.run_unit("engine_prune")
+
+    def test_prune_past_its_budget(self):
+        self.run_unit("prune_budget")
+
+    def test_symmetry(self):
+        self.run_unit("engine_symmetry")
+
+
+class SymmetryTest(UnitTestCase):
+    def test_pipeline_lookup(self):
+        self.run_unit("symmetry_pipeline")
+
+    def test_true_words(self):
+        self.run_unit("symmetry_true_words")
+
+    def test_wide_asymmetric_statement(self):
+        # 28 variables chained into 27 classes: three quarters of the rows are points, whose reach
+        # tables would take gigabytes
+        names = ["a%d" % j for j in range(28)]
+        terms = ["(a0 and a1)"] + ["(%s and not %s)" % (names[j], names[j + 1]) for j in range(2, 27)]
+        text = "var %s;\nf = %s;\nshow_ones f;\n" % (" ".join(names), " or ".join(terms))
+        code, out, _ = run_table("--explain", write_input(text))
+        self.assertEqual(code, 0)
+        self.assertIn("weight assignments (too many to evaluate)", out)
+        self.assertNotRegex(out, r"\n  symmetry ")
+
+
+# The same function with and/or swapped under a negation (De Morgan), which structural hashing does not undo
+def de_morgan(expression):
+    swapped = expression.replace(" and ", " AND ").replace(" or ", " and ").replace(" AND ", " or ")
+    return "not (%s)" % re.sub(r"\b(a\d+)\b", r"(not \1)", swapped)
+
+
+# The first row of show_ones, without the outputs, or None when it prints none
+def first_row(variables, definitions, name):
+    code, out, _ = run_table(write_input("var %s;\n%sshow_ones %s;\n" % (variables, definitions, name)))
+    rows = out.splitlines()[1:]
+    return " ".join(rows[0].split()[:-1]) if rows else None
+
+
+class QueryTest(UnitTestCase):
+    # 20 variables, and a0 and a1 in front of every formula: the answers lie past the 65536 rows
+    # simulated first, so the solver finds them
+    NAMES = ["a%d" % j for j in range(20)]
+
+    def query(self, definitions, statement):
+        code, out, err = run_table(write_input("var %s;\n%s%s;\n" % (" ".join(self.NAMES), definitions, statement)))
+        self.assertEqual(code, 0, err)
+        return out.splitlines()
+
+    def test_check_against_show_ones(self):
+        rng = random.Random(30)
+        variables = " ".join(self.NAMES)
+        for case in range(12):
+            r = random_expression(rng, self.NAMES[2:], 6)
+            definitions = "r = %s;\nz = a0 and a1 and r;\n" % r
+            if case % 3 == 2:
+                definitions += "u = z and not (%s);\n" % de_morgan(r)  # never true
+                name = "u"
+            else:
+                name = "z"
+            expected = first_row(variables, definitions, name)
+            lines = self.query(definitions, "check " + name)
+            if expected is None:
+                self.assertEqual(lines, ["# check %s: UNSAT" % name])
+            else:
+                self.assertEqual(lines[0], "# check %s: SAT" % name)
+                self.assertEqual(lines[1], "# %s %s" % (variables, name))
+                self.assertEqual(lines[2], expected + " 1")
+
+    def test_equiv_against_show_ones(self):
+        rng = random.Random(31)
+        variables = " ".join(self.NAMES)
+        for case in range(12):
+            r = random_expression(rng, self.NAMES[2:], 6)
+            other = de_morgan(r) if case % 2 == 0 else random_expression(rng, self.NAMES[2:], 6)
+            definitions = "x = a0 and a1 and %s;\ny = a0 and a1 and %s;\nd = (x and not y) or (y and not x);\n" % (r, other)
+            expected = first_row(variables, definitions, "d")
+            lines = self.query(definitions, "equiv x y")
+            if expected is None:
+                self.assertEqual(lines, ["# equiv x y: EQUIVALENT"])
+            else:
+                self.assertEqual(lines[0], "# equiv x y: DIFFERENT")
+                self.assertEqual(" ".join(lines[2].split()[:-2]), expected)
+            if case % 2 == 0:
+                self.assertIsNone(expected)
+
+    def test_solver_deadline(self):
+        self.run_unit("sat_deadline")
+
+
+class CompileErrorTest(unittest.TestCase):
+    def assertFails(self, text, message):
+        code, out, err = run_table(write_input(text))
+        self.assertEqual(code, 1)
+        self.assertEqual(out, "")
+        self.assertEqual(err.strip(), message)
+
+    def test_undeclared_in_expression(self):
+        self.assertFails("var a b;\nf = a and\n  (b or zz or zz);\nshow f;\n", "line 3, column 9: Undeclared variable zz")
+
+    def test_undeclared_in_show(self):
+        self.assertFails("var a b;\nf = a;\nshow f\n  g;\n", "line 4, column 3: Undeclared variable g")
+
+
+if __name__ == "__main__":
+    unittest.main()
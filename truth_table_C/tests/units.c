@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../table.h"
+
+/*
+ * Unit tests of the engines, built by test_table.py with the sources of the binary (table.c
+ * without its main). "units <name>" runs one test, prints what failed and exits with 1 when
+ * something did.
+ */
+
+static int failures = 0;
+
+#define EXPECT(condition) do { \
+        if (!(condition)){ \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static Formula* compile(const char *text){
+    char err[256];
+    Formula *formula = compile_source(text, strlen(text), err, sizeof(err));
+    if (formula == NULL){
+        fprintf(stderr, "%s\n", err);
+        exit(1);
+    }
+    return formula;
+}
+
+// Everything written to out since it was created, out is closed
+static char* contents(FILE *out){
+    fflush(out);
+    long length = ftell(out);
+    char *text = malloc(length + 1);
+    if (text == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    rewind(out);
+    text[fread(text, 1, length, out)] = '\0';
+    fclose(out);
+    return text;
+}
+
+static FILE* open_temporary(void){
+    FILE *out = tmpfile();
+    if (out == NULL){
+        perror("tmpfile");
+        exit(1);
+    }
+    return out;
+}
+
+static size_t count_lines(const char *text){
+    size_t lines = 0;
+    for (; *text; text++){
+        lines += *text == '\n';
+    }
+    return lines;
+}
+
+/* LUT MAPPING */
+
+// A mapping that does not shrink the cone leaves neither instructions nor hash entries behind
+static void test_lut_rejected_mapping(void){
+    const char *shown = "var a b c d e f;\n"
+                        "g = ((((f or not e) and (d or f)) or (c and (b or b))) and (b or (d or f)));\nshow g;\n";
+    const char *checked = "var a b c d e f;\n"
+                          "g = ((((f or not e) and (d or f)) or (c and (b or b))) and (b or (d or f)));\ncheck g;\n";
+    Formula *formula = compile(shown);
+    Formula *unmapped = compile(checked);  // queries are not mapped
+    EXPECT(formula->statements[0].cone_size == unmapped->statements[0].cone_size);
+    EXPECT(formula->size == unmapped->size);
+
+    size_t size = formula->size;
+    for (size_t i = 0; i < size; i++){
+        Instr in = formula->code[i];
+        if (in.op == OP_NOT || in.op == OP_AND || in.op == OP_OR){
+            EXPECT(emit_instr(formula, in.op, in.a, in.b) == i);
+        }
+    }
+    EXPECT(formula->size == size);
+    free_formula(unmapped);
+    free_formula(formula);
+}
+
+/* SYMMETRY */
+
+// Two classes of 7 variables declared interleaved, and c symmetric with nothing
+static const char *symmetric_text =
+    "var a3 b0 a1 b4 a0 b6 a5 b2 a2 b5 a6 b1 a4 b3 c;\n"
+    "all_a = a0 and a1 and a2 and a3 and a4 and a5 and a6;\n"
+    "any_a = a0 or a1 or a2 or a3 or a4 or a5 or a6;\n"
+    "all_b = b0 and b1 and b2 and b3 and b4 and b5 and b6;\n"
+    "any_b = b0 or b1 or b2 or b3 or b4 or b5 or b6;\n"
+    "f = (all_a or not any_a) and any_b and not all_b;\n"
+    "g = (any_a and not all_a) or (all_b and c);\n"
+    "h = all_a and all_b and c;\n"
+    "show_ones f;\n"
+    "show_ones g;\n"
+    "show_ones h;\n"
+    "show f g;\n";
+
+// The pipeline looking the rows up, and skipping the words below no true point, prints what the scan does
+static void test_symmetry_pipeline(void){
+    Formula *formula = compile(symmetric_text);
+    for (size_t s = 0; s < formula->num_statements; s++){
+        const Statement *stmt = &formula->statements[s];
+        Symmetry symmetry;
+        find_symmetry(formula, stmt, 1.0, &symmetry);
+        EXPECT(symmetry.num_classes < stmt->num_vars);
+        evaluate_symmetry(formula, stmt, &symmetry);
+
+        FILE *out = open_temporary();
+        run_statement(formula, stmt, out);
+        char *expected = contents(out);
+
+        Options options;
+        memset(&options, 0, sizeof(options));
+        options.num_threads = 2;
+        options.inflight = 2;
+        options.symmetry = &symmetry;
+        out = open_temporary();
+        run_statement_pipelined(formula, stmt, &options, out);
+        char *looked_up = contents(out);
+        EXPECT(strcmp(expected, looked_up) == 0);
+
+        if (stmt->kind == STMT_SHOW_ONES){
+            EXPECT(count_ones(formula, stmt, &symmetry) == count_lines(expected) - 1);
+        }
+        free(looked_up);
+        free(expected);
+        free_symmetry(&symmetry);
+    }
+    free_formula(formula);
+}
+
+// next_true_word stops at exactly the words with a row where an output is true
+static void test_symmetry_true_words(void){
+    Formula *formula = compile(symmetric_text);
+    uint64_t *values = alloc_values(formula);
+    for (size_t s = 0; s < formula->num_statements; s++){
+        const Statement *stmt = &formula->statements[s];
+        Symmetry symmetry;
+        find_symmetry(formula, stmt, 1.0, &symmetry);
+        evaluate_symmetry(formula, stmt, &symmetry);
+
+        unsigned long rows = 1UL << stmt->num_vars;
+        for (unsigned long start = 0; start < rows; start += 64 * 37){
+            unsigned long expected = rows;
+            for (unsigned long base = start; base < rows && expected == rows; base += 64){
+                eval_word(formula, stmt, base, values);
+                for (size_t j = 0; j < stmt->num_outputs; j++){
+                    if (values[stmt->outputs[j]] != 0){
+                        expected = base;
+                    }
+                }
+            }
+            EXPECT(next_true_word(stmt, &symmetry, start, rows) == expected);
+        }
+        free_symmetry(&symmetry);
+    }
+    free(values);
+    free_formula(formula);
+}
+
+/* SAT */
+
+// Parity of n variables xored in two orders, hard for the solver: equivalent, or differing on
+// the rows where the first three variables are set
+static Formula* parity_miter(size_t n, int differ){
+    char *text = malloc(128 * n + 256);
+    if (text == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    char *p = text;
+    p += sprintf(p, "var");
+    for (size_t i = 0; i < n; i++){
+        p += sprintf(p, " x%zu", i);
+    }
+    p += sprintf(p, ";\np0 = x0;\nq0 = x%zu;\n", 3 % n);
+    for (size_t i = 1; i < n; i++){
+        size_t x = (7 * i + 3) % n;
+        p += sprintf(p, "p%zu = (p%zu and not x%zu) or (not p%zu and x%zu);\n", i, i - 1, i, i - 1, i);
+        p += sprintf(p, "q%zu = (q%zu and not x%zu) or (not q%zu and x%zu);\n", i, i - 1, x, i - 1, x);
+    }
+    if (differ){
+        p += sprintf(p, "t = x0 and x1 and x2;\nq = (q%zu and not t) or (not q%zu and t);\n", n - 1, n - 1);
+    }
+    else {
+        p += sprintf(p, "q = q%zu;\n", n - 1);
+    }
+    sprintf(p, "equiv p%zu q;\n", n - 1);
+    Formula *formula = compile(text);
+    free(text);
+    return formula;
+}
+
+static char* query_text(const Formula *formula, double budget){
+    FILE *out = open_temporary();
+    run_query(formula, &formula->statements[0], budget, out);
+    return contents(out);
+}
+
+// The solver gives up at a restart past its deadline, and run_query then simulates the rest
+static void test_sat_deadline(void){
+    Formula *formula = parity_miter(20, 0);
+    const Statement *stmt = &formula->statements[0];
+    EXPECT(check_satisfiable(formula, stmt, now_seconds()) == -1);
+    EXPECT(check_satisfiable(formula, stmt, 0) == 0);
+    char *text = query_text(formula, 1e-9);
+    EXPECT(strcmp(text, "# equiv p19 q: EQUIVALENT\n") == 0);
+    free(text);
+    free_formula(formula);
+
+    // the same first differing row from the solver and from simulation
+    formula = parity_miter(20, 1);
+    char *solved = query_text(formula, 0);
+    char *simulated = query_text(formula, 1e-9);
+    EXPECT(strncmp(solved, "# equiv p19 q: DIFFERENT\n", 25) == 0);
+    EXPECT(strstr(solved, "\n1 1 1 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 ") != NULL);
+    EXPECT(strcmp(solved, simulated) == 0);
+    free(simulated);
+    free(solved);
+    free_formula(formula);
+}
+
+/* ENGINES */
+
+// Whether the planner picks engine for statement s; its estimates rest on timings a loaded
+// machine can upset, so it gets three tries
+static int planner_picks(const Formula *formula, size_t s, Engine engine, const Options *options){
+    int picked = 0;
+    for (int attempt = 0; attempt < 3 && !picked; attempt++){
+        Plan plan;
+        plan_statement(formula, &formula->statements[s], options, &plan);
+        picked = plan.engine == engine;
+        free_plan(&plan);
+    }
+    return picked;
+}
+
+// What statement s prints with the engine of its plan replaced by engine
+static char* print_forced(const Formula *formula, size_t s, Engine engine, const Options *options){
+    const Statement *stmt = &formula->statements[s];
+    Plan plan;
+    plan_statement(formula, stmt, options, &plan);
+    if (engine == ENGINE_SYMMETRY && plan.symmetry.num_classes == 0){
+        free_symmetry(&plan.symmetry);
+        find_symmetry(formula, stmt, 1.0, &plan.symmetry);  // the table was too small to look
+    }
+    plan.engine = plan.fallback = engine;
+    FILE *out = open_temporary();
+    run_planned(formula, stmt, &plan, options, out);
+    free_plan(&plan);
+    return contents(out);
+}
+
+// Every statement prints through engine what the scan prints, and prints some rows
+static void expect_engine(const Formula *formula, Engine engine, const Options *options){
+    for (size_t s = 0; s < formula->num_statements; s++){
+        char *expected = print_forced(formula, s, ENGINE_SCAN, options);
+        char *printed = print_forced(formula, s, engine, options);
+        EXPECT(count_lines(expected) > 1);
+        EXPECT(strcmp(expected, printed) == 0);
+        free(printed);
+        free(expected);
+    }
+}
+
+// 16 variables and a cheap formula: the planner picks the pipeline for show, whose text dominates
+static const char *pipelined_text =
+    "var a0 a1 a2 a3 a4 a5 a6 a7 a8 a9 a10 a11 a12 a13 a14 a15;\n"
+    "f = (a0 and a1) or (a2 and not a3) or (a5 and a9 and not a14);\n"
+    "show f;\n"
+    "show_ones f;\n";
+
+static void test_engine_pipeline(void){
+    Formula *formula = compile(pipelined_text);
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.inflight = 3;
+    for (size_t threads = 1; threads <= 4; threads += 3){
+        options.num_threads = threads;
+        EXPECT(planner_picks(formula, 0, ENGINE_PIPELINE, &options));
+        expect_engine(formula, ENGINE_PIPELINE, &options);
+    }
+    free_formula(formula);
+}
+
+// num_vars variables, t a chain of layers multiplexers on variables drawn at random, so few
+// variables are symmetric, and f the conjunction of the first conj variables with t; then statements
+static Formula* layered_formula(size_t num_vars, size_t conj, size_t layers, const char *statements){
+    char *text = malloc(8 * num_vars + 96 * layers + strlen(statements) + 64);
+    if (text == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    uint32_t seed = 1;
+    size_t v[4];
+    char *p = text;
+    p += sprintf(p, "var");
+    for (size_t i = 0; i < num_vars; i++){
+        p += sprintf(p, " a%zu", i);
+    }
+    for (size_t i = 0; i < layers; i++){
+        for (int k = 0; k < 4; k++){
+            seed = (seed * 1103515245u + 12345u) & 0x7fffffff;
+            v[k] = (seed >> 8) % num_vars;
+        }
+        if (i == 0){
+            p += sprintf(p, ";\nt0 = (a%zu and not a%zu) or (a%zu and a%zu)", v[0], v[1], v[2], v[3]);
+        }
+        else {
+            p += sprintf(p, ";\nt%zu = (t%zu and a%zu) or (not t%zu and a%zu and not a%zu)", i, i - 1, v[0], i - 1, v[1], v[2]);
+        }
+    }
+    p += sprintf(p, ";\nf =");
+    for (size_t i = 0; i < conj; i++){
+        p += sprintf(p, " a%zu and", i);
+    }
+    sprintf(p, " t%zu;\n%s", layers - 1, statements);
+    Formula *formula = compile(text);
+    free(text);
+    return formula;
+}
+
+// 22 variables, a deep cone and four of them set on every printed row: the planner picks pruning
+static void test_engine_prune(void){
+    Formula *formula = layered_formula(22, 4, 40, "show_ones f;\n");
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 1;
+    EXPECT(planner_picks(formula, 0, ENGINE_PRUNE, &options));
+    expect_engine(formula, ENGINE_PRUNE, &options);
+    free_formula(formula);
+}
+
+// Pruning past its budget stops between two subcubes, and the pipeline prints the rest
+static void test_prune_budget(void){
+    Formula *formula = layered_formula(22, 4, 40, "show_ones f;\n");
+    const Statement *stmt = &formula->statements[0];
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 2;
+    unsigned long rows = 1UL << stmt->num_vars;
+
+    FILE *out = open_temporary();
+    unsigned long row = show_ones_pruned(formula, stmt, &options, now_seconds() - 1, out);
+    EXPECT(row > 0 && row < rows && row % (1UL << PRUNE_LEAF_VARS) == 0);
+    fclose(out);
+
+    char *expected = print_forced(formula, 0, ENGINE_SCAN, &options);
+    for (int budget = 0; budget <= 4; budget += 2){
+        Plan plan;
+        plan_statement(formula, stmt, &options, &plan);
+        plan.engine = ENGINE_PRUNE;
+        plan.fallback = ENGINE_PIPELINE;
+        plan.budget = budget * 1e-3 + 1e-9;  // stopped at the first subcube, or somewhere further
+        out = open_temporary();
+        run_planned(formula, stmt, &plan, &options, out);
+        char *printed = contents(out);
+        EXPECT(strcmp(expected, printed) == 0);
+        free(printed);
+        free_plan(&plan);
+    }
+    free(expected);
+    free_formula(formula);
+}
+
+// An explicit --split asks the planner for the cofactors
+static void test_engine_cofactor(void){
+    Formula *formula = layered_formula(18, 4, 40, "show_ones f;\nshow f;\n");
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 4;
+    options.split = 4;
+    for (size_t s = 0; s < formula->num_statements; s++){
+        EXPECT(planner_picks(formula, s, ENGINE_COFACTOR, &options));
+    }
+    expect_engine(formula, ENGINE_COFACTOR, &options);
+    free_formula(formula);
+}
+
+// Three classes of 7, 7 and 10 variables, on a table large enough for the planner to look for them
+static const char *wide_symmetric_text =
+    "var a3 b0 a1 b4 a0 b6 a5 b2 a2 b5 a6 b1 a4 b3 d0 d1 d2 d3 d4 d5 d6 d7 d8 d9;\n"
+    "all_a = a0 and a1 and a2 and a3 and a4 and a5 and a6;\n"
+    "any_a = a0 or a1 or a2 or a3 or a4 or a5 or a6;\n"
+    "all_b = b0 and b1 and b2 and b3 and b4 and b5 and b6;\n"
+    "any_b = b0 or b1 or b2 or b3 or b4 or b5 or b6;\n"
+    "any_d = d0 or d1 or d2 or d3 or d4 or d5 or d6 or d7 or d8 or d9;\n"
+    "f = (all_a or not any_a) and any_b and not all_b and not any_d;\n"
+    "show_ones f;\n";
+
+static void test_engine_symmetry(void){
+    Formula *formula = compile(wide_symmetric_text);
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 2;
+    EXPECT(planner_picks(formula, 0, ENGINE_SYMMETRY, &options));
+    expect_engine(formula, ENGINE_SYMMETRY, &options);
+    free_formula(formula);
+}
+
+// The formula of the pipeline on 18 variables, printed with four threads into a file: the planner
+// maps the file, whose text costs more to write through a stream than to evaluate
+static void test_engine_mapped(void){
+    Formula *formula = compile("var a0 a1 a2 a3 a4 a5 a6 a7 a8 a9 a10 a11 a12 a13 a14 a15 a16 a17;\n"
+                               "f = (a0 and a1) or (a2 and not a3) or (a5 and a9 and not a14);\n"
+                               "show f;\n"
+                               "show_ones f;\n");
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 4;
+    options.output = "table.txt";  // only tells the planner the output is a file
+    for (size_t s = 0; s < formula->num_statements; s++){
+        EXPECT(planner_picks(formula, s, ENGINE_MAPPED, &options));
+    }
+    expect_engine(formula, ENGINE_MAPPED, &options);
+
+    // the second statement is mapped past the text of the first
+    FILE *scanned = open_temporary(), *mapped = open_temporary();
+    for (size_t s = 0; s < formula->num_statements; s++){
+        Plan plan;
+        plan_statement(formula, &formula->statements[s], &options, &plan);
+        plan.engine = ENGINE_SCAN;
+        run_planned(formula, &formula->statements[s], &plan, &options, scanned);
+        plan.engine = ENGINE_MAPPED;
+        run_planned(formula, &formula->statements[s], &plan, &options, mapped);
+        free_plan(&plan);
+    }
+    char *expected = contents(scanned), *printed = contents(mapped);
+    EXPECT(strcmp(expected, printed) == 0);
+    free(printed);
+    free(expected);
+    free_formula(formula);
+}
+
+// One sweep of statements first..end-1 prints what the scan prints for each in turn
+static void expect_fused(const Formula *formula, size_t first, size_t end, const Options *options){
+    FILE *out = open_temporary();
+    for (size_t s = first; s < end; s++){
+        run_statement(formula, &formula->statements[s], out);
+    }
+    char *expected = contents(out);
+    out = open_temporary();
+    run_fused(formula, first, end, options, out);
+    char *printed = contents(out);
+    EXPECT(strcmp(expected, printed) == 0);
+    free(printed);
+    free(expected);
+}
+
+// Four show_ones statements sharing a deep cone: the planner prints them from one sweep
+static void test_engine_fusion(void){
+    Options options;
+    memset(&options, 0, sizeof(options));
+    options.num_threads = 1;
+    Formula *formula = layered_formula(18, 4, 40, "g = f and a4;\nh = f and not a5;\nk = f and a6;\n"
+                                                  "show_ones f;\nshow_ones g;\nshow_ones h;\nshow_ones k;\n");
+    int fused = 0;
+    for (int attempt = 0; attempt < 3 && !fused; attempt++){
+        Plan plans[4];
+        for (size_t s = 0; s < 4; s++){
+            plan_statement(formula, &formula->statements[s], &options, &plans[s]);
+        }
+        size_t end;
+        double one_sweep, one_by_one;
+        fused = plan_fusion(formula, plans, 0, &options, &end, &one_sweep, &one_by_one) && end == 4;
+        for (size_t s = 0; s < 4; s++){
+            free_plan(&plans[s]);
+        }
+    }
+    EXPECT(fused);
+    expect_fused(formula, 0, 4, &options);
+    free_formula(formula);
+
+    // show next to show_ones, and statements reached with fewer variables than the sweep
+    formula = layered_formula(16, 3, 30, "g = f and a4;\nshow_ones g;\nshow f g;\n"
+                                         "var b c;\nh = (f and b) or (g and not c);\nshow_ones h f;\nshow_ones g;\n");
+    expect_fused(formula, 0, formula->num_statements, &options);
+    expect_fused(formula, 1, 3, &options);
+    free_formula(formula);
+}
+
+typedef struct {
+    const char *name;
+    void (*run)(void);
+} UnitTest;
+
+static const UnitTest tests[] = {
+    {"engine_cofactor", test_engine_cofactor},
+    {"engine_fusion", test_engine_fusion},
+    {"engine_mapped", test_engine_mapped},
+    {"engine_pipeline", test_engine_pipeline},
+    {"engine_prune", test_engine_prune},
+    {"engine_symmetry", test_engine_symmetry},
+    {"lut_rejected_mapping", test_lut_rejected_mapping},
+    {"prune_budget", test_prune_budget},
+    {"sat_deadline", test_sat_deadline},
+    {"symmetry_pipeline", test_symmetry_pipeline},
+    {"symmetry_true_words", test_symmetry_true_words},
+};
+
+int main(int argc, char *argv[]){
+    size_t num_tests = sizeof(tests) / sizeof(tests[0]);
+    for (size_t i = 0; i < num_tests; i++){
+        if (argc < 2 || strcmp(argv[1], tests[i].name) == 0){
+            tests[i].run();
+            if (argc >= 2){
+                return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+            }
+        }
+    }
+    if (argc >= 2){
+        fprintf(stderr, "Unknown test %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "table.h"
+
+/*
+ * Watch mode: reruns the file every time it is saved.
+ *
+ * Every version is compiled into the same structurally hashed instruction store, so an
+ * assignment whose text and dependencies did not change gets the same instruction as in
+ * the previous version, and expressions whose text did not change are not even reparsed.
+ * Output columns are cached bit-packed, keyed by (instruction, declared variables): only
+ * the shown variables whose cone of influence changed are evaluated again.
+ */
+
+#define WATCH_POLL_MS 200
+#define MAX_CACHED_VARS 24           // 2 MiB per cached column
+#define MAX_STORE_SIZE (1u << 22)    // Start over when old versions pile up in the store
+
+typedef struct {
+    unsigned int instr;
+    size_t num_vars;
+    uint64_t *bits;   // Bit r is the value on row r
+} Column;
+
+typedef struct {
+    Column *columns;
+    size_t count;
+} ColumnCache;
+
+typedef struct {
+    Formula *formula;   // Instruction store shared by all versions of the file
+    Dict *parsed;       // Expression text -> tree, for the current version
+    ColumnCache cache;
+    unsigned long evaluated;  // Columns computed during the last refresh
+    unsigned long reused;     // Columns taken from the cache during the last refresh
+} WatchState;
+
+static void free_columns(ColumnCache *cache){
+    for (size_t i = 0; i < cache->count; i++){
+        free(cache->columns[i].bits);
+    }
+    free(cache->columns);
+    cache->columns = NULL;
+    cache->count = 0;
+}
+
+static Column* find_column(ColumnCache *cache, unsigned int instr, size_t num_vars){
+    for (size_t i = 0; i < cache->count; i++){
+        if (cache->columns[i].instr == instr && cache->columns[i].num_vars == num_vars &&
+            cache->columns[i].bits != NULL){
+            return &cache->columns[i];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t* push_column(ColumnCache *cache, unsigned int instr, size_t num_vars, uint64_t *bits){
+    cache->columns = realloc(cache->columns, (cache->count + 1) * sizeof(Column));
+    if (cache->columns == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    cache->columns[cache->count].instr = instr;
+    cache->columns[cache->count].num_vars = num_vars;
+    cache->columns[cache->count].bits = bits;
+    cache->count++;
+    return bits;
+}
+
+// Column of instr over the rows of num_vars variables, from the previous round when possible
+static uint64_t* get_column(WatchState *state, ColumnCache *next, unsigned int instr,
+                            size_t num_vars, uint64_t *values){
+    Column *column = find_column(next, instr, num_vars);
+    if (column != NULL){
+        return column->bits;
+    }
+    column = find_column(&state->cache, instr, num_vars);
+    if (column != NULL){
+        uint64_t *bits = column->bits;
+        column->bits = NULL;  // moved to the new cache
+        state->reused++;
+        return push_column(next, instr, num_vars, bits);
+    }
+
+    unsigned long rows = 1UL << num_vars;
+    uint64_t *bits = malloc(((rows + 63) / 64) * sizeof(uint64_t));
+    if (bits == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    Statement single;
+    memset(&single, 0, sizeof(single));
+    single.num_vars = num_vars;
+    single.num_outputs = 1;
+    single.outputs = &instr;
+    compute_cone(state->formula, &single);
+    for (unsigned long base = 0; base < rows; base += 64){
+        eval_word(state->formula, &single, base, values);
+        bits[base / 64] = values[instr];
+    }
+    free(single.cone);
+    state->evaluated++;
+    return push_column(next, instr, num_vars, bits);
+}
+
+// Prints a statement from the cached columns of its outputs
+static void print_from_columns(WatchState *state, ColumnCache *next, const Statement *stmt, uint64_t *values){
+    const Formula *formula = state->formula;
+    uint64_t **columns = malloc((stmt->num_outputs + 1) * sizeof(uint64_t *));
+    if (columns == NULL){
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        columns[j] = get_column(state, next, stmt->outputs[j], stmt->num_vars, values);
+    }
+
+    print_header(stmt, formula->variables, stdout);
+    OutputBuffer *buffer = create_output_buffer(stdout);
+    unsigned long rows = 1UL << stmt->num_vars;
+    for (unsigned long base = 0; base < rows; base += 64){
+        uint64_t ones = 0;
+        for (size_t j = 0; j < stmt->num_outputs; j++){
+            values[stmt->outputs[j]] = columns[j][base / 64];
+            ones |= columns[j][base / 64];
+        }
+        uint64_t selected = valid_rows_mask(rows, base);
+        if (stmt->kind == STMT_SHOW_ONES){
+            selected &= ones;
+        }
+        while (selected != 0){
+            unsigned int bit = __builtin_ctzll(selected);
+            emit_row(buffer, stmt, base + bit, values, bit);
+            selected &= selected - 1;
+        }
+    }
+    flush_output(buffer);
+    free(buffer);
+    free(columns);
+}
+
+// Recompiles the file and prints every statement, returns 0 if the file is malformed
+static int refresh(WatchState *state, const char *input_file){
+    TokenList *token_list = read_file(input_file);
+    if (token_list == NULL){
+        return 0;
+    }
+
+    if (state->formula->size > MAX_STORE_SIZE){
+        free_formula(state->formula);
+        state->formula = create_formula();
+        free_columns(&state->cache);
+    }
+
+    char err[256];
+    Dict *parsed = initialize_dict(token_list->size + 1);
+    int ok = compile_into(state->formula, token_list, state->parsed, parsed, err, sizeof(err));
+    free_token_list(token_list);
+
+    // trees taken over from the previous version were left NULL there, the rest is gone from the file
+    unsigned long expressions = 0, taken = 0;
+    for (unsigned long i = 0; i < parsed->size; i++){
+        expressions += parsed->entries[i] != NULL;
+    }
+    for (unsigned long i = 0; i < state->parsed->size; i++){
+        taken += state->parsed->entries[i] != NULL && state->parsed->entries[i]->node == NULL;
+    }
+    unsigned long reparsed = expressions - taken;
+    free_dict(state->parsed);
+    state->parsed = parsed;
+
+    if (!ok){
+        fprintf(stderr, "%s\n", err);
+        return 0;
+    }
+
+    const Formula *formula = state->formula;
+    uint64_t *values = alloc_values(formula);
+    ColumnCache next = {NULL, 0};
+    state->evaluated = state->reused = 0;
+    for (size_t i = 0; i < formula->num_statements; i++){
+        const Statement *stmt = &formula->statements[i];
+        if (stmt->num_vars > MAX_CACHED_VARS || is_query(stmt)){
+            run_statement(formula, stmt, stdout);
+        }
+        else {
+            print_from_columns(state, &next, stmt, values);
+        }
+    }
+    fflush(stdout);
+    free(values);
+
+    // columns not used by this version are dropped
+    free_columns(&state->cache);
+    state->cache = next;
+
+    fprintf(stderr, "watch: %lu of %lu expressions reparsed, %lu of %lu columns evaluated\n",
+            reparsed, expressions, state->evaluated, state->evaluated + state->reused);
+    return 1;
+}
+
+static int same_version(const struct stat *a, const struct stat *b){
+    return a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec &&
+           a->st_size == b->st_size && a->st_ino == b->st_ino;
+}
+
+// Polls the file and reruns it after every change, until the process is stopped
+int watch(const char *input_file){
+    struct stat last;
+    if (stat(input_file, &last) != 0){
+        perror("error opening file");
+        return EXIT_FAILURE;
+    }
+
+    WatchState state;
+    state.formula = create_formula();
+    state.parsed = initialize_dict(1);
+    state.cache.columns = NULL;
+    state.cache.count = 0;
+    refresh(&state, input_file);
+
+    struct timespec interval = {0, WATCH_POLL_MS * 1000000L};
+    for (;;){
+        nanosleep(&interval, NULL);
+        struct stat now;
+        // editors that save by renaming leave the path missing for a moment
+        if (stat(input_file, &now) != 0 || same_version(&now, &last)){
+            continue;
+        }
+        last = now;
+        refresh(&state, input_file);
+    }
+
+    return EXIT_SUCCESS;
+}
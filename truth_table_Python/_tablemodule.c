@@ -0,0 +1,511 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include "table.h"
+
+/*
+ * Optional native engine for table.py.
+ *
+ * evaluate(variables, assignments, names, node_types) compiles the Python AST into the
+ * structurally hashed instructions of the C implementation, evaluates the shown names 64 rows at
+ * a time and returns a Table: the bit-packed columns, one row of uint64 words per shown name
+ * (bit r % 64 of word r / 64 is the value on row r), exported through the buffer protocol.
+ * node_types is the tuple of the node classes (Boolean, Variable, Not, And, Or) of table.py.
+ * Table.write(fd, ones_only) prints the rows the way show() and show_ones() do, without
+ * creating a Python object per row.
+ *
+ * Assignments are compiled in dictionary order and may only use the declared variables and the
+ * assignments before them, like the pure Python evaluation; names that are neither give a
+ * column of zeros when shown.
+ *
+ * The AST is first flattened into steps with only the Python API, then the C engine builds the
+ * formula from the steps without calling back into Python: its allocation failures unwind
+ * through out_of_memory to the caller, which raises MemoryError instead of exiting.
+ */
+
+typedef struct {
+    PyObject_HEAD
+    size_t num_vars;
+    size_t num_outputs;
+    size_t words;           // Words per column
+    uint64_t *bits;         // num_outputs columns of words
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+} TableObject;
+
+typedef struct {
+    PyTypeObject *boolean, *variable, *not, *and, *or;
+} NodeTypes;
+
+// One node of the flattened AST: an instruction whose operands are earlier steps (the variable
+// index for OP_INPUT, the value for OP_CONST)
+typedef struct {
+    unsigned char op;
+    unsigned int a, b;
+} Step;
+
+typedef struct {
+    Step *steps;
+    size_t size;
+    size_t capacity;
+} Program;
+
+/* OUT OF MEMORY */
+
+static jmp_buf allocation_jump;  // Only used with the GIL held and no Python code running
+
+static void unwind(void){
+    longjmp(allocation_jump, 1);
+}
+
+/* COMPILATION */
+
+// Appends a step, returns 0 with MemoryError set on failure
+static int add_step(Program *program, unsigned char op, unsigned int a, unsigned int b, unsigned int *result){
+    if (program->size >= UINT_MAX){
+        PyErr_NoMemory();
+        return 0;
+    }
+    if (program->size == program->capacity){
+        size_t capacity = program->capacity * 2 + 64;
+        Step *steps = PyMem_Realloc(program->steps, capacity * sizeof(Step));
+        if (steps == NULL){
+            PyErr_NoMemory();
+            return 0;
+        }
+        program->steps = steps;
+        program->capacity = capacity;
+    }
+    program->steps[program->size].op = op;
+    program->steps[program->size].a = a;
+    program->steps[program->size].b = b;
+    *result = (unsigned int)program->size++;
+    return 1;
+}
+
+// Flattens a node, returns 0 with a Python exception set on failure
+static int compile_node(Program *program, const NodeTypes *types, PyObject *symbols, PyObject *node,
+                        unsigned int *result){
+    if (PyObject_TypeCheck(node, types->boolean)){
+        PyObject *value = PyObject_GetAttrString(node, "value");
+        if (value == NULL){
+            return 0;
+        }
+        int truth = PyObject_IsTrue(value);
+        Py_DECREF(value);
+        if (truth < 0){
+            return 0;
+        }
+        return add_step(program, OP_CONST, truth, 0, result);
+    }
+    if (PyObject_TypeCheck(node, types->variable)){
+        PyObject *name = PyObject_GetAttrString(node, "name");
+        if (name == NULL){
+            return 0;
+        }
+        PyObject *step = PyDict_GetItemWithError(symbols, name);
+        if (step == NULL){
+            if (!PyErr_Occurred()){
+                PyErr_SetObject(PyExc_KeyError, name);  // same error as the row by row evaluation
+            }
+            Py_DECREF(name);
+            return 0;
+        }
+        Py_DECREF(name);
+        *result = (unsigned int)PyLong_AsUnsignedLong(step);
+        return 1;
+    }
+    if (PyObject_TypeCheck(node, types->not)){
+        PyObject *child = PyObject_GetAttrString(node, "child");
+        if (child == NULL){
+            return 0;
+        }
+        unsigned int a;
+        int ok = compile_node(program, types, symbols, child, &a);
+        Py_DECREF(child);
+        return ok && add_step(program, OP_NOT, a, 0, result);
+    }
+    int is_and = PyObject_TypeCheck(node, types->and);
+    if (is_and || PyObject_TypeCheck(node, types->or)){
+        PyObject *left = PyObject_GetAttrString(node, "left");
+        PyObject *right = left != NULL ? PyObject_GetAttrString(node, "right") : NULL;
+        unsigned int a, b;
+        int ok = right != NULL && compile_node(program, types, symbols, left, &a) &&
+                 compile_node(program, types, symbols, right, &b);
+        Py_XDECREF(left);
+        Py_XDECREF(right);
+        return ok && add_step(program, is_and ? OP_AND : OP_OR, a, b, result);
+    }
+
+    PyErr_Format(PyExc_TypeError, "unexpected node of type %s", Py_TYPE(node)->tp_name);
+    return 0;
+}
+
+// Binds name to step in symbols, returns 0 with an exception set on failure
+static int bind(PyObject *symbols, PyObject *name, unsigned int step){
+    PyObject *value = PyLong_FromUnsignedLong(step);
+    if (value == NULL){
+        return 0;
+    }
+    int status = PyDict_SetItem(symbols, name, value);
+    Py_DECREF(value);
+    return status == 0;
+}
+
+// Reads the node classes out of node_types, returns 0 with TypeError set when it is not a tuple
+// of five classes
+static int read_node_types(PyObject *node_types, NodeTypes *types){
+    PyTypeObject **fields[5] = {&types->boolean, &types->variable, &types->not, &types->and, &types->or};
+    if (!PyTuple_Check(node_types) || PyTuple_GET_SIZE(node_types) != 5){
+        PyErr_SetString(PyExc_TypeError, "node_types must be the tuple (Boolean, Variable, Not, And, Or)");
+        return 0;
+    }
+    for (Py_ssize_t i = 0; i < 5; i++){
+        PyObject *type = PyTuple_GET_ITEM(node_types, i);
+        if (!PyType_Check(type)){
+            PyErr_SetString(PyExc_TypeError, "node_types must be the tuple (Boolean, Variable, Not, And, Or)");
+            return 0;
+        }
+        *fields[i] = (PyTypeObject *)type;
+    }
+    return 1;
+}
+
+// Builds the formula of the steps and points the outputs of stmt (step indices on entry) at its
+// instructions, with the cone mapped and the evaluation words in values; returns NULL with
+// MemoryError set when the C engine runs out of memory. Calls no Python code.
+static Formula* build_formula(const Program *program, Statement *stmt, uint64_t **values){
+    Formula *volatile formula = NULL;
+    unsigned int *volatile instrs = NULL;
+
+    out_of_memory = unwind;
+    if (setjmp(allocation_jump) != 0){
+        out_of_memory = NULL;
+        free(instrs);
+        free_formula(formula);
+        PyErr_NoMemory();
+        return NULL;
+    }
+
+    instrs = malloc((program->size + 1) * sizeof(unsigned int));
+    if (instrs == NULL){
+        allocation_failed();
+    }
+    formula = create_formula();
+    for (size_t k = 0; k < program->size; k++){
+        const Step *step = &program->steps[k];
+        int operands = step->op == OP_NOT || step->op == OP_AND || step->op == OP_OR;
+        instrs[k] = emit_instr(formula, step->op, operands ? instrs[step->a] : step->a,
+                               operands && step->op != OP_NOT ? instrs[step->b] : step->b);
+    }
+    for (size_t j = 0; j < stmt->num_outputs; j++){
+        stmt->outputs[j] = instrs[stmt->outputs[j]];
+    }
+    compute_cone(formula, stmt);
+    map_luts(formula, stmt);
+    *values = alloc_values(formula);
+
+    out_of_memory = NULL;
+    free(instrs);
+    return formula;
+}
+
+/* TABLE OBJECT */
+
+static void table_dealloc(TableObject *self){
+    free(self->bits);
+    Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static int table_getbuffer(TableObject *self, Py_buffer *view, int flags){
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->buf = self->bits;
+    view->len = (Py_ssize_t)(self->num_outputs * self->words * sizeof(uint64_t));
+    view->itemsize = sizeof(uint64_t);
+    view->readonly = 1;
+    view->format = (flags & PyBUF_FORMAT) ? "Q" : NULL;
+    view->ndim = 2;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE){
+        PyErr_SetString(PyExc_BufferError, "truth tables are read-only");
+        view->obj = NULL;
+        Py_DECREF(self);
+        return -1;
+    }
+    return 0;
+}
+
+static PyBufferProcs table_as_buffer = {
+    (getbufferproc)table_getbuffer,
+    NULL,  // the bits live as long as the table, which every view holds a reference to
+};
+
+// Table.write(fd, ones_only): prints the rows (no header) to a file descriptor
+static PyObject* table_write(TableObject *self, PyObject *args){
+    int fd, ones_only;
+    if (!PyArg_ParseTuple(args, "ip", &fd, &ones_only)){
+        return NULL;
+    }
+    int copy = dup(fd);
+    FILE *out = copy >= 0 ? fdopen(copy, "w") : NULL;
+    if (out == NULL){
+        if (copy >= 0){
+            close(copy);
+        }
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+
+    // formatting view of the statement: output j is value j
+    Statement view;
+    memset(&view, 0, sizeof(view));
+    view.num_vars = self->num_vars;
+    view.num_outputs = self->num_outputs;
+    view.outputs = malloc((self->num_outputs + 1) * sizeof(unsigned int));
+    uint64_t *values = malloc((self->num_outputs + 1) * sizeof(uint64_t));
+    if (view.outputs == NULL || values == NULL){
+        fclose(out);
+        free(view.outputs);
+        free(values);
+        return PyErr_NoMemory();
+    }
+    for (size_t j = 0; j < self->num_outputs; j++){
+        view.outputs[j] = j;
+    }
+
+    out_of_memory = unwind;
+    if (setjmp(allocation_jump) != 0){
+        out_of_memory = NULL;
+        fclose(out);
+        free(view.outputs);
+        free(values);
+        return PyErr_NoMemory();
+    }
+    OutputBuffer *buffer = create_output_buffer(out);
+    out_of_memory = NULL;
+
+    int failed;
+    Py_BEGIN_ALLOW_THREADS
+    unsigned long rows = 1UL << self->num_vars;
+    for (unsigned long base = 0; base < rows; base += 64){
+        uint64_t ones = 0;
+        for (size_t j = 0; j < self->num_outputs; j++){
+            values[j] = self->bits[j * self->words + base / 64];
+            ones |= values[j];
+        }
+        uint64_t selected = valid_rows_mask(rows, base);
+        if (ones_only){
+            selected &= ones;
+        }
+        while (selected != 0){
+            unsigned int bit = __builtin_ctzll(selected);
+            emit_row(buffer, &view, base + bit, values, bit);
+            selected &= selected - 1;
+        }
+    }
+    flush_output(buffer);
+    free(buffer);
+    failed = ferror(out) | fclose(out);
+    Py_END_ALLOW_THREADS
+
+    free(values);
+    free(view.outputs);
+    if (failed){
+        return PyErr_SetFromErrno(PyExc_OSError);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef table_methods[] = {
+    {"write", (PyCFunction)table_write, METH_VARARGS, "write(fd, ones_only): print the rows to a file descriptor"},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyObject* table_get_num_vars(TableObject *self, void *closure){
+    (void)closure;
+    return PyLong_FromSize_t(self->num_vars);
+}
+
+static PyObject* table_get_num_outputs(TableObject *self, void *closure){
+    (void)closure;
+    return PyLong_FromSize_t(self->num_outputs);
+}
+
+static PyGetSetDef table_getset[] = {
+    {"num_vars", (getter)table_get_num_vars, NULL, "number of declared variables", NULL},
+    {"num_outputs", (getter)table_get_num_outputs, NULL, "number of shown names", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyTypeObject TableType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "_table.Table",
+    .tp_basicsize = sizeof(TableObject),
+    .tp_dealloc = (destructor)table_dealloc,
+    .tp_as_buffer = &table_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Bit-packed truth table columns, one row of uint64 words per shown name",
+    .tp_methods = table_methods,
+    .tp_getset = table_getset,
+};
+
+/* MODULE */
+
+// evaluate(variables, assignments, names, node_types) -> Table
+static PyObject* evaluate(PyObject *module, PyObject *args){
+    (void)module;
+    PyObject *variables, *assignments, *names, *node_types;
+    NodeTypes types;
+    if (!PyArg_ParseTuple(args, "OO!OO", &variables, &PyDict_Type, &assignments, &names, &node_types) ||
+        !read_node_types(node_types, &types)){
+        return NULL;
+    }
+    PyObject *variable_list = PySequence_Fast(variables, "variables must be a sequence");
+    PyObject *name_list = variable_list != NULL ? PySequence_Fast(names, "names must be a sequence") : NULL;
+    PyObject *symbols = PyDict_New();
+    if (name_list == NULL || symbols == NULL){
+        Py_XDECREF(variable_list);
+        Py_XDECREF(name_list);
+        Py_XDECREF(symbols);
+        return NULL;
+    }
+
+    size_t num_vars = PySequence_Fast_GET_SIZE(variable_list);
+    size_t num_outputs = PySequence_Fast_GET_SIZE(name_list);
+    Program program = {NULL, 0, 0};
+    Formula *formula = NULL;
+    uint64_t *values = NULL;
+    Statement stmt;
+    memset(&stmt, 0, sizeof(stmt));
+    TableObject *table = NULL;
+    int ok = 1;
+
+    if (num_vars >= 64){
+        PyErr_SetString(PyExc_ValueError, "Cannot enumerate the rows of 64 variables");
+        ok = 0;
+    }
+    for (size_t i = 0; ok && i < num_vars; i++){
+        unsigned int step;
+        ok = add_step(&program, OP_INPUT, i, 0, &step) &&
+             bind(symbols, PySequence_Fast_GET_ITEM(variable_list, i), step);
+    }
+
+    PyObject *key, *node;
+    Py_ssize_t position = 0;
+    while (ok && PyDict_Next(assignments, &position, &key, &node)){
+        unsigned int step;
+        ok = compile_node(&program, &types, symbols, node, &step) && bind(symbols, key, step);
+    }
+
+    if (ok){
+        stmt.kind = STMT_SHOW;
+        stmt.num_vars = num_vars;
+        stmt.num_outputs = num_outputs;
+        stmt.outputs = malloc((num_outputs + 1) * sizeof(unsigned int));
+        if (stmt.outputs == NULL){
+            PyErr_NoMemory();
+            ok = 0;
+        }
+    }
+    for (size_t j = 0; ok && j < num_outputs; j++){
+        PyObject *step = PyDict_GetItemWithError(symbols, PySequence_Fast_GET_ITEM(name_list, j));
+        if (step == NULL && PyErr_Occurred()){
+            ok = 0;
+        }
+        else if (step != NULL){
+            stmt.outputs[j] = (unsigned int)PyLong_AsUnsignedLong(step);
+        }
+        else {
+            // unknown names show as 0, like truth_table.get(var) in table.py
+            ok = add_step(&program, OP_CONST, 0, 0, &stmt.outputs[j]);
+        }
+    }
+
+    if (ok){
+        table = PyObject_New(TableObject, &TableType);
+        if (table == NULL){
+            ok = 0;
+        }
+    }
+    if (ok){
+        table->num_vars = num_vars;
+        table->num_outputs = num_outputs;
+        table->words = ((1UL << num_vars) + 63) / 64;
+        table->shape[0] = (Py_ssize_t)num_outputs;
+        table->shape[1] = (Py_ssize_t)table->words;
+        table->strides[0] = (Py_ssize_t)(table->words * sizeof(uint64_t));
+        table->strides[1] = sizeof(uint64_t);
+        table->bits = malloc((num_outputs * table->words + 1) * sizeof(uint64_t));
+        if (table->bits == NULL){
+            PyErr_NoMemory();
+            ok = 0;
+        }
+    }
+
+    if (ok){
+        formula = build_formula(&program, &stmt, &values);
+        ok = formula != NULL;
+    }
+    if (ok){
+        Py_BEGIN_ALLOW_THREADS
+        unsigned long rows = 1UL << num_vars;
+        for (unsigned long base = 0; base < rows; base += 64){
+            eval_word(formula, &stmt, base, values);
+            for (size_t j = 0; j < num_outputs; j++){
+                table->bits[j * table->words + base / 64] = values[stmt.outputs[j]] & valid_rows_mask(rows, base);
+            }
+        }
+        Py_END_ALLOW_THREADS
+    }
+    if (!ok && table != NULL){
+        Py_DECREF(table);
+        table = NULL;
+    }
+
+    free(values);
+    free(stmt.outputs);
+    free(stmt.cone);
+    free_formula(formula);
+    PyMem_Free(program.steps);
+    Py_DECREF(symbols);
+    Py_DECREF(name_list);
+    Py_DECREF(variable_list);
+    return (PyObject *)table;
+}
+
+static PyMethodDef module_methods[] = {
+    {"evaluate", evaluate, METH_VARARGS,
+     "evaluate(variables, assignments, names, node_types) -> Table of the bit-packed columns of names"},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef table_module = {
+    PyModuleDef_HEAD_INIT,
+    "_table",
+    "Native truth table engine for table.py",
+    -1,
+    module_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit__table(void){
+    if (PyType_Ready(&TableType) < 0){
+        return NULL;
+    }
+    PyObject *module = PyModule_Create(&table_module);
+    if (module == NULL){
+        return NULL;
+    }
+    Py_INCREF(&TableType);
+    if (PyModule_AddObject(module, "Table", (PyObject *)&TableType) < 0){
+        Py_DECREF(&TableType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
@@ -0,0 +1,24 @@
+# Builds the optional native engine used by table.py:
+#     python3 setup.py build_ext --inplace
+# table.py falls back to pure Python evaluation when _table is not built.
+import glob
+import os
+
+from setuptools import Extension, setup
+
+os.chdir(os.path.dirname(os.path.abspath(__file__)))
+engine = os.path.join("..", "truth_table_C")
+
+setup(
+    name="truth_table_native",
+    ext_modules=[
+        Extension(
+            "_table",
+            sources=["_tablemodule.c"] + sorted(glob.glob(os.path.join(engine, "*.c"))),
+            include_dirs=[engine],
+            define_macros=[("TABLE_NO_MAIN", None)],
+            extra_compile_args=["-O3", "-pthread"],
+            extra_link_args=["-pthread"],
+        )
+    ],
+)
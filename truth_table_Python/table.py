@@ -1,5 +1,21 @@
 import sys
 
+try:
+    import _table as native  # Optional C engine, built with setup.py
+except ImportError:
+    native = None
+
+try:
+    import numpy as np  # Optional, enables the vectorized evaluation
+except ImportError:
+    np = None
+
+CHUNK_WORDS = 1 << 12  # Words (64 rows each) evaluated together
+LINE_WORDS = 1 << 10   # Words formatted together
+ALL_ONES = (1 << 64) - 1
+LOW_BIT_PATTERNS = [0xAAAAAAAAAAAAAAAA, 0xCCCCCCCCCCCCCCCC, 0xF0F0F0F0F0F0F0F0,
+                    0xFF00FF00FF00FF00, 0xFFFF0000FFFF0000, 0xFFFFFFFF00000000]  # Row bit k inside a word
+
 # Base class for all nodes in AST
 class TreeNode:
     def evaluate(self, assignments):
@@ -13,6 +29,9 @@ class Boolean(TreeNode):
     def evaluate(self, assignments):
         return self.value  # Just return the Boolean value
 
+    def vectorize(self, columns):
+        return np.uint64(ALL_ONES if self.value else 0)  # Broadcast against the word arrays
+
 #Variable
 class Variable(TreeNode):
     def __init__(self, name):
@@ -21,6 +40,9 @@ class Variable(TreeNode):
     def evaluate(self, assignments):
         return assignments[self.name]  # Get the variable's value from assignments
 
+    def vectorize(self, columns):
+        return columns[self.name]
+
 #not
 class Not(TreeNode):
     def __init__(self, child):
@@ -29,6 +51,9 @@ class Not(TreeNode):
     def evaluate(self, assignments):
         return not self.child.evaluate(assignments)  # Return the opposite of the child's value
 
+    def vectorize(self, columns):
+        return ~self.child.vectorize(columns)
+
 #and
 class And(TreeNode):
     def __init__(self, left, right):
@@ -41,6 +66,9 @@ class And(TreeNode):
             return False  # Short-circuit: no need to evaluate the right side if left is False
         return self.right.evaluate(assignments)  # Evaluate the right side
 
+    def vectorize(self, columns):
+        return self.left.vectorize(columns) & self.right.vectorize(columns)
+
 #or
 class Or(TreeNode):
     def __init__(self, left, right):
@@ -53,6 +81,11 @@ class Or(TreeNode):
             return True  # Short-circuit: no need to evaluate the right side if left is True
         return self.right.evaluate(assignments)  # Evaluate the right side
 
+    def vectorize(self, columns):
+        return self.left.vectorize(columns) | self.right.vectorize(columns)
+
+NODE_TYPES = (Boolean, Variable, Not, And, Or)  # Node classes, in the order the native engine reads them
+
 # Tokenizer into list
 def tokenizer(input_data: str) -> list:
     special = ["(", ")", "=", ";"]  # Special characters we need to handle
@@ -220,11 +253,94 @@ def assignment(tokens):
             raise ValueError(f"Unexpected token {token} in assignments")  # Handle unexpected tokens
     return assignments
 
+# Prints the rows with the native engine, returns False when it cannot handle the input
+def native_rows(assignments, variables, vars_to_show, ones_only):
+    if native is None or not set(variables).isdisjoint(assignments):
+        return False  # Reassigned variables change their own columns, left to the Python path
+    try:
+        table = native.evaluate(variables, assignments, vars_to_show, NODE_TYPES)
+    except KeyError:
+        return False  # Unbound name, the Python path raises it only on the rows that reach it
+    sys.stdout.flush()
+    try:
+        table.write(sys.stdout.fileno(), ones_only)
+    except (AttributeError, OSError, ValueError):  # stdout without a file descriptor
+        columns = memoryview(table).tolist()
+        width = len(variables)
+        for val in range(1 << width):
+            word, bit = divmod(val, 64)
+            row = [(column[word] >> bit) & 1 for column in columns]
+            if ones_only and not any(row):
+                continue
+            bits = [str((val >> (width - 1 - i)) & 1) for i in range(width)]
+            print(" ".join(bits + [str(value) for value in row]))
+    return True
+
+# Words of the declared variables for the rows first_word * 64 onwards
+def variable_columns(variables, first_word, words):
+    columns = {}
+    width = len(variables)
+    index = np.arange(first_word, first_word + words, dtype=np.uint64)
+    for i, var in enumerate(variables):
+        bit = width - 1 - i
+        if bit < 6:
+            columns[var] = np.uint64(LOW_BIT_PATTERNS[bit])  # Same word everywhere
+        else:
+            columns[var] = np.uint64(0) - ((index >> np.uint64(bit - 6)) & np.uint64(1))
+    return columns
+
+# Text of count rows starting at first_row, one byte per character
+def format_rows(width, shown, first_row, count, ones_only):
+    row = np.arange(first_row, first_row + count, dtype=np.uint64)
+    cells = np.empty((count, width + len(shown)), dtype=np.uint8)
+    for i in range(width):
+        cells[:, i] = (row >> np.uint64(width - 1 - i)) & np.uint64(1)
+    for j, column in enumerate(shown):
+        packed = np.ascontiguousarray(column, dtype="<u8").view(np.uint8)
+        cells[:, width + j] = np.unpackbits(packed, bitorder="little")[:count]
+    if ones_only:
+        cells = cells[cells[:, width:].any(axis=1)]
+    text = np.full((len(cells), max(2 * cells.shape[1], 1)), ord(" "), dtype=np.uint8)
+    text[:, 0:2 * cells.shape[1]:2] = cells + ord("0")
+    text[:, -1] = ord("\n")  # Newline instead of the trailing space
+    return text.tobytes()
+
+# Prints the rows with whole-array NumPy operations, returns False when it cannot handle the input
+def numpy_rows(assignments, variables, vars_to_show, ones_only):
+    if np is None or not set(variables).isdisjoint(assignments):
+        return False  # Reassigned variables change their own columns, left to the Python path
+    width = len(variables)
+    rows = 1 << width
+    total_words = (rows + 63) // 64
+    sys.stdout.flush()
+    out = getattr(sys.stdout, "buffer", None)
+    for first_word in range(0, total_words, CHUNK_WORDS):
+        words = min(CHUNK_WORDS, total_words - first_word)
+        columns = variable_columns(variables, first_word, words)
+        try:
+            for var in assignments:
+                columns[var] = assignments[var].vectorize(columns)  # Each node once per chunk
+        except KeyError:
+            return False  # Unbound name, found on the first chunk before anything is printed
+        shown = [np.broadcast_to(columns.get(var, np.uint64(0)), (words,)) for var in vars_to_show]
+        for start in range(0, words, LINE_WORDS):
+            stop = min(start + LINE_WORDS, words)
+            first_row = (first_word + start) * 64
+            text = format_rows(width, [column[start:stop] for column in shown], first_row,
+                               min(rows - first_row, (stop - start) * 64), ones_only)
+            if out is not None:
+                out.write(text)
+            else:
+                sys.stdout.write(text.decode("ascii"))  # stdout without a binary buffer
+    return True
+
 # Displays the truth table based on the assignments and variables
 def show(assignments, variables, vars_to_show):
     vars_list = variables
     header = vars_list + vars_to_show
     print("# " + " ".join(header))  # Print the table header
+    if native_rows(assignments, variables, vars_to_show, False) or numpy_rows(assignments, variables, vars_to_show, False):
+        return
     rows = 1 << len(vars_list)  # Total number of rows in the truth table (all possible combinations of 0 and 1)
 
     for val in range(rows):
@@ -246,6 +362,8 @@ def show_ones(assignments, variables, vars_to_show):
     vars_list = variables
     header = vars_list + vars_to_show
     print("# " + " ".join(header))  # Print the table header
+    if native_rows(assignments, variables, vars_to_show, True) or numpy_rows(assignments, variables, vars_to_show, True):
+        return
     rows = 1 << len(vars_list)  # Total number of rows in the truth table
 
     for val in range(rows):
@@ -0,0 +1,178 @@
+# Tests of table.py, run from anywhere with
+#     python3 truth_table_Python/tests/test_table.py
+# The native extension is built into a temporary directory first, so an extension built in place
+# is left alone. Every evaluation path must print what the row by row evaluation prints.
+import io
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import unittest
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOURCES = os.path.dirname(HERE)
+BUILD = tempfile.mkdtemp(prefix="table_py_tests_")
+
+table = None  # table.py, imported once the extension is built
+
+
+def setUpModule():
+    global table
+    subprocess.run([sys.executable, os.path.join(SOURCES, "setup.py"), "build_ext", "--build-lib", BUILD,
+                    "--build-temp", os.path.join(BUILD, "temp")], check=True, capture_output=True)
+    sys.path[:0] = [BUILD, SOURCES]  # the fresh extension before one built in place
+    import table as module
+    table = module
+
+
+def tearDownModule():
+    shutil.rmtree(BUILD, ignore_errors=True)
+
+
+def write_input(text):
+    path = os.path.join(BUILD, "input_%d.txt" % write_input.count)
+    write_input.count += 1
+    with open(path, "w") as f:
+        f.write(text)
+    return path
+
+
+write_input.count = 0
+
+
+# Runs table.py on text with only the given engine enabled ("python" is the row by row evaluation),
+# printing to stdout or to a temporary file, which has a file descriptor like a terminal or a pipe;
+# returns the printed text, the exception raised, if any, and whether the engine printed the rows of
+# each show statement itself
+def run_engine(engine, text, stdout=None):
+    saved = table.native, table.np, table.native_rows, table.numpy_rows, sys.stdout
+    handled = []
+
+    def spy(rows):
+        def engine_rows(*args):
+            handled.append(rows(*args))
+            return handled[-1]
+        return engine_rows
+
+    table.native = table.native if engine == "native" else None
+    table.np = table.np if engine == "numpy" else None
+    if engine == "native":
+        table.native_rows = spy(table.native_rows)
+    if engine == "numpy":
+        table.numpy_rows = spy(table.numpy_rows)
+    path = write_input(text)
+    error = None
+    with tempfile.TemporaryFile("w+") as out:
+        sys.stdout = stdout if stdout is not None else out
+        try:
+            table.truth_table(path)
+        except Exception as e:
+            error = e
+        finally:
+            sys.stdout.flush()
+            table.native, table.np, table.native_rows, table.numpy_rows, sys.stdout = saved
+        out.seek(0)
+        return stdout.getvalue() if stdout is not None else out.read(), error, handled
+
+
+def random_expression(rng, names, depth):
+    choice = rng.randrange(6 if depth > 0 else 2)
+    if choice == 0:
+        return rng.choice(names)
+    if choice == 1:
+        return rng.choice(names + ["True", "False"])
+    if choice == 2:
+        return "not " + random_expression(rng, names, depth - 1)
+    operator = rng.choice(["and", "or"])
+    return "(%s %s %s)" % (random_expression(rng, names, depth - 1), operator,
+                           random_expression(rng, names, depth - 1))
+
+
+# A program over num_vars variables with a few assignments built on each other, shown with show and
+# show_ones, including a name that is never assigned
+def random_program(rng, num_vars):
+    variables = ["v%d" % i for i in range(num_vars)]
+    names = list(variables)
+    lines = ["var %s;" % " ".join(variables)]
+    for k in range(rng.randint(1, 5)):
+        lines.append("t%d = %s;" % (k, random_expression(rng, names, 3)))
+        names.append("t%d" % k)
+    assigned = names[num_vars:]
+    lines.append("show %s;" % " ".join(rng.sample(assigned, rng.randint(1, len(assigned))) + ["unset"]))
+    lines.append("show_ones %s;" % " ".join(rng.sample(assigned, rng.randint(1, len(assigned)))))
+    return "\n".join(lines) + "\n"
+
+
+class EngineTestCase(unittest.TestCase):
+    # Checks that every engine prints and raises what the row by row evaluation does, returns
+    # whether each engine printed the rows itself
+    def assert_same(self, text, engines):
+        expected, expected_error, _ = run_engine("python", text)
+        handled = {}
+        for engine in engines:
+            output, error, handled[engine] = run_engine(engine, text)
+            self.assertEqual(output, expected, "%s on\n%s" % (engine, text))
+            self.assertEqual(type(error), type(expected_error), "%s on\n%s" % (engine, text))
+        return handled
+
+
+class NativeTest(EngineTestCase):
+    ENGINE = "native"
+
+    def test_random_programs(self):
+        rng = random.Random(1)
+        for _ in range(60):
+            handled = self.assert_same(random_program(rng, rng.randint(1, 9)), [self.ENGINE])
+            self.assertEqual(handled[self.ENGINE], [True, True])
+
+    def test_reassigned_variable_falls_back(self):
+        handled = self.assert_same("var a b;\na = not a;\nc = a and b;\nshow a c;\nshow_ones c;\n", [self.ENGINE])
+        self.assertEqual(handled[self.ENGINE], [False, False])
+
+    def test_unbound_name_falls_back(self):
+        # the row by row evaluation raises on the first row that reaches y, after the rows before it
+        text = "var a b;\nx = a and y;\ny = b;\nshow x;\n"
+        self.assertIsInstance(run_engine("python", text)[1], KeyError)
+        self.assertEqual(self.assert_same(text, [self.ENGINE])[self.ENGINE], [False])
+        # and never raises when no row reaches it
+        handled = self.assert_same("var a b;\nx = False and y;\ny = b;\nshow_ones x y;\n", [self.ENGINE])
+        self.assertEqual(handled[self.ENGINE], [False])
+
+    def test_stdout_without_file_descriptor(self):
+        text = "var a b c;\nx = (a or b) and not c;\nshow x;\nshow_ones x;\n"
+        expected = run_engine("python", text)[0]
+        output, error, handled = run_engine(self.ENGINE, text, io.StringIO())
+        self.assertIsNone(error)
+        self.assertEqual(handled, [True, True])
+        self.assertEqual(output, expected)
+
+
+class NumpyTest(NativeTest):
+    ENGINE = "numpy"
+
+    def setUp(self):
+        if table.np is None:
+            self.skipTest("NumPy is not installed")
+
+    def test_chunk_and_line_boundaries(self):
+        # chunks of two words formatted a word at a time, over variables above and below bit 6
+        saved = table.CHUNK_WORDS, table.LINE_WORDS
+        table.CHUNK_WORDS, table.LINE_WORDS = 2, 1
+        try:
+            rng = random.Random(2)
+            for _ in range(20):
+                handled = self.assert_same(random_program(rng, rng.randint(7, 10)), [self.ENGINE])
+                self.assertEqual(handled[self.ENGINE], [True, True])
+        finally:
+            table.CHUNK_WORDS, table.LINE_WORDS = saved
+
+    def test_engines_agree(self):
+        rng = random.Random(3)
+        for _ in range(30):
+            self.assert_same(random_program(rng, rng.randint(1, 9)), ["native", "numpy"])
+
+
+if __name__ == "__main__":
+    unittest.main()